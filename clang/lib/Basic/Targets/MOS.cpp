@@ -11,13 +11,22 @@
 //===----------------------------------------------------------------------===//
 
 #include "MOS.h"
+#include "clang/Basic/MacroBuilder.h"
+#include "clang/Basic/TargetBuiltins.h"
 
+using namespace clang;
 using namespace clang::targets;
 
+const Builtin::Info MOSTargetInfo::BuiltinInfo[] = {
+#define BUILTIN(ID, TYPE, ATTRS)                                               \
+  {#ID, TYPE, ATTRS, nullptr, ALL_LANGUAGES, nullptr},
+#include "clang/Basic/BuiltinsMOS.def"
+};
+
 MOSTargetInfo::MOSTargetInfo(const llvm::Triple &Triple, const TargetOptions &)
     : TargetInfo(Triple) {
   static const char Layout[] =
-      "e-p:16:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
+      "e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
   resetDataLayout(Layout);
 
   PointerWidth = 16;
@@ -42,6 +51,19 @@ MOSTargetInfo::MOSTargetInfo(const llvm::Triple &Triple, const TargetOptions &)
   WIntType = UnsignedLong;
   Char32Type = UnsignedLong;
   SigAtomicType = UnsignedChar;
+  // Single-byte atomics are lowered inline; the rest become libcalls.
+  MaxAtomicPromoteWidth = MaxAtomicInlineWidth = 8;
+}
+
+void MOSTargetInfo::getTargetDefines(const LangOptions &Opts,
+                                     MacroBuilder &Builder) const {
+  // Data in the zero page is addressed with 8-bit pointers.
+  Builder.defineMacro("__zeropage", "__attribute__((address_space(1)))");
+}
+
+ArrayRef<Builtin::Info> MOSTargetInfo::getTargetBuiltins() const {
+  return llvm::makeArrayRef(BuiltinInfo, clang::MOS::LastTSBuiltin -
+                                             Builtin::FirstTSBuiltin);
 }
 
 bool MOSTargetInfo::validateAsmConstraint(
@@ -23,13 +23,15 @@ namespace clang {
 namespace targets {
 
 class MOSTargetInfo : public TargetInfo {
+  static const Builtin::Info BuiltinInfo[];
+
 public:
   MOSTargetInfo(const llvm::Triple &Triple, const TargetOptions &);
 
   void getTargetDefines(const LangOptions &Opts,
-                        MacroBuilder &Builder) const override {}
+                        MacroBuilder &Builder) const override;
 
-  ArrayRef<Builtin::Info> getTargetBuiltins() const override { return None; }
+  ArrayRef<Builtin::Info> getTargetBuiltins() const override;
 
   BuiltinVaListKind getBuiltinVaListKind() const override {
     return TargetInfo::VoidPtrBuiltinVaList;
@@ -57,6 +59,15 @@ public:
   void fillValidCPUList(SmallVectorImpl<StringRef> &Values) const override;
 
   bool setCPU(const std::string &Name) override { return isValidCPUName(Name); }
+
+protected:
+  // Zero page pointers (address space 1) are a single byte.
+  uint64_t getPointerWidthV(unsigned AddrSpace) const override {
+    return AddrSpace == 1 ? 8 : PointerWidth;
+  }
+  IntType getPtrDiffTypeV(unsigned AddrSpace) const override {
+    return AddrSpace == 1 ? SignedChar : PtrDiffType;
+  }
 };
 
 } // namespace targets
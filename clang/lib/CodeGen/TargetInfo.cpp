@@ -10945,6 +10945,10 @@ public:
       Fn->addFnAttr("interrupt-norecurse");
     if (FD->getAttr<MOSNoISRAttr>())
       Fn->addFnAttr("no-isr");
+    if (FD->getAttr<MOSSelfModifyingAttr>())
+      Fn->addFnAttr("mos-self-modifying");
+    if (FD->getAttr<MOSSweet16Attr>())
+      Fn->addFnAttr("mos-sweet16");
   }
 };
 
@@ -100,4 +100,12 @@ void mos::Linker::AddLTOOptions(const toolchains::MOS &TC, const ArgList &Args,
   addLTOOptions(TC, Args, CmdArgs, Output, Inputs[0],
                 TC.getDriver().getLTOMode() == LTOK_Thin);
   addMOSCodeGenArgs(CmdArgs);
+
+  // The whole-program analyses run once on the merged module before it's
+  // partitioned, so code generation of full LTO can use the -flto-jobs
+  // threads too.
+  unsigned Jobs;
+  if (!Args.getLastArgValue(options::OPT_flto_jobs_EQ).getAsInteger(10, Jobs) &&
+      Jobs > 1)
+    CmdArgs.push_back(Args.MakeArgString("--lto-partitions=" + Twine(Jobs)));
 }
@@ -6779,6 +6779,32 @@ static void handleMOSInterruptNoISRAttr(Sema &S, Decl *D, const ParsedAttr &AL)
   handleSimpleAttribute<MOSNoISRAttr>(S, D, AL);
 }
 
+static void handleMOSSelfModifyingAttr(Sema &S, Decl *D, const ParsedAttr &AL) {
+  if (!isFunctionOrMethod(D)) {
+    S.Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'self_modifying'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(S, 0))
+    return;
+
+  handleSimpleAttribute<MOSSelfModifyingAttr>(S, D, AL);
+}
+
+static void handleMOSSweet16Attr(Sema &S, Decl *D, const ParsedAttr &AL) {
+  if (!isFunctionOrMethod(D)) {
+    S.Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'sweet16'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(S, 0))
+    return;
+
+  handleSimpleAttribute<MOSSweet16Attr>(S, D, AL);
+}
+
 static void handleWebAssemblyExportNameAttr(Sema &S, Decl *D, const ParsedAttr &AL) {
   if (!isFunctionOrMethod(D)) {
     S.Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
@@ -7826,6 +7852,12 @@ static void ProcessDeclAttribute(Sema &S, Scope *scope, Decl *D,
   case ParsedAttr::AT_MOSNoISR:
     handleMOSInterruptNoISRAttr(S, D, AL);
     break;
+  case ParsedAttr::AT_MOSSelfModifying:
+    handleMOSSelfModifyingAttr(S, D, AL);
+    break;
+  case ParsedAttr::AT_MOSSweet16:
+    handleMOSSweet16Attr(S, D, AL);
+    break;
   case ParsedAttr::AT_WebAssemblyExportName:
     handleWebAssemblyExportNameAttr(S, D, AL);
     break;
@@ -0,0 +1,21 @@
+// RUN: %clang_cc1 -triple mos -O2 -emit-llvm %s -o - | FileCheck %s
+
+// Test MOS packed BCD builtins.
+
+unsigned char add8(unsigned char a, unsigned char b) {
+  // CHECK-LABEL: define dso_local {{.*}}i8 @add8(
+  // CHECK: call i8 @llvm.mos.bcd.add8(i8 {{.*}}%a, i8 {{.*}}%b)
+  return __builtin_mos_bcd_add8(a, b);
+}
+
+unsigned short add16(unsigned short a, unsigned short b) {
+  // CHECK-LABEL: define dso_local {{.*}}i16 @add16(
+  // CHECK: call i16 @llvm.mos.bcd.add16(i16 {{.*}}%a, i16 {{.*}}%b)
+  return __builtin_mos_bcd_add16(a, b);
+}
+
+unsigned long sub32(unsigned long a, unsigned long b) {
+  // CHECK-LABEL: define dso_local {{.*}}i32 @sub32(
+  // CHECK: call i32 @llvm.mos.bcd.sub32(i32 %a, i32 %b)
+  return __builtin_mos_bcd_sub32(a, b);
+}
@@ -0,0 +1,9 @@
+// RUN: %clang_cc1 -triple mos -O2 -emit-llvm %s -o - | FileCheck %s
+
+// CHECK-LABEL: define dso_local void @copy(i8* {{.*}}%dst, i8* {{.*}}%src) local_unnamed_addr #0 {
+__attribute__((self_modifying)) void copy(char *dst, const char *src) {
+  for (unsigned char i = 0; i < 200; ++i)
+    dst[i] = src[i];
+}
+
+// CHECK: attributes #0 = { {{.*}} "mos-self-modifying" {{.*}} }
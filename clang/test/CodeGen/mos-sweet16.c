@@ -0,0 +1,9 @@
+// RUN: %clang_cc1 -triple mos -O2 -emit-llvm %s -o - | FileCheck %s
+
+// CHECK-LABEL: define dso_local void @setup(i16* {{.*}}%p) local_unnamed_addr #0 {
+__attribute__((sweet16)) void setup(unsigned *p) {
+  p[0] = 0x1234;
+  p[1] = 0x5678;
+}
+
+// CHECK: attributes #0 = { {{.*}} "mos-sweet16" {{.*}} }
@@ -0,0 +1,19 @@
+// RUN: %clang_cc1 -triple mos -O2 -emit-llvm %s -o - | FileCheck %s
+
+// Test MOS zero page pointers.
+
+// CHECK: target datalayout = "e-p:16:8-p1:8:8-
+
+_Static_assert(sizeof(char __zeropage *) == 1, "zero page pointers are 8 bits");
+_Static_assert(sizeof(char *) == 2, "default pointers are 16 bits");
+
+// CHECK: @buf = dso_local addrspace(1) global [16 x i8] zeroinitializer
+char __zeropage buf[16];
+
+// CHECK-LABEL: define dso_local {{.*}}i8 @load(i8 addrspace(1)* {{.*}}%p, i8 {{.*}}%i)
+// CHECK: getelementptr inbounds i8, i8 addrspace(1)* %p
+char load(char __zeropage *p, unsigned char i) { return p[i]; }
+
+// CHECK-LABEL: define dso_local {{.*}}i8* @widen(i8 addrspace(1)* {{.*}}%p)
+// CHECK: addrspacecast i8 addrspace(1)* %p to i8*
+char *widen(char __zeropage *p) { return (char *)p; }
@@ -39,6 +39,8 @@ MOS::MOS() {
   defaultMaxPageSize = 1;
   defaultCommonPageSize = 1;
   noneRel = R_MOS_NONE;
+  // Far call thunks between banks; see MOSBanks.cpp.
+  needsThunks = true;
 }
 
 static uint32_t getEFlags(InputFile *file) {
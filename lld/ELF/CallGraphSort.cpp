@@ -76,7 +76,7 @@ struct Cluster {
 
 class CallGraphSort {
 public:
-  CallGraphSort();
+  CallGraphSort(const CallGraphProfile &profile);
 
   DenseMap<const InputSectionBase *, int> run();
 
@@ -96,11 +96,9 @@ constexpr uint64_t MAX_CLUSTER_SIZE = 1024 * 1024;
 using SectionPair =
     std::pair<const InputSectionBase *, const InputSectionBase *>;
 
-// Take the edge list in Config->CallGraphProfile, resolve symbol names to
-// Symbols, and generate a graph between InputSections with the provided
-// weights.
-CallGraphSort::CallGraphSort() {
-  MapVector<SectionPair, uint64_t> &profile = config->callGraphProfile;
+// Take the edge list in profile, resolve symbol names to Symbols, and generate
+// a graph between InputSections with the provided weights.
+CallGraphSort::CallGraphSort(const CallGraphProfile &profile) {
   DenseMap<const InputSectionBase *, int> secToCluster;
 
   auto getOrCreateNode = [&](const InputSectionBase *isec) -> int {
@@ -113,7 +111,7 @@ CallGraphSort::CallGraphSort() {
   };
 
   // Create the graph.
-  for (std::pair<SectionPair, uint64_t> &c : profile) {
+  for (const std::pair<SectionPair, uint64_t> &c : profile) {
     const auto *fromSB = cast<InputSectionBase>(c.first.first->repl);
     const auto *toSB = cast<InputSectionBase>(c.first.second->repl);
     uint64_t weight = c.second;
@@ -265,5 +263,10 @@ DenseMap<const InputSectionBase *, int> CallGraphSort::run() {
 // according to the C³ heuristic. All clusters are then sorted by a density
 // metric to further improve locality.
 DenseMap<const InputSectionBase *, int> elf::computeCallGraphProfileOrder() {
-  return CallGraphSort().run();
+  return CallGraphSort(config->callGraphProfile).run();
+}
+
+DenseMap<const InputSectionBase *, int>
+elf::computeCallGraphProfileOrder(const CallGraphProfile &profile) {
+  return CallGraphSort(profile).run();
 }
@@ -10,12 +10,21 @@
 #define LLD_ELF_CALL_GRAPH_SORT_H
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
 
 namespace lld {
 namespace elf {
 class InputSectionBase;
 
+using CallGraphProfile = llvm::MapVector<
+    std::pair<const InputSectionBase *, const InputSectionBase *>, uint64_t>;
+
 llvm::DenseMap<const InputSectionBase *, int> computeCallGraphProfileOrder();
+
+// Like the above, but orders by the given profile instead of
+// config->callGraphProfile.
+llvm::DenseMap<const InputSectionBase *, int>
+computeCallGraphProfileOrder(const CallGraphProfile &profile);
 } // namespace elf
 } // namespace lld
 
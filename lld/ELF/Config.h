@@ -128,6 +128,7 @@ struct Configuration {
   std::vector<VersionDefinition> versionDefinitions;
   std::vector<llvm::StringRef> auxiliaryList;
   std::vector<llvm::StringRef> filterList;
+  std::vector<llvm::StringRef> mosCompress;
   std::vector<llvm::StringRef> searchPaths;
   std::vector<llvm::StringRef> symbolOrderingFile;
   std::vector<llvm::StringRef> thinLTOModulesToCompile;
@@ -181,6 +182,7 @@ struct Configuration {
   bool mergeArmExidx;
   bool mipsN32Abi = false;
   bool mmapOutputFile;
+  bool mosBankPlacement;
   bool nmagic;
   bool noDynamicLinker = false;
   bool noinhibitExec;
@@ -264,6 +266,8 @@ struct Configuration {
   uint64_t commonPageSize;
   uint64_t maxPageSize;
   uint64_t mipsGotSize;
+  uint64_t mosHardStackBudget;
+  uint64_t mosSoftStackBudget;
   uint64_t zStackSize;
   unsigned ltoPartitions;
   unsigned ltoo;
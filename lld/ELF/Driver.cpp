@@ -28,6 +28,9 @@
 #include "InputFiles.h"
 #include "InputSection.h"
 #include "LinkerScript.h"
+#include "MOSBanks.h"
+#include "MOSCompress.h"
+#include "MOSStackSizes.h"
 #include "MarkLive.h"
 #include "OutputSections.h"
 #include "ScriptParser.h"
@@ -101,6 +104,8 @@ bool elf::link(ArrayRef<const char *> args, bool canExitEarly,
     partitions = {Partition()};
 
     SharedFile::vernauxNum = 0;
+
+    clearMOSStackUsage();
   };
 
   errorHandler().logName = args::getFilenameWithoutExe(args[0]);
@@ -326,6 +331,18 @@ static void checkOptions() {
   if (config->pcRelOptimize && config->emachine != EM_PPC64)
     error("--pcrel-optimize is only supported on PowerPC64 targets");
 
+  if (config->mosBankPlacement && config->emachine != EM_MCS6502)
+    error("--mos-bank-placement is only supported on MOS targets");
+
+  if (!config->mosCompress.empty() && config->emachine != EM_MCS6502)
+    error("--mos-compress is only supported on MOS targets");
+
+  if (config->mosHardStackBudget && config->emachine != EM_MCS6502)
+    error("--mos-hard-stack-budget is only supported on MOS targets");
+
+  if (config->mosSoftStackBudget && config->emachine != EM_MCS6502)
+    error("--mos-soft-stack-budget is only supported on MOS targets");
+
   if (config->pie && config->shared)
     error("-shared and -pie may not be used together");
 
@@ -1034,6 +1051,13 @@ static void readConfigs(opt::InputArgList &args) {
                    OPT_no_lto_unique_basic_block_section_names, false);
   config->mapFile = args.getLastArgValue(OPT_Map);
   config->mipsGotSize = args::getInteger(args, OPT_mips_got_size, 0xfff0);
+  config->mosBankPlacement =
+      args.hasFlag(OPT_mos_bank_placement, OPT_no_mos_bank_placement, false);
+  config->mosCompress = args::getStrings(args, OPT_mos_compress);
+  config->mosHardStackBudget =
+      args::getInteger(args, OPT_mos_hard_stack_budget, 0);
+  config->mosSoftStackBudget =
+      args::getInteger(args, OPT_mos_soft_stack_budget, 0);
   config->mergeArmExidx =
       args.hasFlag(OPT_merge_exidx_entries, OPT_no_merge_exidx_entries, true);
   config->mmapOutputFile =
@@ -2158,6 +2182,22 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
   if (Symbol *sym = symtab->find(config->entry))
     handleUndefined(sym);
 
+  // Calls between MOS banks go through thunks that call the runtime, so pull
+  // it out of any archive now.
+  if (config->emachine == EM_MCS6502 && hasMOSBanks())
+    if (Symbol *sym = symtab->find(mosBankCallName))
+      handleUndefined(sym);
+
+  // Likewise, nothing refers to the decompressor for --mos-compress.
+  if (config->emachine == EM_MCS6502 && !config->mosCompress.empty()) {
+    Symbol *sym = symtab->find(mosDecompressName);
+    if (sym)
+      handleUndefined(sym);
+    if (!sym || !sym->isDefined())
+      warn("--mos-compress: " + Twine(mosDecompressName) +
+           " is not defined; compressed sections will not be decompressed");
+  }
+
   // Handle the `--undefined-glob <pattern>` options.
   for (StringRef pat : args::getStrings(args, OPT_undefined_glob))
     handleUndefinedGlob(pat);
@@ -2380,6 +2420,10 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
     // "orphans", and they are assigned to output sections by the default rule.
     // Process that.
     script->addOrphanSections();
+
+    // MOS banks are numbered by their position within their OVERLAY.
+    if (config->emachine == EM_MCS6502)
+      assignMOSBanks();
   }
 
   {
@@ -2412,6 +2456,11 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
     readCallGraphsFromObjectFiles<ELFT>();
   }
 
+  // Bank placement uses the call graph, and it must precede address
+  // assignment.
+  if (config->mosBankPlacement)
+    placeMOSBanks();
+
   // Write the result to the file.
   writeResult<ELFT>();
 }
@@ -836,6 +836,17 @@ uint64_t LinkerScript::advance(uint64_t size, unsigned alignment) {
 void LinkerScript::output(InputSection *s) {
   assert(ctx->outSec == s->getParent());
   uint64_t before = advance(0, 1);
+
+  // MOS sections so flagged must not straddle a 256-byte page, since indexed
+  // accesses and branches that cross a page take an extra cycle. Padding is
+  // only inserted when the section would otherwise actually cross a page.
+  if (config->emachine == EM_MCS6502 && (s->flags & SHF_MOS_NOPAGECROSS)) {
+    uint64_t start = alignTo(before, s->alignment);
+    uint64_t size = s->getSize();
+    if (size && size <= 256 && start / 256 != (start + size - 1) / 256)
+      advance(0, 256);
+  }
+
   uint64_t pos = advance(s->getSize(), s->alignment);
   s->outSecOff = pos - s->getSize() - ctx->outSec->addr;
 
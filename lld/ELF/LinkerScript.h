@@ -326,6 +326,9 @@ public:
   // PHDRS command list.
   std::vector<PhdrsCommand> phdrsCommands;
 
+  // The output sections of each OVERLAY command, in order.
+  std::vector<std::vector<OutputSection *>> overlays;
+
   bool hasSectionsCommand = false;
   bool errorOnMissingSection = false;
 
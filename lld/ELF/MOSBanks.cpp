@@ -0,0 +1,240 @@
+//===- MOSBanks.cpp -------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// MOS programs larger than the 64 KiB address space are built for bank
+// switching hardware, which maps one of several banks into a fixed window of
+// the address space. Banks are described in the linker script as the output
+// sections of an OVERLAY; they share a virtual address range but are loaded
+// at consecutive addresses in the image. A bank's number is its index in the
+// OVERLAY.
+//
+// A call or jump from one bank into another (or from unbanked memory into a
+// bank) is redirected through a thunk placed next to the caller:
+//
+//   JSR __mos_bank_call
+//   .byte bank
+//   .word target
+//
+// __mos_bank_call is provided by the runtime for the particular hardware. It
+// reads the bank and target following its return address, maps in the bank,
+// calls the target, restores the caller's bank, and returns directly to the
+// thunk's caller. Calls within a bank or into unbanked memory are left alone.
+// Only calls and jumps are redirected; function pointers are not.
+//
+// With --mos-bank-placement, the code in each OVERLAY is also redistributed
+// among its banks. Sections are ordered by the C3 heuristic from
+// CallGraphSort.cpp, then packed into banks first-fit, which keeps hot callers
+// and callees in the same bank. Without a call graph profile, each static call
+// site counts as one call. Each bank must be given a memory region, whose
+// length is the capacity of the bank.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSBanks.h"
+#include "CallGraphSort.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "InputSection.h"
+#include "LinkerScript.h"
+#include "OutputSections.h"
+#include "Relocations.h"
+#include "Symbols.h"
+#include "lld/Common/ErrorHandler.h"
+#include "lld/Common/Memory.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+constexpr uint8_t jsrOpcode = 0x20;
+constexpr uint8_t jmpOpcode = 0x4c;
+} // namespace
+
+bool elf::hasMOSBanks() {
+  return llvm::any_of(script->overlays,
+                      [](const std::vector<OutputSection *> &overlay) {
+                        return !overlay.empty();
+                      });
+}
+
+// Later removal of empty banks doesn't change the numbering.
+void elf::assignMOSBanks() {
+  for (const std::vector<OutputSection *> &overlay : script->overlays)
+    for (unsigned i = 0, e = overlay.size(); i != e; ++i)
+      overlay[i]->mosBank = i;
+}
+
+Optional<unsigned> elf::getMOSBank(const OutputSection *os) {
+  if (!os || !os->inOverlay)
+    return None;
+  return os->mosBank;
+}
+
+// Returns the number of bytes written by a relocation of the given type.
+static unsigned getRelocSize(RelType type) {
+  switch (type) {
+  case R_MOS_ADDR16:
+  case R_MOS_ADDR24_SEGMENT:
+    return 2;
+  case R_MOS_FK_DATA_4:
+    return 4;
+  case R_MOS_FK_DATA_8:
+    return 8;
+  default:
+    return 1;
+  }
+}
+
+// Returns whether a relocation of the given type at offset in isec, against
+// sym, is the operand of a JSR or JMP. Both the caller and the destination
+// must be code, and the destination must not be a data object. The byte
+// before the operand must hold one of the two opcodes, and it must not itself
+// be written by a relocation, as it would be if it ended the previous entry
+// of a table of addresses. isRelocated returns whether a relocation in isec
+// writes the byte at a given offset.
+static bool isCallOrJump(const InputSectionBase &isec, uint64_t offset,
+                         RelType type, const Symbol &sym,
+                         function_ref<bool(uint64_t)> isRelocated) {
+  if (type != R_MOS_ADDR16 || offset == 0 || !(isec.flags & SHF_EXECINSTR))
+    return false;
+  auto *d = dyn_cast<Defined>(&sym);
+  if (!d || !d->section || !(d->section->flags & SHF_EXECINSTR) ||
+      d->isObject())
+    return false;
+  uint8_t opcode = isec.data()[offset - 1];
+  if (opcode != jsrOpcode && opcode != jmpOpcode)
+    return false;
+  return !isRelocated(offset - 1);
+}
+
+bool elf::needsMOSBankThunk(const InputSection &isec, const Relocation &rel) {
+  auto isRelocated = [&](uint64_t offset) {
+    return llvm::any_of(isec.relocations, [&](const Relocation &r) {
+      return r.offset <= offset && offset < r.offset + getRelocSize(r.type);
+    });
+  };
+  if (!isCallOrJump(isec, rel.offset, rel.type, *rel.sym, isRelocated))
+    return false;
+  const OutputSection *dest =
+      cast<Defined>(rel.sym)->section->getOutputSection();
+  return getMOSBank(dest) && dest != isec.getOutputSection();
+}
+
+// Adds an edge to profile for each static call site in the given sections.
+template <class RelTy>
+static void addStaticCalls(InputSectionBase *isec, ArrayRef<RelTy> rels,
+                           CallGraphProfile &profile) {
+  auto isRelocated = [&](uint64_t offset) {
+    return llvm::any_of(rels, [&](const RelTy &r) {
+      return r.r_offset <= offset &&
+             offset < r.r_offset + getRelocSize(r.getType(false));
+    });
+  };
+  for (const RelTy &rel : rels) {
+    Symbol &sym = isec->getFile<ELF32LE>()->getRelocTargetSym(rel);
+    if (!isCallOrJump(*isec, rel.r_offset, rel.getType(false), sym,
+                      isRelocated))
+      continue;
+    auto *d = cast<Defined>(&sym);
+    if (d->section == isec)
+      continue;
+    if (auto *to = dyn_cast<InputSectionBase>(d->section))
+      ++profile[{isec, to}];
+  }
+}
+
+static void placeOverlay(ArrayRef<OutputSection *> banks) {
+  std::vector<uint64_t> capacity;
+  for (OutputSection *bank : banks) {
+    MemoryRegion *region =
+        script->memoryRegions.lookup(bank->memoryRegionName);
+    if (!region) {
+      warn("--mos-bank-placement: bank " + bank->name +
+           " has no memory region; leaving its OVERLAY as written");
+      return;
+    }
+    capacity.push_back(region->length().getValue());
+  }
+
+  // Pull the code out of every bank, keeping anything else where the script
+  // placed it. For now, the code all belongs to the first bank, since
+  // CallGraphSort only clusters sections within an output section.
+  std::vector<InputSection *> code;
+  std::vector<uint64_t> used(banks.size());
+  for (unsigned i = 0, e = banks.size(); i != e; ++i) {
+    for (BaseCommand *base : banks[i]->sectionCommands) {
+      auto *isd = dyn_cast<InputSectionDescription>(base);
+      if (!isd)
+        continue;
+      llvm::erase_if(isd->sections, [&](InputSection *isec) {
+        if (!(isec->flags & SHF_EXECINSTR)) {
+          used[i] = alignTo(used[i], isec->alignment) + isec->getSize();
+          return false;
+        }
+        code.push_back(isec);
+        isec->parent = banks[0];
+        return true;
+      });
+    }
+  }
+  if (code.empty())
+    return;
+
+  // The static call profile is kept apart from the global one, since that
+  // would also reorder the sections of every other output section, overriding
+  // --symbol-ordering-file.
+  CallGraphProfile staticProfile;
+  if (config->callGraphProfile.empty())
+    for (InputSection *isec : code) {
+      if (isec->areRelocsRela)
+        addStaticCalls(isec, isec->relas<ELF32LE>(), staticProfile);
+      else
+        addStaticCalls(isec, isec->rels<ELF32LE>(), staticProfile);
+    }
+
+  DenseMap<const InputSectionBase *, int> order =
+      computeCallGraphProfileOrder(config->callGraphProfile.empty()
+                                       ? staticProfile
+                                       : config->callGraphProfile);
+  // Sections without an order (0) go last, in their original order.
+  llvm::stable_sort(code, [&](InputSection *a, InputSection *b) {
+    return order.lookup(a) - 1U < order.lookup(b) - 1U;
+  });
+
+  for (InputSection *isec : code) {
+    unsigned i = 0;
+    for (unsigned e = banks.size(); i != e; ++i)
+      if (alignTo(used[i], isec->alignment) + isec->getSize() <= capacity[i])
+        break;
+    if (i == banks.size()) {
+      error("--mos-bank-placement: no bank has room for " + toString(isec));
+      return;
+    }
+    used[i] = alignTo(used[i], isec->alignment) + isec->getSize();
+
+    OutputSection *bank = banks[i];
+    if (bank->sectionCommands.empty() ||
+        !isa<InputSectionDescription>(bank->sectionCommands.back()))
+      bank->sectionCommands.push_back(make<InputSectionDescription>(""));
+    cast<InputSectionDescription>(bank->sectionCommands.back())
+        ->sections.push_back(isec);
+    bank->commitSection(isec);
+  }
+}
+
+void elf::placeMOSBanks() {
+  for (const std::vector<OutputSection *> &overlay : script->overlays)
+    if (overlay.size() > 1)
+      placeOverlay(overlay);
+}
@@ -0,0 +1,46 @@
+//===- MOSBanks.h -----------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_MOSBANKS_H
+#define LLD_ELF_MOSBANKS_H
+
+#include "lld/Common/LLVM.h"
+#include "llvm/ADT/Optional.h"
+
+namespace lld {
+namespace elf {
+
+class InputSection;
+class OutputSection;
+struct Relocation;
+
+// The runtime routine called by far call thunks to switch banks.
+constexpr const char *mosBankCallName = "__mos_bank_call";
+
+// Returns whether the linker script places any output sections in banks.
+bool hasMOSBanks();
+
+// Numbers the banks of each OVERLAY.
+void assignMOSBanks();
+
+// Returns the bank number of an output section, which is its index within its
+// OVERLAY, or None if the section isn't banked.
+llvm::Optional<unsigned> getMOSBank(const OutputSection *os);
+
+// Returns whether rel, a relocation in isec, is a call or jump into a bank
+// that may not be mapped in when isec runs.
+bool needsMOSBankThunk(const InputSection &isec, const Relocation &rel);
+
+// Redistributes the code in each OVERLAY among its banks so that callers and
+// their callees tend to share a bank (--mos-bank-placement).
+void placeMOSBanks();
+
+} // namespace elf
+} // namespace lld
+
+#endif
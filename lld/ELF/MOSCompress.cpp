@@ -0,0 +1,330 @@
+//===- MOSCompress.cpp ----------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// With --mos-compress, the contents of the named output sections are removed
+// from the image and stored compressed in .mos_compressed instead. The
+// sections keep their run addresses, which are given by the linker script as
+// usual; the runtime's __mos_decompress unpacks them there at startup. Since
+// it's referenced by nothing else, the linker pulls __mos_decompress out of
+// any archive, and it finds the data through the __mos_compressed symbol. A
+// 6502 implementation is in llvm/utils/mos-benchmarks/Inputs/decompress.s.
+//
+// A compressed section becomes NOBITS, but that only removes it from the image
+// if nothing with contents follows it in its segment; otherwise its space
+// remains as a hole in the file. So each compressed section must be the last
+// section with contents in its segment (e.g., .data, followed only by .bss),
+// and the linker reports an error if it isn't.
+//
+// .mos_compressed has the following format:
+//
+//   .byte count
+//   ; count times:
+//   .word run address
+//   ; stream
+//
+// Each stream is a sequence of tokens that decodes to the section contents:
+//
+//   00           End of stream.
+//   01-7F        Copy that many literal bytes following the token.
+//   80-BF d      Copy (token & 3F) + 3 bytes from d + 1 bytes back.
+//   C0-FF dl dh  Copy (token & 3F) + 4 bytes from dh:dl bytes back.
+//
+// Copies proceed a byte at a time, so they may overlap their own output. The
+// format is byte-aligned, and short matches need no 16-bit arithmetic, which
+// keeps the decompressor small and fast on the 6502.
+//
+// The compressed contents depend on relocated section contents, and hence on
+// addresses, so the size of .mos_compressed is found alongside the other
+// address-dependent content. After writing it, the linker decompresses the
+// data again and checks that it matches the uncompressed link exactly.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSCompress.h"
+#include "Config.h"
+#include "LinkerScript.h"
+#include "OutputSections.h"
+#include "lld/Common/ErrorHandler.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Support/Endian.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+using namespace llvm::support::endian;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+constexpr uint8_t endToken = 0x00;
+constexpr uint8_t shortMatchToken = 0x80;
+constexpr uint8_t longMatchToken = 0xc0;
+
+constexpr size_t maxLiterals = 0x7f;
+constexpr size_t minShortMatch = 3;
+constexpr size_t maxShortMatch = minShortMatch + 0x3f;
+constexpr size_t maxShortDistance = 0x100;
+constexpr size_t minLongMatch = 4;
+constexpr size_t maxLongMatch = minLongMatch + 0x3f;
+constexpr size_t maxLongDistance = 0xffff;
+
+// Bounds the matches examined at each position, which keeps compression
+// roughly linear on pathological inputs.
+constexpr unsigned maxChainLength = 256;
+
+// Finds matches among the previous bytes of the input with the same 3-byte
+// prefix as the current position.
+class MatchFinder {
+public:
+  explicit MatchFinder(ArrayRef<uint8_t> data)
+      : data(data), head(1 << hashBits, none), prev(data.size(), none) {}
+
+  void insert(size_t pos) {
+    if (pos + minShortMatch > data.size())
+      return;
+    uint32_t &h = head[hash(pos)];
+    prev[pos] = h;
+    h = pos;
+  }
+
+  // Returns the length and distance of the match at pos that saves the most
+  // bytes, or a length of zero if no match saves any.
+  std::pair<size_t, size_t> find(size_t pos) const {
+    size_t bestLen = 0, bestDist = 0;
+    int64_t bestSavings = 0;
+    if (pos + minShortMatch > data.size())
+      return {0, 0};
+
+    unsigned chain = 0;
+    for (uint32_t cand = head[hash(pos)];
+         cand != none && chain < maxChainLength; cand = prev[cand], ++chain) {
+      size_t dist = pos - cand;
+      if (dist > maxLongDistance)
+        break;
+      size_t limit = std::min<size_t>(data.size() - pos,
+                                      dist <= maxShortDistance ? maxShortMatch
+                                                               : maxLongMatch);
+      size_t len = 0;
+      while (len < limit && data[cand + len] == data[pos + len])
+        ++len;
+
+      bool isShort = dist <= maxShortDistance && len >= minShortMatch;
+      if (!isShort && len < minLongMatch)
+        continue;
+      int64_t savings = int64_t(len) - (isShort ? 2 : 3);
+      if (savings > bestSavings) {
+        bestLen = len;
+        bestDist = dist;
+        bestSavings = savings;
+      }
+    }
+    return {bestLen, bestDist};
+  }
+
+private:
+  static constexpr unsigned hashBits = 16;
+  static constexpr uint32_t none = UINT32_MAX;
+
+  uint32_t hash(size_t pos) const {
+    uint32_t v = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16;
+    return (v * 2654435761u) >> (32 - hashBits);
+  }
+
+  ArrayRef<uint8_t> data;
+  std::vector<uint32_t> head;
+  std::vector<uint32_t> prev;
+};
+} // namespace
+
+// Appends the compressed stream for data to out. Matches are chosen greedily.
+static void compress(ArrayRef<uint8_t> data, std::vector<uint8_t> &out) {
+  MatchFinder finder(data);
+  size_t literalStart = 0;
+
+  auto flushLiterals = [&](size_t end) {
+    while (literalStart < end) {
+      size_t n = std::min(end - literalStart, maxLiterals);
+      out.push_back(n);
+      out.insert(out.end(), data.begin() + literalStart,
+                 data.begin() + literalStart + n);
+      literalStart += n;
+    }
+  };
+
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t len, dist;
+    std::tie(len, dist) = finder.find(pos);
+    if (!len) {
+      finder.insert(pos++);
+      continue;
+    }
+
+    flushLiterals(pos);
+    if (dist <= maxShortDistance && len <= maxShortMatch) {
+      out.push_back(shortMatchToken | (len - minShortMatch));
+      out.push_back(dist - 1);
+    } else {
+      out.push_back(longMatchToken | (len - minLongMatch));
+      out.push_back(dist & 0xff);
+      out.push_back(dist >> 8);
+    }
+    for (size_t end = pos + len; pos < end; ++pos)
+      finder.insert(pos);
+    literalStart = pos;
+  }
+  flushLiterals(pos);
+  out.push_back(endToken);
+}
+
+// Decompresses the stream at data into out, as __mos_decompress would.
+// Returns the number of bytes consumed, or zero if the stream is malformed.
+static size_t decompress(ArrayRef<uint8_t> data, std::vector<uint8_t> &out) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    uint8_t token = data[pos++];
+    if (token == endToken)
+      return pos;
+
+    if (token < shortMatchToken) {
+      if (pos + token > data.size())
+        return 0;
+      out.insert(out.end(), data.begin() + pos, data.begin() + pos + token);
+      pos += token;
+      continue;
+    }
+
+    size_t len, dist;
+    if (token < longMatchToken) {
+      if (pos + 1 > data.size())
+        return 0;
+      len = (token & 0x3f) + minShortMatch;
+      dist = data[pos++] + 1;
+    } else {
+      if (pos + 2 > data.size())
+        return 0;
+      len = (token & 0x3f) + minLongMatch;
+      dist = read16le(&data[pos]);
+      pos += 2;
+    }
+    if (!dist || dist > out.size())
+      return 0;
+    for (size_t i = 0; i < len; ++i)
+      out.push_back(out[out.size() - dist]);
+  }
+  return 0;
+}
+
+MOSCompressedSection::MOSCompressedSection()
+    : SyntheticSection(SHF_ALLOC, SHT_PROGBITS, 1, ".mos_compressed") {}
+
+void MOSCompressedSection::finalizeContents() {
+  for (StringRef name : config->mosCompress) {
+    auto it = llvm::find_if(outputSections, [&](OutputSection *os) {
+      return os->name == name;
+    });
+    if (it == outputSections.end()) {
+      error("--mos-compress: no such output section: " + name);
+      continue;
+    }
+    OutputSection *os = *it;
+    if (os == getParent()) {
+      error("--mos-compress: cannot compress " + name +
+            ", which contains the compressed data");
+      continue;
+    }
+    if (os->mosCompressed)
+      continue;
+    if (!(os->flags & SHF_ALLOC) || os->type != SHT_PROGBITS) {
+      error("--mos-compress: " + name +
+            " is not an allocated section with contents");
+      continue;
+    }
+    os->type = SHT_NOBITS;
+    os->mosCompressed = true;
+    sections.push_back(os);
+  }
+  if (sections.size() > UINT8_MAX)
+    error("--mos-compress: too many sections to compress");
+}
+
+void MOSCompressedSection::checkSegments() const {
+  for (OutputSection *os : sections) {
+    if (!os->ptLoad)
+      continue;
+    auto it = llvm::find(outputSections, os);
+    for (OutputSection *sec : llvm::make_range(std::next(it),
+                                               outputSections.end())) {
+      if (sec->ptLoad != os->ptLoad || sec->type == SHT_NOBITS ||
+          !sec->size)
+        continue;
+      error("--mos-compress: " + os->name +
+            " must be the last section with contents in its segment, but " +
+            sec->name + " follows it");
+      break;
+    }
+  }
+}
+
+// Returns the contents each compressed section would have had if it weren't
+// compressed.
+std::vector<std::vector<uint8_t>>
+MOSCompressedSection::getUncompressedContents() const {
+  std::vector<std::vector<uint8_t>> contents;
+  for (OutputSection *os : sections) {
+    contents.emplace_back(os->size);
+    os->writeTo<ELF32LE>(contents.back().data());
+  }
+  return contents;
+}
+
+std::vector<uint8_t> MOSCompressedSection::getContents(
+    ArrayRef<std::vector<uint8_t>> uncompressed) const {
+  std::vector<uint8_t> out;
+  out.push_back(sections.size());
+  for (size_t i = 0, e = sections.size(); i != e; ++i) {
+    out.push_back(sections[i]->addr & 0xff);
+    out.push_back(sections[i]->addr >> 8 & 0xff);
+    compress(uncompressed[i], out);
+  }
+  return out;
+}
+
+// The size only ever grows, so that the address assignment loop converges.
+// Any slack left at the end is zero-filled when written.
+bool MOSCompressedSection::updateAllocSize() {
+  size_t newSize = getContents(getUncompressedContents()).size();
+  if (newSize <= size)
+    return false;
+  size = newSize;
+  return true;
+}
+
+void MOSCompressedSection::writeTo(uint8_t *buf) {
+  std::vector<std::vector<uint8_t>> uncompressed = getUncompressedContents();
+  std::vector<uint8_t> contents = getContents(uncompressed);
+  if (contents.size() > size) {
+    error("--mos-compress: compressed data grew after layout was final");
+    return;
+  }
+  memcpy(buf, contents.data(), contents.size());
+  memset(buf + contents.size(), 0, size - contents.size());
+
+  // Check that decompressing the data reproduces the uncompressed link.
+  ArrayRef<uint8_t> data = makeArrayRef(contents).drop_front();
+  for (size_t i = 0, e = sections.size(); i != e; ++i) {
+    std::vector<uint8_t> decompressed;
+    size_t consumed = decompress(data.drop_front(2), decompressed);
+    if (!consumed || decompressed != uncompressed[i]) {
+      error("--mos-compress: decompressing " + sections[i]->name +
+            " does not reproduce its contents");
+      return;
+    }
+    data = data.drop_front(2 + consumed);
+  }
+}
@@ -0,0 +1,52 @@
+//===- MOSCompress.h --------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_MOSCOMPRESS_H
+#define LLD_ELF_MOSCOMPRESS_H
+
+#include "SyntheticSections.h"
+
+namespace lld {
+namespace elf {
+
+class OutputSection;
+
+// The runtime routine that decompresses .mos_compressed at startup.
+constexpr const char *mosDecompressName = "__mos_decompress";
+
+// The symbol the runtime routine uses to find .mos_compressed.
+constexpr const char *mosCompressedName = "__mos_compressed";
+
+// Holds the compressed contents of the output sections named by
+// --mos-compress. Those sections are made NOBITS, so they keep their run
+// addresses but take no space in the image.
+class MOSCompressedSection final : public SyntheticSection {
+public:
+  MOSCompressedSection();
+  size_t getSize() const override { return size; }
+  void finalizeContents() override;
+  bool updateAllocSize() override;
+  void writeTo(uint8_t *buf) override;
+
+  // Reports an error for each compressed section followed by contents in the
+  // same segment, since its space would then remain in the image as a hole.
+  void checkSegments() const;
+
+private:
+  std::vector<std::vector<uint8_t>> getUncompressedContents() const;
+  std::vector<uint8_t>
+  getContents(ArrayRef<std::vector<uint8_t>> uncompressed) const;
+
+  std::vector<OutputSection *> sections;
+  size_t size = 0;
+};
+
+} // namespace elf
+} // namespace lld
+
+#endif
@@ -0,0 +1,288 @@
+//===- MOSStackSizes.cpp --------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The MOS backend emits a .mos_stack_sizes record for each function, giving
+// its own hard and soft stack usage and its direct callees. This file walks
+// the resulting call graph from each entry point (main and every interrupt
+// service routine) to find the worst-case stack depth of the whole program.
+//
+// Interrupts may arrive at any point, and NMIs may arrive even while an IRQ is
+// being handled, so the worst case for the program is the worst case of main
+// plus that of every interrupt handler. The result is reported in the map file
+// and checked against the budgets given on the command line.
+//
+// The result is exact only if the call graph is fully known. Recursion,
+// indirect calls, variable-sized stack objects, and calls to functions without
+// records (e.g., those written in assembly) all make the result a lower bound;
+// these are reported as incomplete.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSStackSizes.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "InputSection.h"
+#include "Relocations.h"
+#include "SymbolTable.h"
+#include "Symbols.h"
+#include "Target.h"
+#include "lld/Common/ErrorHandler.h"
+#include "lld/Common/Strings.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/BinaryFormat/MOSStackSizes.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::object;
+using namespace llvm::support::endian;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+struct FunctionRecord {
+  std::string name;
+  uint16_t staticBytes = 0;
+  uint16_t softBytes = 0;
+  uint8_t hardBytes = 0;
+  uint8_t callBytes = 0;
+  uint8_t flags = 0;
+  bool incompleteCallees = false;
+  SmallVector<uint64_t, 4> callees;
+
+  // Worst-case usage including callees; filled in by the call graph walk.
+  enum { Unvisited, Visiting, Visited } state = Unvisited;
+  uint64_t totalSoft = 0;
+  uint64_t totalHard = 0;
+  bool incomplete = false;
+};
+
+struct EntryUsage {
+  std::string name;
+  uint64_t soft;
+  uint64_t hard;
+  bool incomplete;
+};
+
+struct StackUsage {
+  bool computed = false;
+  std::vector<EntryUsage> entries;
+  uint64_t totalSoft = 0;
+  uint64_t totalHard = 0;
+  uint64_t totalStatic = 0;
+  bool incomplete = false;
+};
+} // namespace
+
+// The stack usage of the current link. Cleared between links by
+// clearMOSStackUsage().
+static StackUsage usage;
+
+// Returns the address referred to by the relocation at the given offset, or
+// None if there is none or if it refers to a discarded section.
+template <class RelTy>
+static Optional<uint64_t> getTarget(InputSectionBase &sec, ArrayRef<RelTy> rels,
+                                    uint64_t offset) {
+  for (const RelTy &rel : rels) {
+    if (rel.r_offset != offset)
+      continue;
+    Symbol &sym = sec.getFile<ELF32LE>()->getRelocTargetSym(rel);
+    auto *d = dyn_cast<Defined>(&sym);
+    if (!d || (d->section && !d->section->isLive()))
+      return None;
+    int64_t addend = RelTy::IsRela
+                         ? getAddend<ELF32LE>(rel)
+                         : target->getImplicitAddend(
+                               sec.data().data() + offset,
+                               rel.getType(config->isMips64EL));
+    return d->getVA(addend);
+  }
+  return None;
+}
+
+static Optional<uint64_t> getTarget(InputSectionBase &sec, uint64_t offset) {
+  if (sec.areRelocsRela)
+    return getTarget(sec, sec.relas<ELF32LE>(), offset);
+  return getTarget(sec, sec.rels<ELF32LE>(), offset);
+}
+
+static std::string getFunctionName(InputSectionBase &sec, uint64_t offset) {
+  auto find = [&](auto rels) -> std::string {
+    for (const auto &rel : rels) {
+      if (rel.r_offset != offset)
+        continue;
+      Symbol &sym = sec.getFile<ELF32LE>()->getRelocTargetSym(rel);
+      if (sym.isSection())
+        if (auto *d = dyn_cast<Defined>(&sym))
+          if (d->section)
+            return d->section->name.str();
+      return toString(sym);
+    }
+    return "<unknown>";
+  };
+  if (sec.areRelocsRela)
+    return find(sec.relas<ELF32LE>());
+  return find(sec.rels<ELF32LE>());
+}
+
+static void readRecords(InputSectionBase &sec,
+                        DenseMap<uint64_t, FunctionRecord> &records) {
+  ArrayRef<uint8_t> data = sec.data();
+  uint64_t offset = 0;
+  while (offset < data.size()) {
+    if (data.size() - offset < MOS::StackSizesRecordSize) {
+      error(toString(&sec) + ": truncated stack usage record");
+      return;
+    }
+    const uint8_t *buf = data.data() + offset;
+    uint8_t numCallees = buf[9];
+    uint64_t size = MOS::StackSizesRecordSize + 2 * numCallees;
+    if (data.size() - offset < size) {
+      error(toString(&sec) + ": truncated stack usage record");
+      return;
+    }
+
+    // Records of functions discarded by --gc-sections or COMDAT elimination
+    // have nothing to contribute.
+    Optional<uint64_t> addr = getTarget(sec, offset);
+    if (addr) {
+      FunctionRecord &rec = records[*addr];
+      rec.name = getFunctionName(sec, offset);
+      rec.staticBytes = read16le(buf + 2);
+      rec.softBytes = read16le(buf + 4);
+      rec.hardBytes = buf[6];
+      rec.callBytes = buf[7];
+      rec.flags = buf[8];
+      for (unsigned i = 0; i < numCallees; ++i) {
+        if (Optional<uint64_t> callee =
+                getTarget(sec, offset + MOS::StackSizesRecordSize + 2 * i))
+          rec.callees.push_back(*callee);
+        else
+          rec.incompleteCallees = true;
+      }
+    }
+    offset += size;
+  }
+}
+
+static void visit(FunctionRecord &rec,
+                  DenseMap<uint64_t, FunctionRecord> &records) {
+  if (rec.state == FunctionRecord::Visited)
+    return;
+  rec.state = FunctionRecord::Visiting;
+
+  rec.incomplete = rec.incompleteCallees ||
+                   (rec.flags & (MOS::SSF_INDIRECT_CALLS | MOS::SSF_DYNAMIC));
+  uint64_t calleeSoft = 0;
+  uint64_t calleeHard = 0;
+  for (uint64_t addr : rec.callees) {
+    auto it = records.find(addr);
+    if (it == records.end()) {
+      rec.incomplete = true;
+      continue;
+    }
+    FunctionRecord &callee = it->second;
+    // A recursive call; its depth is unbounded.
+    if (callee.state == FunctionRecord::Visiting) {
+      rec.incomplete = true;
+      continue;
+    }
+    visit(callee, records);
+    calleeSoft = std::max(calleeSoft, callee.totalSoft);
+    calleeHard = std::max(calleeHard, callee.totalHard);
+    rec.incomplete |= callee.incomplete;
+  }
+
+  rec.totalSoft = rec.softBytes + calleeSoft;
+  rec.totalHard = rec.hardBytes;
+  if (rec.callBytes)
+    rec.totalHard = std::max(rec.totalHard, rec.callBytes + calleeHard);
+  rec.state = FunctionRecord::Visited;
+}
+
+void elf::computeMOSStackUsage() {
+  DenseMap<uint64_t, FunctionRecord> records;
+  for (InputSectionBase *sec : inputSections)
+    if (sec->isLive() && sec->name == MOS::StackSizesSectionName)
+      readRecords(*sec, records);
+  if (records.empty())
+    return;
+
+  usage.computed = true;
+  auto addEntry = [&](FunctionRecord &rec, StringRef name,
+                      uint64_t entryBytes) {
+    visit(rec, records);
+    EntryUsage entry{std::string(name), rec.totalSoft,
+                     rec.totalHard + entryBytes, rec.incomplete};
+    usage.totalSoft += entry.soft;
+    usage.totalHard += entry.hard;
+    usage.incomplete |= entry.incomplete;
+    usage.entries.push_back(std::move(entry));
+  };
+
+  // main is called by the C runtime via JSR, which pushes a return address.
+  if (Symbol *main = symtab->find("main")) {
+    if (auto *d = dyn_cast<Defined>(main)) {
+      auto it = records.find(d->getVA());
+      if (it != records.end())
+        addEntry(it->second, "main", 2);
+    }
+  }
+
+  // Interrupts push the return address and the processor status. Visit them
+  // in address order for a deterministic report.
+  std::vector<std::pair<uint64_t, FunctionRecord *>> isrs;
+  for (auto &kv : records)
+    if (kv.second.flags & MOS::SSF_ISR)
+      isrs.emplace_back(kv.first, &kv.second);
+  llvm::sort(isrs, [](const auto &a, const auto &b) {
+    return a.first < b.first;
+  });
+  for (auto &isr : isrs)
+    addEntry(*isr.second, isr.second->name, 3);
+
+  for (auto &kv : records)
+    usage.totalStatic += kv.second.staticBytes;
+
+  auto check = [&](uint64_t budget, uint64_t used, StringRef kind) {
+    if (!budget)
+      return;
+    if (used > budget)
+      error("worst-case " + kind + " stack usage of " + Twine(used) +
+            " bytes exceeds budget of " + Twine(budget) + " bytes");
+    else if (usage.incomplete)
+      warn(kind + " stack usage of " + Twine(used) +
+           " bytes is a lower bound; the call graph contains recursion, "
+           "indirect calls, dynamic allocations, or functions without stack "
+           "usage information");
+  };
+  check(config->mosHardStackBudget, usage.totalHard, "hard");
+  check(config->mosSoftStackBudget, usage.totalSoft, "soft");
+}
+
+void elf::clearMOSStackUsage() { usage = StackUsage(); }
+
+void elf::writeMOSStackUsage(raw_ostream &os) {
+  if (!usage.computed)
+    return;
+
+  os << "\nStack usage (bytes):\n";
+  os << right_justify("Soft", 8) << ' ' << right_justify("Hard", 8)
+     << " Entry\n";
+  auto writeLine = [&](uint64_t soft, uint64_t hard, StringRef name,
+                       bool incomplete) {
+    os << right_justify((incomplete ? ">=" : "") + Twine(soft).str(), 8) << ' '
+       << right_justify((incomplete ? ">=" : "") + Twine(hard).str(), 8) << ' '
+       << name << '\n';
+  };
+  for (const EntryUsage &entry : usage.entries)
+    writeLine(entry.soft, entry.hard, entry.name, entry.incomplete);
+  writeLine(usage.totalSoft, usage.totalHard, "<total>", usage.incomplete);
+  os << "Static stack: " << usage.totalStatic << " bytes\n";
+}
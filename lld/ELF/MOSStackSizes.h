@@ -0,0 +1,31 @@
+//===- MOSStackSizes.h ------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_MOSSTACKSIZES_H
+#define LLD_ELF_MOSSTACKSIZES_H
+
+#include "lld/Common/LLVM.h"
+
+namespace lld {
+namespace elf {
+
+// Computes the worst-case stack usage of a MOS program from the
+// .mos_stack_sizes records emitted by the compiler, and checks it against
+// --mos-hard-stack-budget and --mos-soft-stack-budget.
+void computeMOSStackUsage();
+
+// Writes the stack usage computed by computeMOSStackUsage() to a map file.
+void writeMOSStackUsage(raw_ostream &os);
+
+// Discards the stack usage computed for the previous link.
+void clearMOSStackUsage();
+
+} // namespace elf
+} // namespace lld
+
+#endif
@@ -21,6 +21,7 @@
 #include "MapFile.h"
 #include "InputFiles.h"
 #include "LinkerScript.h"
+#include "MOSStackSizes.h"
 #include "OutputSections.h"
 #include "SymbolTable.h"
 #include "Symbols.h"
@@ -213,6 +214,9 @@ void elf::writeMapFile() {
       }
     }
   }
+
+  if (config->emachine == ELF::EM_MCS6502)
+    writeMOSStackUsage(os);
 }
 
 static void print(StringRef a, StringRef b) {
@@ -325,7 +325,7 @@ static void writeInt(uint8_t *buf, uint64_t data, uint64_t size) {
 }
 
 template <class ELFT> void OutputSection::writeTo(uint8_t *buf) {
-  if (type == SHT_NOBITS)
+  if (type == SHT_NOBITS && !mosCompressed)
     return;
 
   // If -compress-debug-section is specified and if this is a debug section,
@@ -95,6 +95,15 @@ public:
   bool usedInExpression = false;
   bool inOverlay = false;
 
+  // For MOS, the index of this section within its OVERLAY, which is the number
+  // of the bank it's loaded into. See MOSBanks.cpp.
+  unsigned mosBank = 0;
+
+  // For MOS, set if --mos-compress stores this section in .mos_compressed. The
+  // section is NOBITS in the output, but writeTo still writes its contents so
+  // that they can be compressed. See MOSCompress.cpp.
+  bool mosCompressed = false;
+
   // Tracks whether the section has ever had an input section added to it, even
   // if the section was later removed (e.g. because it is a synthetic section
   // that wasn't needed). This is needed for orphan placement.
@@ -43,6 +43,7 @@
 #include "Relocations.h"
 #include "Config.h"
 #include "LinkerScript.h"
+#include "MOSBanks.h"
 #include "OutputSections.h"
 #include "SymbolTable.h"
 #include "Symbols.h"
@@ -2034,8 +2035,12 @@ bool ThunkCreator::createThunks(ArrayRef<OutputSection *> outputSections) {
             if (pass > 0 && normalizeExistingThunk(rel, src))
               continue;
 
-            if (!target->needsThunk(rel.expr, rel.type, isec->file, src,
-                                    *rel.sym, rel.addend))
+            // MOS bank thunks depend on the caller's bank, which can't be
+            // told from its address alone.
+            if (config->emachine == EM_MCS6502
+                    ? !needsMOSBankThunk(*isec, rel)
+                    : !target->needsThunk(rel.expr, rel.type, isec->file, src,
+                                          *rel.sym, rel.addend))
               continue;
 
             Thunk *t;
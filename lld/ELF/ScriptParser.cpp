@@ -536,6 +536,7 @@ std::vector<BaseCommand *> ScriptParser::readOverlay() {
   expect("{");
 
   std::vector<BaseCommand *> v;
+  std::vector<OutputSection *> overlay;
   OutputSection *prev = nullptr;
   while (!errorCount() && !consume("}")) {
     // VA is the same for all sections. The LMAs are consecutive in memory
@@ -547,8 +548,10 @@ std::vector<BaseCommand *> ScriptParser::readOverlay() {
     else
       os->lmaExpr = lmaExpr;
     v.push_back(os);
+    overlay.push_back(os);
     prev = os;
   }
+  script->overlays.push_back(std::move(overlay));
 
   // According to the specification, at the end of the overlay, the location
   // counter should be equal to the overlay base address plus size of the
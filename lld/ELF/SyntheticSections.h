@@ -32,6 +32,7 @@
 namespace lld {
 namespace elf {
 class Defined;
+class MOSCompressedSection;
 struct PhdrEntry;
 class SymbolTableBaseSection;
 class VersionNeedBaseSection;
@@ -1204,6 +1205,7 @@ struct InStruct {
   PPC64LongBranchTargetSection *ppc64LongBranchTarget;
   MipsGotSection *mipsGot;
   MipsRldMapSection *mipsRldMap;
+  MOSCompressedSection *mosCompressed;
   SyntheticSection *partEnd;
   SyntheticSection *partIndex;
   PltSection *plt;
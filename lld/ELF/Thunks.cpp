@@ -23,8 +23,10 @@
 #include "Thunks.h"
 #include "Config.h"
 #include "InputSection.h"
+#include "MOSBanks.h"
 #include "OutputSections.h"
 #include "Symbols.h"
+#include "SymbolTable.h"
 #include "SyntheticSections.h"
 #include "Target.h"
 #include "lld/Common/ErrorHandler.h"
@@ -243,6 +245,20 @@ public:
   InputSection *getTargetInputSection() const override;
 };
 
+// MOS far call thunk. Calls the runtime to switch to the bank containing the
+// destination; see MOSBanks.cpp.
+class MOSBankThunk final : public Thunk {
+public:
+  MOSBankThunk(Symbol &dest, int64_t addend) : Thunk(dest, addend) {
+    alignment = 1;
+  }
+  uint32_t size() override { return 6; }
+  void writeTo(uint8_t *buf) override;
+  void addSymbols(ThunkSection &isec) override;
+  bool isCompatibleWith(const InputSection &isec,
+                        const Relocation &rel) const override;
+};
+
 class PPC32PltCallStub final : public Thunk {
 public:
   // For R_PPC_PLTREL24, Thunk::addend records the addend which will be used to
@@ -1083,6 +1099,33 @@ bool PPC64PCRelLongBranchThunk::isCompatibleWith(const InputSection &isec,
   return rel.type == R_PPC64_REL24_NOTOC;
 }
 
+void MOSBankThunk::writeTo(uint8_t *buf) {
+  Symbol *bankCall = symtab->find(mosBankCallName);
+  if (!bankCall || !bankCall->isDefined()) {
+    error("far call thunk to " + toString(destination) + " requires " +
+          mosBankCallName + " to be defined");
+    return;
+  }
+  auto *d = cast<Defined>(&destination);
+  buf[0] = 0x20; // JSR __mos_bank_call
+  write16(buf + 1, bankCall->getVA());
+  buf[3] = *getMOSBank(d->section->getOutputSection());
+  write16(buf + 4, destination.getVA(addend));
+}
+
+void MOSBankThunk::addSymbols(ThunkSection &isec) {
+  addSymbol(saver.save("__mos_far_" + destination.getName()), STT_FUNC, 0,
+            isec);
+}
+
+// A thunk can be used by any caller in its own bank, or by any caller at all
+// if it's outside the banked window.
+bool MOSBankThunk::isCompatibleWith(const InputSection &isec,
+                                    const Relocation &rel) const {
+  const OutputSection *os = getThunkTargetSym()->section->getOutputSection();
+  return !getMOSBank(os) || os == isec.getOutputSection();
+}
+
 Thunk::Thunk(Symbol &d, int64_t a) : destination(d), addend(a), offset(0) {}
 
 Thunk::~Thunk() = default;
@@ -1238,5 +1281,8 @@ Thunk *elf::addThunk(const InputSection &isec, Relocation &rel) {
   if (config->emachine == EM_PPC64)
     return addThunkPPC64(rel.type, s, a);
 
-  llvm_unreachable("add Thunk only supported for ARM, Mips and PowerPC");
+  if (config->emachine == EM_MCS6502)
+    return make<MOSBankThunk>(s, a);
+
+  llvm_unreachable("add Thunk only supported for ARM, Mips, PowerPC and MOS");
 }
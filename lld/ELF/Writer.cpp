@@ -12,6 +12,8 @@
 #include "CallGraphSort.h"
 #include "Config.h"
 #include "LinkerScript.h"
+#include "MOSCompress.h"
+#include "MOSStackSizes.h"
 #include "MapFile.h"
 #include "OutputSections.h"
 #include "Relocations.h"
@@ -512,6 +514,12 @@ template <class ELFT> void elf::createSyntheticSections() {
     add(in.ppc64LongBranchTarget);
   }
 
+  if (config->emachine == EM_MCS6502 && !config->mosCompress.empty()) {
+    in.mosCompressed = make<MOSCompressedSection>();
+    add(in.mosCompressed);
+    addOptionalRegular(mosCompressedName, in.mosCompressed, 0);
+  }
+
   in.gotPlt = make<GotPltSection>();
   add(in.gotPlt);
   in.igotPlt = make<IgotPltSection>();
@@ -609,6 +617,9 @@ template <class ELFT> void Writer<ELFT>::run() {
   for (Partition &part : partitions)
     removeEmptyPTLoad(part.phdrs);
 
+  if (in.mosCompressed)
+    in.mosCompressed->checkSegments();
+
   if (!config->oFormatBinary)
     assignFileOffsets();
   else
@@ -625,6 +636,8 @@ template <class ELFT> void Writer<ELFT>::run() {
   // before checkSections() because the files may be useful in case
   // checkSections() or openFile() fails, for example, due to an erroneous file
   // size.
+  if (config->emachine == EM_MCS6502 && !config->relocatable)
+    computeMOSStackUsage();
   writeMapFile();
   writeCrossReferenceTable();
   writeArchiveStats();
@@ -1755,6 +1768,9 @@ template <class ELFT> void Writer<ELFT>::finalizeAddressDependentContent() {
     if (in.mipsGot)
       in.mipsGot->updateAllocSize();
 
+    if (in.mosCompressed)
+      changed |= in.mosCompressed->updateAllocSize();
+
     for (Partition &part : partitions) {
       changed |= part.relaDyn->updateAllocSize();
       if (part.relrDyn)
@@ -2079,6 +2095,10 @@ template <class ELFT> void Writer<ELFT>::finalizeSections() {
     if (auto *sec = dyn_cast<OutputSection>(base))
       outputSections.push_back(sec);
 
+  // The sections compressed by --mos-compress become NOBITS, which must be
+  // known before segments are created.
+  finalizeSynthetic(in.mosCompressed);
+
   // Prefer command line supplied address over other constraints.
   for (OutputSection *sec : outputSections) {
     auto i = config->sectionStartMap.find(sec->name);
@@ -2919,7 +2939,7 @@ template <class ELFT> void Writer<ELFT>::openFile() {
 
 template <class ELFT> void Writer<ELFT>::writeSectionsBinary() {
   for (OutputSection *sec : outputSections)
-    if (sec->flags & SHF_ALLOC)
+    if ((sec->flags & SHF_ALLOC) && !sec->mosCompressed)
       sec->writeTo<ELFT>(Out::bufferStart + sec->offset);
 }
 
@@ -2967,8 +2987,10 @@ template <class ELFT> void Writer<ELFT>::writeSections() {
     if (sec->type == SHT_REL || sec->type == SHT_RELA)
       sec->writeTo<ELFT>(Out::bufferStart + sec->offset);
 
+  // The contents of sections compressed by --mos-compress are only written
+  // into .mos_compressed.
   for (OutputSection *sec : outputSections)
-    if (sec->type != SHT_REL && sec->type != SHT_RELA)
+    if (sec->type != SHT_REL && sec->type != SHT_RELA && !sec->mosCompressed)
       sec->writeTo<ELFT>(Out::bufferStart + sec->offset);
 }
 
@@ -0,0 +1,38 @@
+# REQUIRES: mos
+## The compressed data depends on addresses that depend on its own size. Here
+## .data refers to the address just past .mos_compressed, and becomes more
+## compressible once that address is final. .mos_compressed keeps the size it
+## grew to, and the unused tail is zero-filled.
+
+# RUN: llvm-mc -filetype=obj -triple=mos %s -o %t.o
+# RUN: echo 'SECTIONS { \
+# RUN:   .text 0x1000 : { *(.text) } \
+# RUN:   .mos_compressed 0x80 : { *(.mos_compressed) } \
+# RUN:   .tail : { *(.tail) } \
+# RUN:   .data 0x2000 : { *(.data) } }' > %t.script
+# RUN: ld.lld -T %t.script --mos-compress=.data --fatal-warnings %t.o -o %t
+# RUN: llvm-readelf -S -s %t | FileCheck --check-prefix=SEC %s
+# RUN: llvm-objdump -s -j .mos_compressed %t | FileCheck %s
+
+## At first, tail is at 0x80, which doesn't match the other bytes of .data, so
+## the data takes 10 bytes. That moves tail to 0x8a, after which it takes 8.
+# SEC: .mos_compressed PROGBITS 00000080 {{[0-9a-f]+}} 00000a
+# SEC: 0000008a 0 NOTYPE GLOBAL DEFAULT {{[0-9]+}} tail
+
+# CHECK:      Contents of section .mos_compressed:
+# CHECK-NEXT:  0080 01002001 8a850000 0000
+
+.globl _start, __mos_decompress
+_start:
+__mos_decompress:
+  lda __mos_compressed
+  rts
+
+.section .tail,"a",@progbits
+.globl tail
+tail:
+.byte 0
+
+.data
+.fill 8, 1, 0x8a
+.byte tail
@@ -0,0 +1,51 @@
+# REQUIRES: mos
+# RUN: llvm-mc -filetype=obj -triple=mos %s -o %t.o
+
+# RUN: not ld.lld --mos-compress=.nonexistent %t.o -o /dev/null 2>&1 | \
+# RUN:   FileCheck --check-prefix=MISSING %s
+# MISSING: error: --mos-compress: no such output section: .nonexistent
+
+# RUN: not ld.lld --mos-compress=.bss %t.o -o /dev/null 2>&1 | \
+# RUN:   FileCheck --check-prefix=NOBITS %s
+# NOBITS: error: --mos-compress: .bss is not an allocated section with contents
+
+# RUN: not ld.lld --mos-compress=.mos_compressed %t.o -o /dev/null 2>&1 | \
+# RUN:   FileCheck --check-prefix=SELF %s
+# SELF: error: --mos-compress: cannot compress .mos_compressed, which contains the compressed data
+
+## A compressed section followed by contents in its segment would leave a hole
+## in the image rather than saving space.
+# RUN: echo 'SECTIONS { \
+# RUN:   .text : { *(.text) } \
+# RUN:   .data : { *(.data) } \
+# RUN:   .data2 : { *(.data2) } \
+# RUN:   .bss : { *(.bss) } }' > %t.script
+# RUN: not ld.lld -T %t.script --mos-compress=.data %t.o -o /dev/null 2>&1 | \
+# RUN:   FileCheck --check-prefix=HOLE %s
+# HOLE: error: --mos-compress: .data must be the last section with contents in its segment, but .data2 follows it
+# RUN: ld.lld -T %t.script --mos-compress=.data2 --fatal-warnings %t.o -o %t
+
+## Without __mos_decompress, nothing would unpack the data.
+# RUN: llvm-mc -filetype=obj -triple=mos --defsym=NO_DECOMPRESS=1 %s -o %t.nodecomp.o
+# RUN: ld.lld -T %t.script --mos-compress=.data2 %t.nodecomp.o -o /dev/null 2>&1 | \
+# RUN:   FileCheck --check-prefix=NODECOMP %s
+# NODECOMP: warning: --mos-compress: __mos_decompress is not defined; compressed sections will not be decompressed
+
+.globl _start
+_start:
+  rts
+
+.ifndef NO_DECOMPRESS
+.globl __mos_decompress
+__mos_decompress:
+  rts
+.endif
+
+.data
+.byte 1
+
+.section .data2,"aw",@progbits
+.byte 2
+
+.bss
+.byte 0
@@ -0,0 +1,48 @@
+# REQUIRES: mos
+## --mos-compress stores each named section in .mos_compressed and makes it
+## NOBITS. The linker decompresses the result itself and reports an error if
+## it doesn't match, so a successful link also checks the round trip.
+
+# RUN: llvm-mc -filetype=obj -triple=mos %s -o %t.o
+# RUN: echo 'SECTIONS { \
+# RUN:   .text 0x1000 : { *(.text) } \
+# RUN:   .mos_compressed 0x1800 : { *(.mos_compressed) } \
+# RUN:   .data 0x2000 : { *(.data) } \
+# RUN:   .data2 0x3000 : { *(.data2) } \
+# RUN:   .bss : { *(.bss) } }' > %t.script
+# RUN: ld.lld -T %t.script --mos-compress=.data --mos-compress=.data2 \
+# RUN:   --fatal-warnings %t.o -o %t
+# RUN: llvm-readelf -S -s %t | FileCheck --check-prefix=SEC %s
+# RUN: llvm-objdump -s -j .mos_compressed %t | FileCheck %s
+
+## Naming a section twice compresses it once.
+# RUN: ld.lld -T %t.script --mos-compress=.data --mos-compress=.data2 \
+# RUN:   --mos-compress=.data --fatal-warnings %t.o -o %t.twice
+# RUN: cmp %t %t.twice
+
+# SEC:      .mos_compressed PROGBITS 00001800 {{[0-9a-f]+}} 00001c
+# SEC:      .data           NOBITS   00002000 {{[0-9a-f]+}} 00000c
+# SEC-NEXT: .data2          NOBITS   00003000 {{[0-9a-f]+}} 000108
+# SEC:      00001800 0 NOTYPE {{.*}} __mos_compressed
+
+## Two sections, then for each its run address and stream:
+##   .data:  3 literals, then a short match of 9 bytes from 3 bytes back.
+##   .data2: 5 literals, then short matches of 66, 66, and 57 bytes from 1 byte
+##           back, then a long match of 4 bytes from 260 bytes back.
+# CHECK:      Contents of section .mos_compressed:
+# CHECK-NEXT:  1800 02002003 61626386 02000030 0578797a
+# CHECK-NEXT:  1810 7755bf00 bf00b600 c0040100
+
+.globl _start, __mos_decompress
+_start:
+__mos_decompress:
+  lda __mos_compressed
+  rts
+
+.data
+.ascii "abcabcabcabc"
+
+.section .data2,"aw",@progbits
+.ascii "xyzw"
+.fill 256, 1, 0x55
+.ascii "xyzw"
@@ -1089,7 +1089,10 @@ enum : unsigned {
   SHF_ARM_PURECODE = 0x20000000,
 
   // 8-bit addressable section
-  SHF_MOS_ZEROPAGE = 0x10000000
+  SHF_MOS_ZEROPAGE = 0x10000000,
+
+  // Section must not straddle a 256-byte page boundary
+  SHF_MOS_NOPAGECROSS = 0x20000000
 };
 
 // Section Group Flags
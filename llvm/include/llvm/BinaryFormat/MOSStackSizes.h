@@ -0,0 +1,54 @@
+//===- MOSStackSizes.h - MOS stack usage section ----------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header describes the .mos_stack_sizes section, which the MOS backend
+// emits to describe the stack usage of each function and which the linker
+// combines with the call graph to compute worst-case stack depths.
+//
+// The section is a sequence of little-endian records, one per function:
+//
+//   uint16_t Function;     Address of the function (relocated).
+//   uint16_t StaticBytes;  Size of the function's static stack frame.
+//   uint16_t SoftBytes;    Bytes the function reserves on the soft stack.
+//   uint8_t  HardBytes;    Maximum bytes pushed on the hard stack.
+//   uint8_t  CallBytes;    Hard stack depth at the deepest call, including
+//                          the return address pushed by JSR; zero if the
+//                          function makes no calls.
+//   uint8_t  Flags;        A combination of StackSizesFlags.
+//   uint8_t  NumCallees;   Number of direct callees that follow.
+//   uint16_t Callees[NumCallees]; Addresses of the callees (relocated).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_BINARYFORMAT_MOSSTACKSIZES_H
+#define LLVM_BINARYFORMAT_MOSSTACKSIZES_H
+
+#include <cstdint>
+
+namespace llvm {
+namespace MOS {
+
+/// Name of the section containing the stack usage records.
+constexpr const char StackSizesSectionName[] = ".mos_stack_sizes";
+
+/// Size of a stack usage record, not including its callees.
+constexpr unsigned StackSizesRecordSize = 10;
+
+enum StackSizesFlags : uint8_t {
+  /// The function is an interrupt service routine.
+  SSF_ISR = 1 << 0,
+  /// The function makes calls whose targets aren't known.
+  SSF_INDIRECT_CALLS = 1 << 1,
+  /// The function's soft stack usage depends on runtime values.
+  SSF_DYNAMIC = 1 << 2,
+};
+
+} // namespace MOS
+} // namespace llvm
+
+#endif // LLVM_BINARYFORMAT_MOSSTACKSIZES_H
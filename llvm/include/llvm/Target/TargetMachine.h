@@ -337,6 +337,19 @@ public:
   /// with the new pass manager. Only affects the "default" AAManager.
   virtual void registerDefaultAliasAnalyses(AAManager &) {}
 
+  /// Note that \p M holds the whole program, as merged by regular LTO, rather
+  /// than a single translation unit. Targets may record this in the IR for
+  /// passes that can make closed-world assumptions. Only called when the LTO
+  /// configuration asserts whole program visibility.
+  virtual void markWholeProgram(Module &M) {}
+
+  /// Prepare the whole-program module \p M to be split into partitions that
+  /// are code generated in parallel, as with LTO. Targets may run passes that
+  /// need to see the whole program here, recording their results in the IR for
+  /// each partition to use. Returns false if \p M must instead be code
+  /// generated as a single partition.
+  virtual bool prepareForSplitCodeGen(Module &M) { return true; }
+
   /// Add passes to the specified pass manager to get the specified file
   /// emitted.  Typically this will involve several steps of code generation.
   /// This method should return true if emission of this file type is not
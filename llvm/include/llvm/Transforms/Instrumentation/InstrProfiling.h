@@ -84,6 +84,13 @@ private:
   /// Returns true if profile counter update register promotion is enabled.
   bool isCounterPromotionEnabled() const;
 
+  /// Returns true if counters are narrow and saturating, for targets without
+  /// a profile runtime (MOS).
+  bool usesSaturatingCounters() const;
+
+  /// Returns the type of each profile counter.
+  Type *getCounterType() const;
+
   /// Count the number of instrumented value sites for the function.
   void computeNumValueSiteCounts(InstrProfValueProfileInst *Ins);
 
@@ -505,7 +505,12 @@ Error lto::backend(const Config &C, AddStreamFn AddStream,
       return Error::success();
   }
 
-  if (ParallelCodeGenParallelismLevel == 1) {
+  // The merged module is only the whole program if nothing outside it, such
+  // as a native object, can define or call its symbols.
+  if (C.HasWholeProgramVisibility)
+    TM->markWholeProgram(Mod);
+  if (ParallelCodeGenParallelismLevel == 1 ||
+      !TM->prepareForSplitCodeGen(Mod)) {
     codegen(C, TM.get(), AddStream, 0, Mod, CombinedIndex);
   } else {
     splitCodeGen(C, TM.get(), AddStream, ParallelCodeGenParallelismLevel, Mod,
@@ -338,6 +338,9 @@ static unsigned parseSectionFlags(StringRef flagsStr, bool *UseLastGroup) {
     case 'z':
       flags |= ELF::SHF_MOS_ZEROPAGE;
       break;
+    case 'p':
+      flags |= ELF::SHF_MOS_NOPAGECROSS;
+      break;
     case '?':
       *UseLastGroup = true;
       break;
@@ -121,6 +121,8 @@ void MCSectionELF::PrintSwitchToSection(const MCAsmInfo &MAI, const Triple &T,
   } else if (Arch == Triple::mos) {
     if (Flags & ELF::SHF_MOS_ZEROPAGE)
       OS << 'z';
+    if (Flags & ELF::SHF_MOS_NOPAGECROSS)
+      OS << 'p';
   }
 
   OS << '"';
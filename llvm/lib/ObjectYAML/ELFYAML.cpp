@@ -701,6 +701,7 @@ void ScalarBitSetTraits<ELFYAML::ELF_SHF>::bitset(IO &IO,
     break;
   case ELF::EM_MCS6502:
     BCase(SHF_MOS_ZEROPAGE);
+    BCase(SHF_MOS_NOPAGECROSS);
     break;
   default:
     // Nothing to do.
@@ -115,6 +115,8 @@ StringRef Triple::getArchTypePrefix(ArchType Kind) {
   case mips64:
   case mips64el:    return "mips";
 
+  case mos:         return "mos";
+
   case hexagon:     return "hexagon";
 
   case amdgcn:      return "amdgcn";
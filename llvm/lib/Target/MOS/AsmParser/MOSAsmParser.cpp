@@ -134,6 +134,27 @@ public:
   virtual bool isAddr8() const { return isImm8(); }
   virtual bool isAddr16() const { return isImm16(); }
 
+  // SWEET16 registers are parsed as expressions, so that symbols named like
+  // them remain usable as 6502 operands. Returns -1 if this isn't one.
+  int64_t getSweet16Reg() const {
+    if (!isImm())
+      return -1;
+    int64_t RegNum;
+    if (const auto *CE = dyn_cast<MCConstantExpr>(getImm())) {
+      RegNum = CE->getValue();
+    } else {
+      const auto *SRE = dyn_cast<MCSymbolRefExpr>(getImm());
+      if (!SRE || SRE->getKind() != MCSymbolRefExpr::VK_None)
+        return -1;
+      StringRef Name = SRE->getSymbol().getName();
+      if (Name.size() < 2 || std::tolower(Name.front()) != 'r' ||
+          Name.drop_front().getAsInteger(10, RegNum))
+        return -1;
+    }
+    return (RegNum >= 0 && RegNum < 16) ? RegNum : -1;
+  }
+  virtual bool isSweet16Reg() const { return getSweet16Reg() >= 0; }
+
   static void addExpr(MCInst &Inst, const MCExpr *Expr) {
     if (const auto *CE = dyn_cast<MCConstantExpr>(Expr)) {
       Inst.addOperand(MCOperand::createImm(CE->getValue()));
@@ -166,6 +187,11 @@ public:
     addImmOperands(Inst, N);
   }
 
+  void addSweet16RegOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createImm(getSweet16Reg()));
+  }
+
   static std::unique_ptr<MOSOperand> createImm(const MCExpr *Val, SMLoc S,
                                                SMLoc E) {
     return std::make_unique<MOSOperand>(Val, S, E);
@@ -296,6 +322,8 @@ public:
       return Error(Loc, "operand must be an 16-bit address");
     case Match_InvalidPCRel8:
       return Error(Loc, "operand must be an 8-bit PC relative address");
+    case Match_InvalidSweet16Reg:
+      return Error(Loc, "operand must be a SWEET16 register (r0 to r15)");
     case Match_immediate:
       return Error(Loc, "operand must be an 8 to 16 bit value (between 256 and "
                         "65535 inclusive)");
@@ -523,6 +551,10 @@ public:
     mnemonic [(]expr[),xy]*
     mnemonic a
 
+    SWEET16 only:
+    mnemonic [@]reg
+    mnemonic reg, #expr
+
     65816 only:
     mnemonic [(]expr[),sxy]*
     mnemonic \[ expr \]
@@ -556,6 +588,13 @@ public:
           continue;
         }
       }
+      if (getLexer().is(AsmToken::At)) {
+        eatThatToken(Operands);
+        if (!tryParseExpr(Operands, "register expected after @")) {
+          FirstTime = false;
+          continue;
+        }
+      }
       // I don't know what llvm has against commas, but for some reason
       // TableGen makes an effort to ignore them during parsing.  So,
       // strangely enough, we have to throw out commas too, even though
@@ -67,6 +67,11 @@ void MOSInstPrinter::printOperand(const MCInst *MI, unsigned OpNo,
   }
 }
 
+void MOSInstPrinter::printSweet16Reg(const MCInst *MI, unsigned OpNo,
+                                     raw_ostream &O) {
+  O << 'r' << MI->getOperand(OpNo).getImm();
+}
+
 void MOSInstPrinter::printRegName(raw_ostream &O, unsigned RegNo) const {
   O << getRegisterName(RegNo);
 }
@@ -37,6 +37,7 @@ public:
 // generated by TableGen
   void printInstruction(const MCInst *MI, uint64_t Address, raw_ostream &O);
   void printOperand(const MCInst *MI, unsigned OpNo, raw_ostream &O);
+  void printSweet16Reg(const MCInst *MI, unsigned OpNo, raw_ostream &O);
   static const char *getRegisterName(unsigned RegNo);
   static const char *getRegisterName(unsigned RegNo, unsigned AltIdx);
 
@@ -18,12 +18,62 @@
 
 namespace llvm {
 
+class Module;
+
+namespace MOS {
+
+// Pointers into the zero page are 8 bits wide and use zero page addressing
+// modes; all other pointers are 16 bits wide.
+enum AddressSpace {
+  AS_Default = 0,
+  AS_ZeroPage = 1,
+};
+
+// Function and global variable attribute requesting that the object be placed
+// so that it doesn't straddle a 256-byte page boundary.
+static constexpr const char *NoPageCrossAttr = "mos-nopagecross";
+
+// Function attribute marking a function that runs from RAM, and thus may patch
+// its own instructions.
+static constexpr const char *SelfModifyingAttr = "mos-self-modifying";
+
+// Function attribute requesting that the function be compiled to SWEET16
+// bytecode wherever that's smaller.
+static constexpr const char *Sweet16Attr = "mos-sweet16";
+
+// Module flag recording that the module is the whole program, as under LTO,
+// rather than a single translation unit.
+static constexpr const char *WholeProgramFlag = "mos-whole-program";
+
+// Returns whether M is known to be the whole program.
+bool isWholeProgram(const Module &M);
+
+// Module flag recording that the passes needing the whole program already ran
+// on it, before it was split into partitions for parallel code generation.
+static constexpr const char *WholeProgramPassesFlag =
+    "mos-whole-program-passes";
+
+// Returns whether the whole-program passes already ran on M. If so, M may be
+// only part of the program, so they must not run again.
+bool wholeProgramPassesRan(const Module &M);
+
+} // namespace MOS
+
+void initializeMOSBranchPlacementPass(PassRegistry &);
 void initializeMOSCombinerPass(PassRegistry &);
 void initializeMOSIndexIVPass(PassRegistry &);
+void initializeMOSInternalCCPass(PassRegistry &);
+void initializeMOSInterruptClonePass(PassRegistry &);
+void initializeMOSLibcallRecursionPass(PassRegistry &);
+void initializeMOSLookupTablesPass(PassRegistry &);
 void initializeMOSLowerSelectPass(PassRegistry &);
 void initializeMOSNoRecursePass(PassRegistry &);
+void initializeMOSPageCrossPass(PassRegistry &);
 void initializeMOSPostRAScavengingPass(PassRegistry &);
+void initializeMOSSelfModifyPass(PassRegistry &);
+void initializeMOSSplitTablesPass(PassRegistry &);
 void initializeMOSStaticStackAllocPass(PassRegistry &);
+void initializeMOSSweet16Pass(PassRegistry &);
 
 } // namespace llvm
 
@@ -17,13 +17,24 @@
 #include "MOSSubtarget.h"
 #include "TargetInfo/MOSTargetInfo.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringSet.h"
+#include "llvm/BinaryFormat/ELF.h"
 #include "llvm/BinaryFormat/MOSFlags.h"
+#include "llvm/BinaryFormat/MOSStackSizes.h"
 #include "llvm/CodeGen/AsmPrinter.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSymbolELF.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/TargetRegistry.h"
 
@@ -31,6 +42,10 @@ using namespace llvm;
 
 #define DEBUG_TYPE "asm-printer"
 
+STATISTIC(NumRegTransfers, "Number of register transfers emitted");
+STATISTIC(NumImag8Loads, "Number of imaginary register loads emitted");
+STATISTIC(NumImag8Stores, "Number of imaginary register stores emitted");
+
 namespace {
 
 class MOSAsmPrinter : public AsmPrinter {
@@ -57,6 +72,12 @@ public:
                              const char *ExtraCode, raw_ostream &OS) override;
 
   void emitStartOfAsmFile(Module &M) override;
+
+  void emitFunctionBodyEnd() override;
+
+private:
+  void emitPLPKeepC();
+  void emitStackSizes(const MachineFunction &MF);
 };
 
 // Simple pseudo-instructions have their lowering (with expansion to real
@@ -64,6 +85,32 @@ public:
 #include "MOSGenMCPseudoLowering.inc"
 
 void MOSAsmPrinter::emitInstruction(const MachineInstr *MI) {
+  // Track the cost of copies between registers.
+  switch (MI->getOpcode()) {
+  case MOS::TA:
+  case MOS::T_A:
+    ++NumRegTransfers;
+    break;
+  case MOS::LDImag8:
+    ++NumImag8Loads;
+    break;
+  case MOS::STImag8:
+    ++NumImag8Stores;
+    break;
+  }
+
+  if (MI->getOpcode() == MOS::PLPKeepC) {
+    emitPLPKeepC();
+    return;
+  }
+
+  // Compiler barriers only constrain code motion.
+  if (MI->getOpcode() == MOS::CompilerBarrier) {
+    if (isVerbose())
+      OutStreamer->emitRawComment("COMPILER_BARRIER");
+    return;
+  }
+
   // Do any auto-generated pseudo lowerings.
   if (emitPseudoExpansionLowering(*OutStreamer, MI))
     return;
@@ -73,6 +120,27 @@ void MOSAsmPrinter::emitInstruction(const MachineInstr *MI) {
   EmitToStreamer(*OutStreamer, Inst);
 }
 
+// Pulls the processor status pushed by PHP, then sets the carry back to its
+// value beforehand.
+void MOSAsmPrinter::emitPLPKeepC() {
+  MCSymbol *Set = OutContext.createTempSymbol();
+  MCSymbol *Done = OutContext.createTempSymbol();
+  auto EmitBranch = [&](unsigned Opcode, MCSymbol *Target) {
+    EmitToStreamer(*OutStreamer,
+                   MCInstBuilder(Opcode).addExpr(
+                       MCSymbolRefExpr::create(Target, OutContext)));
+  };
+
+  EmitBranch(MOS::BCS_Relative, Set);
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::PLP_Implied));
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::CLC_Implied));
+  EmitBranch(MOS::BCC_Relative, Done);
+  OutStreamer->emitLabel(Set);
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::PLP_Implied));
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::SEC_Implied));
+  OutStreamer->emitLabel(Done);
+}
+
 void MOSAsmPrinter::lowerOperand(const MachineOperand &MO, MCOperand &MCOp) {
   if (!InstLowering.lowerOperand(MO, MCOp))
     llvm_unreachable("Failed to lower operand.");
@@ -147,6 +215,117 @@ void MOSAsmPrinter::emitStartOfAsmFile(Module &M) {
     Assembler->setELFHeaderEFlags(ModuleEFlags);
 }
 
+void MOSAsmPrinter::emitFunctionBodyEnd() { emitStackSizes(*MF); }
+
+// Returns the number of bytes MI pushes onto the hardware stack, or the
+// negated number it pulls off. Calls are accounted for separately.
+static int getHardStackAdjustment(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  default:
+    return 0;
+  case MOS::PH:
+  case MOS::PHA_Implied:
+  case MOS::PHP_Implied:
+  case MOS::PHX_Implied:
+  case MOS::PHY_Implied:
+    return 1;
+  case MOS::PL:
+  case MOS::PLA_Implied:
+  case MOS::PLP_Implied:
+  case MOS::PLPKeepC:
+  case MOS::PLX_Implied:
+  case MOS::PLY_Implied:
+    return -1;
+  }
+}
+
+// Emits a record describing the stack usage of the function to the
+// .mos_stack_sizes section. The linker combines these with the call graph to
+// compute the worst-case stack depth of the program.
+void MOSAsmPrinter::emitStackSizes(const MachineFunction &MF) {
+  const MOSFrameLowering &TFL =
+      *MF.getSubtarget<MOSSubtarget>().getFrameLowering();
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+
+  uint8_t Flags = 0;
+  if (TFL.isISR(MF))
+    Flags |= MOS::SSF_ISR;
+  if (MFI.hasVarSizedObjects())
+    Flags |= MOS::SSF_DYNAMIC;
+
+  // The hard stack depth on entry to each block is the largest with which any
+  // of its predecessors exits. Pushes and pulls balance around loops, so
+  // visiting the blocks in reverse post-order finds each depth in one pass.
+  DenseMap<const MachineBasicBlock *, unsigned> EntryDepths;
+  unsigned HardBytes = 0;
+  unsigned CallBytes = 0;
+  SetVector<const MCSymbol *> Callees;
+  for (const MachineBasicBlock *MBB :
+       ReversePostOrderTraversal<const MachineFunction *>(&MF)) {
+    unsigned Depth = EntryDepths.lookup(MBB);
+    for (const MachineInstr &MI : *MBB) {
+      if (int Adjustment = getHardStackAdjustment(MI)) {
+        Depth = std::max(0, int(Depth) + Adjustment);
+        HardBytes = std::max(HardBytes, Depth);
+        continue;
+      }
+      switch (MI.getOpcode()) {
+      case MOS::JSR: {
+        CallBytes = std::max(CallBytes, Depth + 2);
+        const MachineOperand &Callee = MI.getOperand(0);
+        if (Callee.isGlobal()) {
+          Callees.insert(getSymbol(Callee.getGlobal()));
+        } else if (Callee.isSymbol()) {
+          // Indirect calls go through __call_indir, which jumps to a target
+          // that isn't known here.
+          if (StringRef(Callee.getSymbolName()) == "__call_indir")
+            Flags |= MOS::SSF_INDIRECT_CALLS;
+          Callees.insert(OutContext.getOrCreateSymbol(Callee.getSymbolName()));
+        } else {
+          Flags |= MOS::SSF_INDIRECT_CALLS;
+        }
+        break;
+      }
+      }
+    }
+    for (const MachineBasicBlock *Succ : MBB->successors()) {
+      unsigned &SuccDepth = EntryDepths[Succ];
+      SuccDepth = std::max(SuccDepth, Depth);
+    }
+  }
+  if (Callees.size() > UINT8_MAX) {
+    Flags |= MOS::SSF_INDIRECT_CALLS;
+    Callees.clear();
+  }
+
+  const auto &TextSec = static_cast<const MCSectionELF &>(*getCurrentSection());
+  unsigned SecFlags = ELF::SHF_LINK_ORDER;
+  StringRef GroupName;
+  if (const MCSymbol *Group = TextSec.getGroup()) {
+    GroupName = Group->getName();
+    SecFlags |= ELF::SHF_GROUP;
+  }
+  MCSection *StackSizesSec = OutContext.getELFSection(
+      MOS::StackSizesSectionName, ELF::SHT_PROGBITS, SecFlags, 0, GroupName,
+      true, TextSec.getUniqueID(),
+      cast<MCSymbolELF>(TextSec.getBeginSymbol()));
+
+  OutStreamer->PushSection();
+  OutStreamer->SwitchSection(StackSizesSec);
+  OutStreamer->emitSymbolValue(CurrentFnSym, 2);
+  OutStreamer->emitIntValue(std::min<uint64_t>(TFL.staticSize(MFI), UINT16_MAX),
+                            2);
+  OutStreamer->emitIntValue(std::min<uint64_t>(MFI.getStackSize(), UINT16_MAX),
+                            2);
+  OutStreamer->emitIntValue(std::min(HardBytes, 255u), 1);
+  OutStreamer->emitIntValue(std::min(CallBytes, 255u), 1);
+  OutStreamer->emitIntValue(Flags, 1);
+  OutStreamer->emitIntValue(Callees.size(), 1);
+  for (const MCSymbol *Callee : Callees)
+    OutStreamer->emitSymbolValue(Callee, 2);
+  OutStreamer->PopSection();
+}
+
 } // namespace
 
 // Force static initialization.
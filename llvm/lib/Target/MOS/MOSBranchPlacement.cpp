@@ -0,0 +1,461 @@
+//===-- MOSBranchPlacement.cpp - MOS Branch Range Placement ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS branch range placement pass.
+//
+// Conditional branches on the 6502 reach only about 127 bytes in either
+// direction. Branch relaxation turns any branch that reaches further into an
+// inverted branch over a JMP, which costs three bytes and makes the branch
+// slower. Often a branch is only out of range because a cold block, such as
+// an error path, was laid out between it and its destination.
+//
+// This pass finds conditional branches that would be relaxed and moves cold
+// blocks between them and their destinations to the end of the function until
+// they are back in range. Branches are considered hottest first, and a block
+// is only moved on behalf of a branch considerably hotter than itself.
+//
+// Moving a block can put other branches out of range: those into it from
+// blocks left in place, and its own branches back. Each of these would be
+// relaxed in turn, so the blocks are only moved if relaxing those branches and
+// adding any JMPs the moved blocks need costs fewer cycles (weighted by block
+// frequency) than relaxing the original branch, or as many cycles and fewer
+// bytes. Relaxing a conditional branch costs three
+// bytes, and at least one cycle each time its block executes, since the
+// fall-through path must then take the inverted branch. A BRA becomes a JMP,
+// which is one byte longer and just as fast. Blocks are chosen by their cost
+// in isolation, but the decision is made on the layout that would result from
+// moving all of them together.
+//
+// Instruction sizes come from getInstSizeInBytes, which overestimates. This
+// may move a block that didn't strictly need to be moved, but since the block
+// is cold, that's cheap.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSBranchPlacement.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <tuple>
+
+#define DEBUG_TYPE "mos-branch-placement"
+
+using namespace llvm;
+
+STATISTIC(NumOutOfRange,
+          "Number of conditional branches out of range before placement");
+STATISTIC(NumBroughtInRange,
+          "Number of conditional branches brought back in range");
+STATISTIC(NumBlocksMoved, "Number of cold blocks moved out of line");
+STATISTIC(NumPutOutOfRange,
+          "Number of branches put out of range by moving blocks");
+STATISTIC(NumUnprofitable, "Number of out-of-range branches left alone "
+                           "because moving blocks would cost more");
+
+static cl::opt<unsigned> ColdBlockRatio(
+    "mos-cold-block-ratio", cl::init(4),
+    cl::desc("Minimum ratio of the frequency of an out-of-range branch to that "
+             "of a block moved out of line to bring it back in range"),
+    cl::Hidden);
+
+namespace {
+
+// The cost of relaxing some set of branches. Cycles are weighted by the
+// frequency of the blocks containing the branches.
+struct RelaxationCost {
+  unsigned NumBranches = 0;
+  uint64_t Bytes = 0;
+  uint64_t Cycles = 0;
+
+  RelaxationCost &operator+=(const RelaxationCost &Other) {
+    NumBranches += Other.NumBranches;
+    Bytes += Other.Bytes;
+    Cycles += Other.Cycles;
+    return *this;
+  }
+  bool operator<(const RelaxationCost &Other) const {
+    return std::tie(Cycles, Bytes) < std::tie(Other.Cycles, Other.Bytes);
+  }
+};
+
+class MOSBranchPlacement : public MachineFunctionPass {
+public:
+  static char ID;
+
+  MOSBranchPlacement() : MachineFunctionPass(ID) {
+    llvm::initializeMOSBranchPlacementPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  const TargetInstrInfo *TII;
+  const MachineBlockFrequencyInfo *MBFI;
+
+  // The worst-case offset of each block from the start of the function,
+  // indexed by block number.
+  SmallVector<uint64_t> BlockOffsets;
+  uint64_t FunctionSize;
+
+  uint64_t getBlockSize(const MachineBasicBlock &MBB) const;
+  void computeBlockOffsets(MachineFunction &MF);
+  int64_t getBranchPosition(const MachineInstr &Br) const;
+  int64_t getBranchOffset(const MachineInstr &Br) const;
+  bool isInRange(const MachineInstr &Br) const;
+  int64_t getOutOfLineSavings(MachineBasicBlock &MBB) const;
+  RelaxationCost getRelaxationCost(const MachineInstr &Br) const;
+  RelaxationCost getOutOfLineCost(MachineBasicBlock &MBB) const;
+  RelaxationCost getBatchCost(MachineFunction &MF,
+                              ArrayRef<MachineBasicBlock *> ToMove,
+                              const MachineInstr &Br, bool &BrInRange) const;
+  bool bringInRange(MachineInstr &Br);
+};
+
+void MOSBranchPlacement::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineBlockFrequencyInfo>();
+  // Only the layout changes; successors and frequencies remain the same.
+  AU.setPreservesCFG();
+  AU.addPreserved<MachineBlockFrequencyInfo>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+// Returns whether MI is a branch that branch relaxation may need to expand.
+static bool isShortBranch(const MachineInstr &MI) {
+  return MI.getOpcode() == MOS::BR || MI.getOpcode() == MOS::BRA;
+}
+
+static MachineInstr *getConditionalBranch(MachineBasicBlock &MBB) {
+  for (MachineInstr &MI : MBB.terminators())
+    if (MI.isConditionalBranch())
+      return &MI;
+  return nullptr;
+}
+
+bool MOSBranchPlacement::runOnMachineFunction(MachineFunction &MF) {
+  TII = MF.getSubtarget().getInstrInfo();
+  MBFI = &getAnalysis<MachineBlockFrequencyInfo>();
+  computeBlockOffsets(MF);
+
+  // Moving blocks may remove the branches of those blocks, so track the
+  // blocks containing the branches instead.
+  SmallVector<MachineBasicBlock *> OutOfRange;
+  for (MachineBasicBlock &MBB : MF) {
+    MachineInstr *Br = getConditionalBranch(MBB);
+    if (Br && !isInRange(*Br))
+      OutOfRange.push_back(&MBB);
+  }
+  NumOutOfRange += OutOfRange.size();
+  if (OutOfRange.empty())
+    return false;
+
+  llvm::stable_sort(OutOfRange, [&](MachineBasicBlock *A,
+                                    MachineBasicBlock *B) {
+    return MBFI->getBlockFreq(A) > MBFI->getBlockFreq(B);
+  });
+
+  // Moving blocks to the end of the function never lengthens a branch between
+  // blocks that weren't moved, so a branch brought in range stays in range.
+  bool Changed = false;
+  for (MachineBasicBlock *MBB : OutOfRange) {
+    MachineInstr *Br = getConditionalBranch(*MBB);
+    if (!Br)
+      continue;
+    if (isInRange(*Br)) {
+      ++NumBroughtInRange;
+      continue;
+    }
+    if (bringInRange(*Br)) {
+      ++NumBroughtInRange;
+      Changed = true;
+      computeBlockOffsets(MF);
+    }
+  }
+  return Changed;
+}
+
+uint64_t
+MOSBranchPlacement::getBlockSize(const MachineBasicBlock &MBB) const {
+  uint64_t Size = 0;
+  for (const MachineInstr &MI : MBB)
+    Size += TII->getInstSizeInBytes(MI);
+  return Size;
+}
+
+void MOSBranchPlacement::computeBlockOffsets(MachineFunction &MF) {
+  BlockOffsets.resize(MF.getNumBlockIDs());
+  uint64_t Offset = 0;
+  for (const MachineBasicBlock &MBB : MF) {
+    // Assume the worst-case padding before aligned blocks.
+    Offset += MBB.getAlignment().value() - 1;
+    BlockOffsets[MBB.getNumber()] = Offset;
+    Offset += getBlockSize(MBB);
+  }
+  FunctionSize = Offset;
+}
+
+// Returns the offset of Br from the start of the function.
+int64_t MOSBranchPlacement::getBranchPosition(const MachineInstr &Br) const {
+  const MachineBasicBlock &MBB = *Br.getParent();
+  int64_t Offset = BlockOffsets[MBB.getNumber()];
+  for (auto I = MBB.begin(); &*I != &Br; ++I)
+    Offset += TII->getInstSizeInBytes(*I);
+  return Offset;
+}
+
+// Returns the offset of the destination of Br from the start of Br.
+int64_t MOSBranchPlacement::getBranchOffset(const MachineInstr &Br) const {
+  return BlockOffsets[TII->getBranchDestBlock(Br)->getNumber()] -
+         getBranchPosition(Br);
+}
+
+bool MOSBranchPlacement::isInRange(const MachineInstr &Br) const {
+  return TII->isBranchOffsetInRange(Br.getOpcode(), getBranchOffset(Br));
+}
+
+// Returns the number of bytes that moving MBB to the end of the function
+// would remove from branches spanning it, or zero if it can't be moved.
+int64_t MOSBranchPlacement::getOutOfLineSavings(MachineBasicBlock &MBB) const {
+  MachineFunction &MF = *MBB.getParent();
+  if (&MBB == &MF.front() || MBB.isEHPad())
+    return 0;
+
+  // The layout predecessor would need a JMP if it fell into MBB.
+  if (std::prev(MBB.getIterator())->canFallThrough())
+    return 0;
+
+  int64_t Savings = getBlockSize(MBB) + MBB.getAlignment().value() - 1;
+
+  // If MBB falls through, it needs a JMP of its own at the end.
+  if (MBB.canFallThrough()) {
+    MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+    SmallVector<MachineOperand> Cond;
+    if (MF.getFunction().hasMinSize() ||
+        TII->analyzeBranch(MBB, TBB, FBB, Cond))
+      return 0;
+    // A JMP is three bytes.
+    Savings -= 3;
+  }
+  return std::max<int64_t>(Savings, 0);
+}
+
+// Returns the cost of relaxing Br.
+RelaxationCost
+MOSBranchPlacement::getRelaxationCost(const MachineInstr &Br) const {
+  RelaxationCost Cost;
+  Cost.NumBranches = 1;
+  if (Br.isConditionalBranch()) {
+    // An inverted branch over a JMP.
+    Cost.Bytes = 3;
+    Cost.Cycles = MBFI->getBlockFreq(Br.getParent()).getFrequency();
+  } else {
+    // BRA becomes JMP.
+    Cost.Bytes = 1;
+  }
+  return Cost;
+}
+
+// Returns the cost of the branches that moving MBB alone to the end of the
+// function would put out of range, along with the JMP it may need at its end.
+// This only ranks the candidates; see getBatchCost.
+RelaxationCost
+MOSBranchPlacement::getOutOfLineCost(MachineBasicBlock &MBB) const {
+  RelaxationCost Cost;
+  int64_t NewOffset = FunctionSize - getBlockSize(MBB);
+
+  // Branches into MBB from blocks left in place.
+  for (MachineBasicBlock *Pred : MBB.predecessors()) {
+    if (Pred == &MBB)
+      continue;
+    for (const MachineInstr &MI : Pred->terminators()) {
+      if (!isShortBranch(MI) || TII->getBranchDestBlock(MI) != &MBB ||
+          !isInRange(MI))
+        continue;
+      if (!TII->isBranchOffsetInRange(MI.getOpcode(),
+                                      NewOffset - getBranchPosition(MI)))
+        Cost += getRelaxationCost(MI);
+    }
+  }
+
+  // Branches out of MBB back to blocks left in place.
+  int64_t Position = NewOffset;
+  for (const MachineInstr &MI : MBB) {
+    if (isShortBranch(MI) && TII->getBranchDestBlock(MI) != &MBB &&
+        isInRange(MI)) {
+      const MachineBasicBlock &Dest = *TII->getBranchDestBlock(MI);
+      if (!TII->isBranchOffsetInRange(
+              MI.getOpcode(), BlockOffsets[Dest.getNumber()] - Position))
+        Cost += getRelaxationCost(MI);
+    }
+    Position += TII->getInstSizeInBytes(MI);
+  }
+
+  if (MBB.canFallThrough()) {
+    Cost.Bytes += 3;
+    Cost.Cycles += 3 * MBFI->getBlockFreq(&MBB).getFrequency();
+  }
+  return Cost;
+}
+
+// Returns the cost of moving the blocks in ToMove, in order, to the end of the
+// function: the relaxation of every branch the new layout would put out of
+// range, and the JMPs the moved blocks would need at their ends. Sets
+// BrInRange to whether Br would then be in range.
+RelaxationCost
+MOSBranchPlacement::getBatchCost(MachineFunction &MF,
+                                 ArrayRef<MachineBasicBlock *> ToMove,
+                                 const MachineInstr &Br,
+                                 bool &BrInRange) const {
+  SmallPtrSet<const MachineBasicBlock *, 8> Moved(ToMove.begin(),
+                                                  ToMove.end());
+  auto NeedsJMP = [&](const MachineBasicBlock &MBB) {
+    return Moved.contains(&MBB) && MBB.canFallThrough();
+  };
+
+  SmallVector<uint64_t> NewOffsets(MF.getNumBlockIDs());
+  uint64_t Offset = 0;
+  auto Place = [&](const MachineBasicBlock &MBB) {
+    Offset += MBB.getAlignment().value() - 1;
+    NewOffsets[MBB.getNumber()] = Offset;
+    Offset += getBlockSize(MBB);
+    if (NeedsJMP(MBB))
+      Offset += 3;
+  };
+  for (const MachineBasicBlock &MBB : MF)
+    if (!Moved.contains(&MBB))
+      Place(MBB);
+  for (const MachineBasicBlock *MBB : ToMove)
+    Place(*MBB);
+
+  RelaxationCost Cost;
+  BrInRange = false;
+  for (const MachineBasicBlock &MBB : MF) {
+    int64_t Position = NewOffsets[MBB.getNumber()];
+    for (const MachineInstr &MI : MBB) {
+      if (isShortBranch(MI)) {
+        const MachineBasicBlock &Dest = *TII->getBranchDestBlock(MI);
+        bool InRange = TII->isBranchOffsetInRange(
+            MI.getOpcode(), NewOffsets[Dest.getNumber()] - Position);
+        if (&MI == &Br)
+          BrInRange = InRange;
+        else if (!InRange && isInRange(MI))
+          Cost += getRelaxationCost(MI);
+      }
+      Position += TII->getInstSizeInBytes(MI);
+    }
+    if (NeedsJMP(MBB)) {
+      Cost.Bytes += 3;
+      Cost.Cycles += 3 * MBFI->getBlockFreq(&MBB).getFrequency();
+    }
+  }
+  return Cost;
+}
+
+bool MOSBranchPlacement::bringInRange(MachineInstr &Br) {
+  MachineBasicBlock *From = Br.getParent();
+  MachineBasicBlock *Dest = TII->getBranchDestBlock(Br);
+  MachineFunction &MF = *From->getParent();
+  if (Dest == From)
+    return false;
+  uint64_t Freq = MBFI->getBlockFreq(From).getFrequency();
+
+  int64_t Offset = getBranchOffset(Br);
+  bool Forward = Offset > 0;
+  auto Begin = std::next((Forward ? From : Dest)->getIterator());
+  auto End = (Forward ? Dest : From)->getIterator();
+
+  struct Candidate {
+    MachineBasicBlock *MBB;
+    int64_t Savings;
+    RelaxationCost Cost;
+  };
+  SmallVector<Candidate> Candidates;
+  for (MachineBasicBlock &MBB : make_range(Begin, End)) {
+    if (MBFI->getBlockFreq(&MBB).getFrequency() * ColdBlockRatio > Freq)
+      continue;
+    if (int64_t Savings = getOutOfLineSavings(MBB))
+      Candidates.push_back({&MBB, Savings, getOutOfLineCost(MBB)});
+  }
+
+  // Move the cheapest blocks first, and of those, the coldest.
+  llvm::stable_sort(Candidates, [&](const Candidate &A, const Candidate &B) {
+    if (A.Cost < B.Cost)
+      return true;
+    if (B.Cost < A.Cost)
+      return false;
+    return MBFI->getBlockFreq(A.MBB) < MBFI->getBlockFreq(B.MBB);
+  });
+
+  SmallVector<MachineBasicBlock *> ToMove;
+  for (const Candidate &C : Candidates) {
+    if (TII->isBranchOffsetInRange(Br.getOpcode(), Offset))
+      break;
+    ToMove.push_back(C.MBB);
+    Offset += Forward ? -C.Savings : C.Savings;
+  }
+
+  // Keep the moved blocks in their original relative order.
+  llvm::sort(ToMove, [&](MachineBasicBlock *A, MachineBasicBlock *B) {
+    return BlockOffsets[A->getNumber()] < BlockOffsets[B->getNumber()];
+  });
+
+  // The candidates' costs were each taken as if only that block moved.
+  // Moving them together spaces them out at the end, so recheck the whole
+  // layout.
+  bool BrInRange;
+  RelaxationCost Cost = getBatchCost(MF, ToMove, Br, BrInRange);
+  if (!BrInRange) {
+    LLVM_DEBUG(dbgs() << "Not enough cold blocks to bring " << Br
+                      << " in range.\n");
+    return false;
+  }
+  if (!(Cost < getRelaxationCost(Br))) {
+    LLVM_DEBUG(dbgs() << "Bringing " << Br << " in range costs more than "
+                      << "relaxing it.\n");
+    ++NumUnprofitable;
+    return false;
+  }
+  NumPutOutOfRange += Cost.NumBranches;
+
+  for (MachineBasicBlock *MBB : ToMove) {
+    LLVM_DEBUG(dbgs() << "Moving " << printMBBReference(*MBB)
+                      << " out of line to bring " << Br << " in range.\n");
+    MachineBasicBlock *OldLayoutSucc = MBB->getNextNode();
+    MBB->moveAfter(&MF.back());
+    MBB->updateTerminator(OldLayoutSucc);
+    ++NumBlocksMoved;
+  }
+  return true;
+}
+
+} // namespace
+
+char MOSBranchPlacement::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSBranchPlacement, DEBUG_TYPE,
+                      "Move cold blocks out of the range of branches", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(MOSBranchPlacement, DEBUG_TYPE,
+                    "Move cold blocks out of the range of branches", false,
+                    false)
+
+MachineFunctionPass *llvm::createMOSBranchPlacementPass() {
+  return new MOSBranchPlacement();
+}
@@ -33,6 +33,7 @@
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/IR/CallingConv.h"
 #include "llvm/Target/TargetMachine.h"
+#include <algorithm>
 #include <memory>
 
 using namespace llvm;
@@ -41,6 +42,12 @@ using namespace llvm;
 
 namespace {
 
+// Returns the calling convention used for fixed values of the given
+// convention.
+CCAssignFn *getFixedCC(CallingConv::ID CC) {
+  return CC == CallingConv::Fast ? CC_MOS_Internal : CC_MOS;
+}
+
 /// Handler to pass values outward to calls and return statements.
 struct MOSOutgoingValueHandler : CallLowering::OutgoingValueHandler {
   /// The instruction causing control flow to leave the current function. This
@@ -101,7 +108,8 @@ struct MOSOutgoingValueHandler : CallLowering::OutgoingValueHandler {
     // Use TableGen-ereted code to assign the argument to a location.
     bool Res;
     if (Info.IsFixed) {
-      Res = CC_MOS(ValNo, ValVT, LocVT, LocInfo, Flags, State);
+      Res = getFixedCC(State.getCallingConv())(ValNo, ValVT, LocVT, LocInfo,
+                                               Flags, State);
     } else {
       // The variable portion of vararg calls are always passed through the
       // stack.
@@ -215,7 +223,8 @@ struct MOSIncomingValueHandler : CallLowering::IncomingValueHandler {
       State.AllocateReg(R);
 
     // Use TableGen-ereted code to assign the argument to a location.
-    bool Res = CC_MOS(ValNo, ValVT, LocVT, LocInfo, Flags, State);
+    bool Res = getFixedCC(State.getCallingConv())(ValNo, ValVT, LocVT,
+                                                  LocInfo, Flags, State);
     StackSize = State.getNextStackOffset();
     return Res;
   }
@@ -298,6 +307,20 @@ struct MOSIncomingReturnHandler : public MOSIncomingValueHandler {
   }
 };
 
+// Under the internal calling convention, arguments marked inreg are assigned
+// before all others, so that earlier arguments can't take the registers that
+// later index and pointer arguments are used from. Caller and callee see the
+// same inreg flags, so both order the arguments the same way.
+void assignInRegFirst(CallingConv::ID CC, bool IsVarArg,
+                      SmallVectorImpl<CallLowering::ArgInfo> &Args) {
+  if (CC != CallingConv::Fast || IsVarArg)
+    return;
+  std::stable_partition(Args.begin(), Args.end(),
+                        [](const CallLowering::ArgInfo &Arg) {
+                          return Arg.Flags[0].isInReg();
+                        });
+}
+
 // Add missing pointer information from the LLT to the argument flags for the
 // corresponding MVT. The MVT doesn't contain pointer information, so this would
 // otherwise be unavailable for use by the calling convention (i.e., CCIfPtr).
@@ -388,6 +411,7 @@ bool MOSCallLowering::lowerFormalArguments(MachineIRBuilder &MIRBuilder,
     splitToValueTypes(OrigArg, SplitArgs, DL);
     ++Idx;
   }
+  assignInRegFirst(F.getCallingConv(), F.isVarArg(), SplitArgs);
 
   MOSIncomingArgsHandler Handler(MIRBuilder, MRI);
   // Invoke TableGen compatibility layer to create loads and copies from the
@@ -448,6 +472,7 @@ bool MOSCallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
   for (auto &OrigArg : Info.OrigArgs) {
     splitToValueTypes(OrigArg, OutArgs, DL);
   }
+  assignInRegFirst(Info.CallConv, Info.IsVarArg, OutArgs);
 
   SmallVector<ArgInfo, 8> InArgs;
   if (!Info.OrigRet.Ty->isVoidTy())
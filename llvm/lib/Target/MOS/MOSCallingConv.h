@@ -24,6 +24,11 @@ bool CC_MOS(unsigned ValNo, MVT ValVT, MVT LocVT,
                 CCValAssign::LocInfo LocInfo, ISD::ArgFlagsTy ArgFlags,
                 CCState &State);
 
+/// Calling convention for local functions with all call sites known (fastcc).
+bool CC_MOS_Internal(unsigned ValNo, MVT ValVT, MVT LocVT,
+                     CCValAssign::LocInfo LocInfo, ISD::ArgFlagsTy ArgFlags,
+                     CCState &State);
+
 /// Calling convention used for the dynamic portion of varargs calls. Just puts
 /// everything on the stack.
 bool CC_MOS_VarArgs(unsigned ValNo, MVT ValVT, MVT LocVT,
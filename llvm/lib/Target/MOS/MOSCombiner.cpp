@@ -31,7 +31,10 @@
 #include "llvm/CodeGen/TargetOpcodes.h"
 #include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/KnownBits.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Target/TargetMachine.h"
 
 #define DEBUG_TYPE "mos-combiner"
@@ -78,6 +81,213 @@ applyFoldGlobalOffset(MachineInstr &MI, MachineRegisterInfo &MRI,
   return true;
 }
 
+// The narrowing combines are only worthwhile before the legalizer has split
+// everything into bytes.
+static bool isPreLegalize(const MachineInstr &MI) {
+  return !MI.getMF()->getProperties().hasProperty(
+      MachineFunctionProperties::Property::Legalized);
+}
+
+// Returns the width of the byte-multiple type needed to hold Bits bits.
+static unsigned getNarrowWidth(unsigned Bits) {
+  return std::max<unsigned>(alignTo(Bits, 8), 8);
+}
+
+// G_TRUNC (binop x, y) => binop (G_TRUNC x), (G_TRUNC y)
+//
+// The low bits of these operations depend only on the low bits of their
+// operands.
+static bool matchNarrowTruncBinOp(MachineInstr &MI, MachineRegisterInfo &MRI) {
+  using namespace TargetOpcode;
+  assert(MI.getOpcode() == G_TRUNC);
+  if (!isPreLegalize(MI) || !MRI.getType(MI.getOperand(0).getReg()).isScalar())
+    return false;
+
+  Register Src = MI.getOperand(1).getReg();
+  if (!MRI.hasOneNonDBGUse(Src))
+    return false;
+  MachineInstr *BinOp = MRI.getVRegDef(Src);
+  if (!BinOp)
+    return false;
+  switch (BinOp->getOpcode()) {
+  default:
+    return false;
+  case G_ADD:
+  case G_SUB:
+  case G_MUL:
+  case G_AND:
+  case G_OR:
+  case G_XOR:
+    return true;
+  }
+}
+
+static bool applyNarrowTruncBinOp(MachineInstr &MI, MachineRegisterInfo &MRI,
+                                  MachineIRBuilder &B) {
+  MachineInstr &BinOp = *MRI.getVRegDef(MI.getOperand(1).getReg());
+  Register Dst = MI.getOperand(0).getReg();
+  LLT Ty = MRI.getType(Dst);
+
+  B.setInstrAndDebugLoc(MI);
+  auto LHS = B.buildTrunc(Ty, BinOp.getOperand(1));
+  auto RHS = B.buildTrunc(Ty, BinOp.getOperand(2));
+  B.buildInstr(BinOp.getOpcode(), {Dst}, {LHS, RHS});
+  MI.eraseFromParent();
+  BinOp.eraseFromParent();
+  return true;
+}
+
+// G_TRUNC (G_LOAD x) => G_LOAD x, narrowed
+//
+// MOS is little-endian, so the low bytes of a value are at its address.
+static bool matchNarrowTruncLoad(MachineInstr &MI, MachineRegisterInfo &MRI) {
+  using namespace TargetOpcode;
+  assert(MI.getOpcode() == G_TRUNC);
+  if (!isPreLegalize(MI))
+    return false;
+  LLT Ty = MRI.getType(MI.getOperand(0).getReg());
+  if (!Ty.isScalar() || !Ty.isByteSized())
+    return false;
+
+  Register Src = MI.getOperand(1).getReg();
+  if (!MRI.hasOneNonDBGUse(Src))
+    return false;
+  MachineInstr *Load = MRI.getVRegDef(Src);
+  if (!Load)
+    return false;
+  switch (Load->getOpcode()) {
+  default:
+    return false;
+  case G_LOAD:
+  case G_SEXTLOAD:
+  case G_ZEXTLOAD:
+    break;
+  }
+  if (!Load->hasOneMemOperand())
+    return false;
+  const MachineMemOperand &MMO = **Load->memoperands_begin();
+  return !MMO.isVolatile() && !MMO.isAtomic();
+}
+
+static bool applyNarrowTruncLoad(MachineInstr &MI, MachineRegisterInfo &MRI,
+                                 MachineIRBuilder &B) {
+  using namespace TargetOpcode;
+  MachineInstr &Load = *MRI.getVRegDef(MI.getOperand(1).getReg());
+  const MachineMemOperand &MMO = **Load.memoperands_begin();
+  Register Dst = MI.getOperand(0).getReg();
+  LLT Ty = MRI.getType(Dst);
+
+  // A narrower load of the same memory is a plain load; otherwise the
+  // extension just has less far to go.
+  unsigned Opcode = G_LOAD;
+  uint64_t Size = Ty.getSizeInBytes();
+  if (Size > MMO.getSize()) {
+    Opcode = Load.getOpcode();
+    Size = MMO.getSize();
+  }
+  MachineMemOperand *NewMMO = B.getMF().getMachineMemOperand(&MMO, 0, Size);
+
+  // Load where the original did to keep the order of memory operations.
+  B.setInstrAndDebugLoc(Load);
+  B.buildLoadInstr(Opcode, Dst, Load.getOperand(1), *NewMMO);
+  MI.eraseFromParent();
+  Load.eraseFromParent();
+  return true;
+}
+
+// G_AND x, y => G_ZEXT (G_AND (G_TRUNC x), (G_TRUNC y))
+//
+// Also for G_OR and G_XOR. The high bits of the result must be known zero.
+static bool matchNarrowLogic(MachineInstr &MI, MachineRegisterInfo &MRI,
+                             GISelKnownBits &KB, unsigned &NarrowWidth) {
+  using namespace TargetOpcode;
+  if (!isPreLegalize(MI))
+    return false;
+  LLT Ty = MRI.getType(MI.getOperand(0).getReg());
+  if (!Ty.isScalar() || Ty.getSizeInBits() <= 8)
+    return false;
+
+  unsigned Width = Ty.getSizeInBits();
+  KnownBits LHS = KB.getKnownBits(MI.getOperand(1).getReg());
+  KnownBits RHS = KB.getKnownBits(MI.getOperand(2).getReg());
+  unsigned LHSBits = Width - LHS.countMinLeadingZeros();
+  unsigned RHSBits = Width - RHS.countMinLeadingZeros();
+  unsigned Bits = MI.getOpcode() == G_AND ? std::min(LHSBits, RHSBits)
+                                          : std::max(LHSBits, RHSBits);
+  NarrowWidth = getNarrowWidth(Bits);
+  return NarrowWidth < Width;
+}
+
+static bool applyNarrowLogic(MachineInstr &MI, MachineRegisterInfo &MRI,
+                             MachineIRBuilder &B, unsigned NarrowWidth) {
+  LLT NarrowTy = LLT::scalar(NarrowWidth);
+  B.setInstrAndDebugLoc(MI);
+  auto LHS = B.buildTrunc(NarrowTy, MI.getOperand(1));
+  auto RHS = B.buildTrunc(NarrowTy, MI.getOperand(2));
+  auto Op = B.buildInstr(MI.getOpcode(), {NarrowTy}, {LHS, RHS});
+  B.buildZExt(MI.getOperand(0), Op);
+  MI.eraseFromParent();
+  return true;
+}
+
+// G_ICMP pred, x, y => G_ICMP pred', (G_TRUNC x), (G_TRUNC y)
+//
+// Valid whenever both operands are known to be zero or sign extensions from
+// the narrower type.
+static bool
+matchNarrowICmp(MachineInstr &MI, MachineRegisterInfo &MRI, GISelKnownBits &KB,
+                std::pair<unsigned, CmpInst::Predicate> &MatchInfo) {
+  using namespace TargetOpcode;
+  assert(MI.getOpcode() == G_ICMP);
+  if (!isPreLegalize(MI))
+    return false;
+  Register LHS = MI.getOperand(2).getReg();
+  Register RHS = MI.getOperand(3).getReg();
+  LLT Ty = MRI.getType(LHS);
+  if (!Ty.isScalar() || Ty.getSizeInBits() <= 8)
+    return false;
+
+  unsigned Width = Ty.getSizeInBits();
+  auto Pred = static_cast<CmpInst::Predicate>(MI.getOperand(1).getPredicate());
+
+  // Zero extended values are nonnegative, so signed and unsigned comparisons
+  // agree on them.
+  unsigned ZeroBits =
+      Width - std::min(KB.getKnownBits(LHS).countMinLeadingZeros(),
+                       KB.getKnownBits(RHS).countMinLeadingZeros());
+  unsigned ZeroWidth = getNarrowWidth(ZeroBits);
+
+  // Sign extension preserves both signed and unsigned order.
+  unsigned SignBits = Width + 1 -
+                      std::min(KB.computeNumSignBits(LHS),
+                               KB.computeNumSignBits(RHS));
+  unsigned SignWidth = getNarrowWidth(SignBits);
+
+  if (ZeroWidth <= SignWidth && ZeroWidth < Width) {
+    MatchInfo = {ZeroWidth, ICmpInst::isEquality(Pred)
+                                ? Pred
+                                : ICmpInst::getUnsignedPredicate(Pred)};
+    return true;
+  }
+  if (SignWidth < Width) {
+    MatchInfo = {SignWidth, Pred};
+    return true;
+  }
+  return false;
+}
+
+static bool
+applyNarrowICmp(MachineInstr &MI, MachineRegisterInfo &MRI, MachineIRBuilder &B,
+                std::pair<unsigned, CmpInst::Predicate> &MatchInfo) {
+  LLT NarrowTy = LLT::scalar(MatchInfo.first);
+  B.setInstrAndDebugLoc(MI);
+  auto LHS = B.buildTrunc(NarrowTy, MI.getOperand(2));
+  auto RHS = B.buildTrunc(NarrowTy, MI.getOperand(3));
+  B.buildICmp(MatchInfo.second, MI.getOperand(0), LHS, RHS);
+  MI.eraseFromParent();
+  return true;
+}
+
 class MOSCombinerHelperState {
 protected:
   CombinerHelper &Helper;
@@ -48,6 +48,11 @@ MOSTargetLowering::MOSTargetLowering(const MOSTargetMachine &TM,
 
   // Used in legalizer (etc.) to refer to the stack pointer.
   setStackPointerRegisterToSaveRestore(MOS::RS0);
+
+  // Single-byte atomics are legalized by disabling interrupts around them, if
+  // the 6502 has no single instruction for them. Wider atomics are expanded to
+  // __atomic_* libcalls.
+  setMaxAtomicSizeInBitsSupported(8);
 }
 
 unsigned MOSTargetLowering::getNumRegistersForInlineAsm(LLVMContext &Context,
@@ -30,6 +30,7 @@
 #include "llvm/CodeGen/PseudoSourceValue.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Target/TargetMachine.h"
@@ -41,6 +42,11 @@ using namespace llvm;
 #define GET_INSTRINFO_CTOR_DTOR
 #include "MOSGenInstrInfo.inc"
 
+static cl::opt<bool> MaskDecimalInterrupts(
+    "mos-mask-decimal-interrupts", cl::init(true),
+    cl::desc("Mask interrupts while in decimal mode on processors that don't "
+             "clear the decimal flag on interrupt."));
+
 MOSInstrInfo::MOSInstrInfo()
     : MOSGenInstrInfo(/*CFSetupOpcode=*/MOS::ADJCALLSTACKDOWN,
                       /*CFDestroyOpcode=*/MOS::ADJCALLSTACKUP) {}
@@ -150,8 +156,19 @@ MachineInstr *MOSInstrInfo::commuteInstructionImpl(MachineInstr &MI, bool NewMI,
 }
 
 unsigned MOSInstrInfo::getInstSizeInBytes(const MachineInstr &MI) const {
-  // Overestimate the size of each instruction to guarantee that any necessary
-  // branches are relaxed.
+  if (MI.isMetaInstruction() || MI.getOpcode() == MOS::CompilerBarrier)
+    return 0;
+  if (MI.isInlineAsm()) {
+    const MachineFunction &MF = *MI.getMF();
+    return getInlineAsmLength(MI.getOperand(0).getSymbolName(),
+                              *MF.getTarget().getMCAsmInfo());
+  }
+
+  if (unsigned Size = MI.getDesc().getSize())
+    return Size;
+
+  // Overestimate the size of each instruction without a known size to
+  // guarantee that any necessary branches are relaxed.
   return 3;
 }
 
@@ -694,6 +711,12 @@ bool MOSInstrInfo::expandPostRAPseudo(MachineInstr &MI) const {
   case MOS::SetSPHi:
     expandSetSP(Builder);
     break;
+  case MOS::ADCDecImm:
+  case MOS::ADCDecImag8:
+  case MOS::SBCDecImm:
+  case MOS::SBCDecImag8:
+    expandDecimal(Builder);
+    break;
   }
 
   return Changed;
@@ -745,7 +768,8 @@ void MOSInstrInfo::expandLDIdx(MachineIRBuilder &Builder) const {
     Builder.buildInstr(MOS::LDAIdx)
         .addDef(Tmp)
         .add(MI.getOperand(1))
-        .add(MI.getOperand(2));
+        .add(MI.getOperand(2))
+        .cloneMemRefs(MI);
     Builder.buildInstr(MOS::TA).add(MI.getOperand(0)).addUse(Tmp);
     MI.eraseFromParent();
     return;
@@ -821,6 +845,101 @@ void MOSInstrInfo::expandSetSP(MachineIRBuilder &Builder) const {
   MI.eraseFromParent();
 }
 
+// Returns the binary mode version of a decimal mode pseudo, or zero if the
+// instruction isn't one.
+static unsigned getBinaryAddSubOpcode(unsigned Opcode) {
+  switch (Opcode) {
+  default:
+    return 0;
+  case MOS::ADCDecImm:
+    return MOS::ADCImm;
+  case MOS::ADCDecImag8:
+    return MOS::ADCImag8;
+  case MOS::SBCDecImm:
+    return MOS::SBCImm;
+  case MOS::SBCDecImag8:
+    return MOS::SBCImag8;
+  }
+}
+
+// Returns whether an instruction behaves identically in binary and decimal
+// mode, and can thus be placed inside a decimal mode region. This is
+// conservative; only loads, stores, and transfers are considered.
+static bool isDecimalTransparent(const MachineInstr &MI) {
+  if (MI.isDebugInstr() || MI.isKill())
+    return true;
+  switch (MI.getOpcode()) {
+  default:
+    return false;
+  case MOS::COPY:
+    return MOS::Anyi8RegClass.contains(MI.getOperand(0).getReg()) &&
+           MOS::Anyi8RegClass.contains(MI.getOperand(1).getReg());
+  case MOS::LDAbs:
+  case MOS::LDAIdx:
+  case MOS::LDAIdxPatch:
+  case MOS::LDCImm:
+  case MOS::LDIdx:
+  case MOS::LDImag8:
+  case MOS::LDImm:
+  case MOS::LDXIdx:
+  case MOS::LDYIdx:
+  case MOS::LDYIndir:
+  case MOS::STAbs:
+  case MOS::STIdx:
+  case MOS::STIdxPatch:
+  case MOS::STImag8:
+  case MOS::STYIndir:
+  case MOS::TA:
+  case MOS::T_A:
+    return true;
+  }
+}
+
+void MOSInstrInfo::expandDecimal(MachineIRBuilder &Builder) const {
+  MachineInstr &MI = *Builder.getInsertPt();
+  MachineBasicBlock &MBB = Builder.getMBB();
+  const MachineFunction &MF = Builder.getMF();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+
+  // Find the run of decimal operations that can share this one's SED/CLD pair.
+  // A multi-byte BCD operation usually forms a single run, since only loads
+  // and stores of its bytes separate the individual ADCs or SBCs.
+  MachineBasicBlock::iterator Last = MI;
+  for (auto I = std::next(MI.getIterator()), E = MBB.end(); I != E; ++I) {
+    if (getBinaryAddSubOpcode(I->getOpcode()))
+      Last = I;
+    else if (!isDecimalTransparent(*I))
+      break;
+  }
+
+  // NMOS processors don't clear the decimal flag on interrupt, so a handler
+  // that doesn't clear it itself would do its arithmetic in decimal mode.
+  // Interrupts are masked for the duration of the region unless they already
+  // are (in an ISR). PLP restores the previous interrupt mask and clears the
+  // decimal flag, but it also restores the carry, so PLPKeepC is used instead
+  // if the final carry is live.
+  bool MaskInterrupts = MaskDecimalInterrupts && !STI.has65C02() &&
+                        !STI.getFrameLowering()->isISR(MF);
+
+  if (MaskInterrupts) {
+    Builder.buildInstr(MOS::PHP_Implied);
+    Builder.buildInstr(MOS::SEI_Implied);
+  }
+  Builder.buildInstr(MOS::SED_Implied);
+
+  for (auto I = MI.getIterator(), E = std::next(Last); I != E; ++I)
+    if (unsigned Opcode = getBinaryAddSubOpcode(I->getOpcode()))
+      I->setDesc(get(Opcode));
+
+  Builder.setInsertPt(MBB, std::next(Last));
+  if (!MaskInterrupts)
+    Builder.buildInstr(MOS::CLD_Implied);
+  else if (Last->getOperand(1).isDead())
+    Builder.buildInstr(MOS::PLP_Implied);
+  else
+    Builder.buildInstr(MOS::PLPKeepC, {MOS::C}, {MOS::C});
+}
+
 bool MOSInstrInfo::reverseBranchCondition(
     SmallVectorImpl<MachineOperand> &Cond) const {
   assert(Cond.size() == 2);
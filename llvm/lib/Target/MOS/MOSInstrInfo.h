@@ -112,6 +112,7 @@ private:
   void expandLDIdx(MachineIRBuilder &Builder) const;
   void expandLDImm1(MachineIRBuilder &Builder) const;
   void expandSetSP(MachineIRBuilder &Builder) const;
+  void expandDecimal(MachineIRBuilder &Builder) const;
 };
 
 namespace MOS {
@@ -182,6 +182,8 @@ bool MOSInstructionSelector::select(MachineInstr &MI) {
   case MOS::G_SADDE:
   case MOS::G_USBCE:
   case MOS::G_SSBCE:
+  case MOS::G_BCD_ADDE:
+  case MOS::G_BCD_SBCE:
     return selectAddSbcE(MI);
   case MOS::G_UNMERGE_VALUES:
     return selectUnMergeValues(MI);
@@ -385,6 +387,16 @@ bool MOSInstructionSelector::selectConstant(MachineInstr &MI) {
   uint64_t Imm = MI.getOperand(1).getCImm()->getZExtValue();
 
   LLT DstTy = Builder.getMRI()->getType(Dst);
+
+  // Zero page pointer constants are loaded like any other byte.
+  if (DstTy.getSizeInBits() == 8) {
+    auto Ld = Builder.buildInstr(MOS::LDImm, {Dst}, {}).addImm(Imm);
+    if (!constrainSelectedInstRegOperands(*Ld, TII, TRI, RBI))
+      return false;
+    MI.eraseFromParent();
+    return true;
+  }
+
   assert(DstTy.getSizeInBits() == 16);
 
   MachineInstrSpan MIS(MI, MI.getParent());
@@ -408,6 +420,15 @@ bool MOSInstructionSelector::selectIndex(MachineInstr &MI) {
 
   MachineInstrSpan MIS(MI, MI.getParent());
 
+  // Zero page addresses wrap around within the zero page, so indexing them is
+  // just an 8-bit addition.
+  if (Builder.getMRI()->getType(Dst).getSizeInBits() == 8) {
+    auto Sum = Builder.buildAdd(S8, Builder.buildPtrToInt(S8, Base), Offset);
+    Builder.buildIntToPtr(Dst, Sum);
+    MI.eraseFromParent();
+    return selectAll(MIS);
+  }
+
   auto Unmerge = Builder.buildUnmerge(S8, Base);
   Register BaseLo = Unmerge.getReg(0), BaseHi = Unmerge.getReg(1);
 
@@ -473,6 +494,17 @@ bool MOSInstructionSelector::selectGlobalValue(MachineInstr &MI) {
 
   MachineIRBuilder Builder(MI);
   LLT S8 = LLT::scalar(8);
+
+  // The address of a zero page global is its low byte.
+  if (Builder.getMRI()->getType(Dst).getSizeInBits() == 8) {
+    auto Imm = Builder.buildInstr(MOS::LDImm, {Dst}, {}).add(MI.getOperand(1));
+    Imm->getOperand(1).setTargetFlags(MOS::MO_LO);
+    if (!constrainSelectedInstRegOperands(*Imm, TII, TRI, RBI))
+      return false;
+    MI.eraseFromParent();
+    return true;
+  }
+
   auto LoImm = Builder.buildInstr(MOS::LDImm, {S8}, {}).add(MI.getOperand(1));
   LoImm->getOperand(1).setTargetFlags(MOS::MO_LO);
   if (!constrainSelectedInstRegOperands(*LoImm, TII, TRI, RBI))
@@ -590,6 +622,32 @@ bool MOSInstructionSelector::selectLoadStore(MachineInstr &MI) {
     return true;
   }
 
+  // Zero page pointers are themselves valid indices from address zero. Since
+  // zero page indexing never crosses a page, this is safe for volatile
+  // accesses too.
+  if (MRI.getType(Addr).getSizeInBits() == 8) {
+    if (matchIndexed(Addr, Base, Offset, MRI)) {
+      // The offset of a zero page G_INDEX may be negative, relying on the sum
+      // wrapping around within the zero page. Only the zp,X forms of LDA and
+      // STA do so; there is no zp,Y form, and abs,Y carries into page one.
+      // Index by X, which has a wrapping zero page form for every data
+      // register.
+      Register Idx = MRI.createVirtualRegister(&MOS::XcRegClass);
+      Builder.buildCopy(Idx, Offset.getReg());
+      Offset.setReg(Idx);
+    } else
+      Offset.ChangeToRegister(Addr, /*isDef=*/false);
+    auto Instr = Builder.buildInstr(IdxOpcode)
+                     .add(SrcDstOp)
+                     .add(Base)
+                     .add(Offset)
+                     .cloneMemRefs(MI);
+    if (!constrainSelectedInstRegOperands(*Instr, TII, TRI, RBI))
+      return false;
+    MI.eraseFromParent();
+    return true;
+  }
+
   if (MMO.isVolatile()) {
     // Always perform volatile accesses with zero index to prevent 6502 page
     // crossing bugs from generating spurious reads to I/O registers.
@@ -712,6 +770,14 @@ bool MOSInstructionSelector::selectAddSbcE(MachineInstr &MI) {
     ImmOpcode = MOS::SBCImm;
     Imag8Opcode = MOS::SBCImag8;
     break;
+  case MOS::G_BCD_ADDE:
+    ImmOpcode = MOS::ADCDecImm;
+    Imag8Opcode = MOS::ADCDecImag8;
+    break;
+  case MOS::G_BCD_SBCE:
+    ImmOpcode = MOS::SBCDecImm;
+    Imag8Opcode = MOS::SBCDecImag8;
+    break;
   }
 
   bool Signed;
@@ -720,6 +786,8 @@ bool MOSInstructionSelector::selectAddSbcE(MachineInstr &MI) {
     llvm_unreachable("Unexpected opcode.");
   case MOS::G_UADDE:
   case MOS::G_USBCE:
+  case MOS::G_BCD_ADDE:
+  case MOS::G_BCD_SBCE:
     Signed = false;
     break;
   case MOS::G_SADDE:
@@ -0,0 +1,180 @@
+//===-- MOSInternalCC.cpp - MOS Internal Calling Convention Pass ----------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS internal calling convention pass.
+//
+// The C calling convention must pass arguments the same way regardless of how
+// the callee uses them. Local functions whose every use is a direct call are
+// free of this constraint, since the caller and callee are always compiled
+// together. This pass gives such functions the fastcc calling convention
+// (CC_MOS_Internal), and marks each argument inreg if it should be passed in
+// the register it's used from: X or Y for bytes used as indices, and the
+// imaginary pointer registers for pointers that are dereferenced. Other
+// arguments are passed as bytes, as in the C calling convention.
+//
+// The inreg markings are placed on both the function and its call sites, so
+// both sides of each call agree on the locations.
+//===----------------------------------------------------------------------===//
+
+#include "MOSInternalCC.h"
+
+#include "MOS.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-internal-cc"
+
+using namespace llvm;
+
+namespace {
+
+struct MOSInternalCC : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSInternalCC() : ModulePass(ID) {
+    initializeMOSInternalCCPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+static bool canChangeCC(const Function &F) {
+  if (F.isDeclaration() || !F.hasLocalLinkage() || F.isVarArg() ||
+      F.hasFnAttribute("interrupt") || F.hasFnAttribute("interrupt-norecurse"))
+    return false;
+  for (const Use &U : F.uses()) {
+    const auto *Call = dyn_cast<CallBase>(U.getUser());
+    if (!Call || !Call->isCallee(&U) || Call->isMustTailCall() ||
+        Call->getCallingConv() != F.getCallingConv())
+      return false;
+  }
+  return true;
+}
+
+// Returns whether V, a pointer, is used as the address of a memory access,
+// possibly after offsetting.
+static bool isDereferenced(const Value &V) {
+  SmallVector<const Value *> Worklist = {&V};
+  SmallPtrSet<const Value *, 8> Visited;
+  while (!Worklist.empty()) {
+    const Value *P = Worklist.pop_back_val();
+    if (!Visited.insert(P).second)
+      continue;
+    for (const User *U : P->users()) {
+      if (const auto *LI = dyn_cast<LoadInst>(U)) {
+        if (LI->getPointerOperand() == P)
+          return true;
+      } else if (const auto *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getPointerOperand() == P)
+          return true;
+      } else if (const auto *GEP = dyn_cast<GEPOperator>(U)) {
+        if (GEP->getPointerOperand() == P)
+          Worklist.push_back(GEP);
+      } else if (isa<BitCastOperator>(U) || isa<PHINode>(U) ||
+                 isa<SelectInst>(U)) {
+        Worklist.push_back(U);
+      }
+    }
+  }
+  return false;
+}
+
+// Returns whether V, a byte, is used as an index into an array.
+static bool isIndex(const Value &V) {
+  for (const User *U : V.users()) {
+    if (isa<ZExtInst>(U) || isa<SExtInst>(U)) {
+      if (isIndex(*U))
+        return true;
+      continue;
+    }
+    const auto *GEP = dyn_cast<GEPOperator>(U);
+    if (GEP && GEP->getPointerOperand() != &V)
+      return true;
+  }
+  return false;
+}
+
+static bool shouldPassInReg(const Argument &Arg) {
+  Type *Ty = Arg.getType();
+  if (Ty->isPointerTy())
+    return Ty->getPointerAddressSpace() == 0 && isDereferenced(Arg);
+  if (Ty->isIntegerTy(8))
+    return isIndex(Arg);
+  return false;
+}
+
+bool MOSInternalCC::runOnModule(Module &M) {
+  LLVM_DEBUG(dbgs() << "**** MOS Internal CC Pass ****\n");
+
+  if (MOS::wholeProgramPassesRan(M))
+    return false;
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (!canChangeCC(F))
+      continue;
+
+    SmallVector<CallBase *> Calls;
+    for (User *U : F.users())
+      Calls.push_back(cast<CallBase>(U));
+
+    LLVM_DEBUG(dbgs() << "Using internal calling convention for "
+                      << F.getName() << ".\n");
+    F.setCallingConv(CallingConv::Fast);
+    for (CallBase *Call : Calls)
+      Call->setCallingConv(CallingConv::Fast);
+
+    for (Argument &Arg : F.args()) {
+      unsigned ArgNo = Arg.getArgNo();
+      bool InReg = shouldPassInReg(Arg);
+      if (InReg) {
+        LLVM_DEBUG(dbgs() << "\tPassing " << Arg << " in a register.\n");
+        F.addParamAttr(ArgNo, Attribute::InReg);
+      } else {
+        F.removeParamAttr(ArgNo, Attribute::InReg);
+      }
+      for (CallBase *Call : Calls) {
+        if (InReg)
+          Call->addParamAttr(ArgNo, Attribute::InReg);
+        else
+          Call->removeParamAttr(ArgNo, Attribute::InReg);
+      }
+    }
+
+    // Returned pointers are kept in an imaginary pointer register.
+    bool RetInReg = F.getReturnType()->isPointerTy() &&
+                    F.getReturnType()->getPointerAddressSpace() == 0;
+    if (RetInReg)
+      F.addAttribute(AttributeList::ReturnIndex, Attribute::InReg);
+    else
+      F.removeAttribute(AttributeList::ReturnIndex, Attribute::InReg);
+    for (CallBase *Call : Calls) {
+      if (RetInReg)
+        Call->addAttribute(AttributeList::ReturnIndex, Attribute::InReg);
+      else
+        Call->removeAttribute(AttributeList::ReturnIndex, Attribute::InReg);
+    }
+    Changed = true;
+  }
+  return Changed;
+}
+
+char MOSInternalCC::ID = 0;
+
+INITIALIZE_PASS(MOSInternalCC, DEBUG_TYPE,
+                "Assign a custom calling convention to local functions", false,
+                false)
+
+ModulePass *llvm::createMOSInternalCCPass() { return new MOSInternalCC(); }
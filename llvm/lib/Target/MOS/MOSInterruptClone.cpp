@@ -0,0 +1,195 @@
+//===-- MOSInterruptClone.cpp - MOS Interrupt Cloning Pass ----------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS interrupt cloning pass.
+//
+// MOSNoRecurse removes norecurse from any function reachable from more than
+// one context (main and each interrupt-norecurse handler), since an interrupt
+// may arrive while main is inside the function. Such functions lose their
+// static stack frames in every context.
+//
+// This pass gives each interrupt-norecurse handler its own copies of the small
+// functions it shares with other contexts, and redirects the direct calls made
+// within that handler's context to the copies. Each function is left to the
+// first context that reaches it (main, then the handlers in module order), so
+// no original goes unused. Each copy is then reachable from only one context
+// and can keep a static frame.
+//
+// Reentrant ("interrupt") handlers get no copies, since functions they reach
+// may be active more than once regardless. The pass only runs on modules
+// marked as the whole program, as during LTO code generation; otherwise,
+// code outside the module could also call the originals from any context.
+//===----------------------------------------------------------------------===//
+
+#include "MOSInterruptClone.h"
+
+#include "MOS.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#define DEBUG_TYPE "mos-interrupt-clone"
+
+using namespace llvm;
+
+static cl::opt<unsigned> CloneBudget(
+    "mos-interrupt-clone-budget", cl::init(256),
+    cl::desc("Maximum number of IR instructions cloned for each "
+             "interrupt-norecurse handler"),
+    cl::Hidden);
+
+static cl::opt<unsigned>
+    CloneMaxSize("mos-interrupt-clone-max-size", cl::init(64),
+                 cl::desc("Maximum size in IR instructions of a function "
+                          "cloned for an interrupt-norecurse handler"),
+                 cl::Hidden);
+
+namespace {
+
+struct MOSInterruptClone : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSInterruptClone() : ModulePass(ID) {
+    initializeMOSInterruptClonePass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+// Collects the functions reachable from Root through direct calls, including
+// Root itself.
+static void collectReachable(Function &Root,
+                             SmallPtrSetImpl<Function *> &Reachable) {
+  SmallVector<Function *> Worklist = {&Root};
+  Reachable.insert(&Root);
+  while (!Worklist.empty()) {
+    Function *F = Worklist.pop_back_val();
+    for (Instruction &I : instructions(*F)) {
+      auto *Call = dyn_cast<CallBase>(&I);
+      if (!Call)
+        continue;
+      Function *Callee = Call->getCalledFunction();
+      if (Callee && !Callee->isDeclaration() && Reachable.insert(Callee).second)
+        Worklist.push_back(Callee);
+    }
+  }
+}
+
+static bool isCloneable(const Function &F) {
+  return F.hasExactDefinition() && !F.hasFnAttribute("interrupt") &&
+         !F.hasFnAttribute("interrupt-norecurse") && F.getName() != "main" &&
+         F.getInstructionCount() <= CloneMaxSize;
+}
+
+// Redirects F's direct calls to functions with clones to the clones.
+static void redirectCalls(Function &F,
+                          const DenseMap<Function *, Function *> &Clones) {
+  for (Instruction &I : instructions(F)) {
+    auto *Call = dyn_cast<CallBase>(&I);
+    if (!Call)
+      continue;
+    auto It = Clones.find(Call->getCalledFunction());
+    if (It != Clones.end())
+      Call->setCalledFunction(It->second);
+  }
+}
+
+bool MOSInterruptClone::runOnModule(Module &M) {
+  LLVM_DEBUG(dbgs() << "**** MOS Interrupt Clone Pass ****\n");
+
+  if (!MOS::isWholeProgram(M) || MOS::wholeProgramPassesRan(M))
+    return false;
+
+  Function *Main = M.getFunction("main");
+  if (!Main || Main->isDeclaration())
+    return false;
+
+  SmallVector<Function *> Contexts = {Main};
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasFnAttribute("interrupt-norecurse"))
+      Contexts.push_back(&F);
+  if (Contexts.size() < 2)
+    return false;
+
+  // Find what each context reaches, and which context each function is left
+  // to.
+  SmallVector<SmallPtrSet<Function *, 16>> Reachable(Contexts.size());
+  DenseMap<Function *, unsigned> Owner;
+  DenseMap<Function *, unsigned> NumContexts;
+  for (unsigned I = 0, E = Contexts.size(); I != E; ++I) {
+    collectReachable(*Contexts[I], Reachable[I]);
+    for (Function *F : Reachable[I]) {
+      Owner.try_emplace(F, I);
+      ++NumContexts[F];
+    }
+  }
+
+  bool Changed = false;
+  for (unsigned I = 1, E = Contexts.size(); I != E; ++I) {
+    Function &Ctx = *Contexts[I];
+
+    // Clone the smallest shared functions first, to free as many functions as
+    // possible within the budget.
+    SmallVector<Function *> Shared;
+    for (Function &F : M)
+      if (Reachable[I].contains(&F) && Owner[&F] != I && isCloneable(F))
+        Shared.push_back(&F);
+    llvm::stable_sort(Shared, [](Function *A, Function *B) {
+      return A->getInstructionCount() < B->getInstructionCount();
+    });
+
+    DenseMap<Function *, Function *> Clones;
+    unsigned Budget = CloneBudget;
+    for (Function *F : Shared) {
+      unsigned Size = F->getInstructionCount();
+      if (Size > Budget)
+        break;
+      Budget -= Size;
+
+      ValueToValueMapTy VMap;
+      Function *Clone = CloneFunction(F, VMap);
+      Clone->setName(F->getName() + "." + Ctx.getName());
+      Clone->setLinkage(GlobalValue::InternalLinkage);
+      Clone->setVisibility(GlobalValue::DefaultVisibility);
+      Clone->setComdat(nullptr);
+      Clones[F] = Clone;
+      LLVM_DEBUG(dbgs() << "Cloned " << F->getName() << " for "
+                        << Ctx.getName() << ".\n");
+    }
+    if (Clones.empty())
+      continue;
+    Changed = true;
+
+    // Calls made only in this context now go to the clones, as do the calls
+    // between clones.
+    for (Function *F : Reachable[I])
+      if (F == &Ctx || NumContexts[F] == 1)
+        redirectCalls(*F, Clones);
+    for (const auto &Clone : Clones)
+      redirectCalls(*Clone.second, Clones);
+  }
+  return Changed;
+}
+
+char MOSInterruptClone::ID = 0;
+
+INITIALIZE_PASS(MOSInterruptClone, DEBUG_TYPE,
+                "Clone functions shared between interrupt contexts", false,
+                false)
+
+ModulePass *llvm::createMOSInterruptClonePass() {
+  return new MOSInterruptClone();
+}
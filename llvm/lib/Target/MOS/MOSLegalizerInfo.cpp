@@ -18,8 +18,10 @@
 #include "MOSLegalizerInfo.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
+#include "MOSSubtarget.h"
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/GlobalISel/LegalizerHelper.h"
@@ -36,6 +38,7 @@
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/IntrinsicsMOS.h"
 #include "llvm/Support/ErrorHandling.h"
 
 using namespace llvm;
@@ -51,26 +54,26 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
   LLT S16 = LLT::scalar(16);
   LLT S64 = LLT::scalar(64);
   LLT P = LLT::pointer(0, 16);
+  LLT ZP = LLT::pointer(MOS::AS_ZeroPage, 8);
 
   // Constants
 
   // 16-bit constants are legal; they can sometimes be folded into absolute and
   // indirect addressing modes.
   getActionDefinitionsBuilder(G_CONSTANT)
-      .legalFor({S1, S8, S16, P})
+      .legalFor({S1, S8, S16, P, ZP})
       .widenScalarToNextPow2(0)
       .clampScalar(0, S8, S8)
       .unsupported();
 
   getActionDefinitionsBuilder({G_IMPLICIT_DEF, G_FREEZE})
-      .legalFor({S1, S8, P})
+      .legalFor({S1, S8, P, ZP})
       .widenScalarToNextPow2(0)
       .clampScalar(0, S8, S8)
       .unsupported();
 
-  getActionDefinitionsBuilder({G_FRAME_INDEX, G_GLOBAL_VALUE})
-      .legalFor({P})
-      .unsupported();
+  getActionDefinitionsBuilder(G_FRAME_INDEX).legalFor({P}).unsupported();
+  getActionDefinitionsBuilder(G_GLOBAL_VALUE).legalFor({P, ZP}).unsupported();
 
   // Integer Extension and Truncation
 
@@ -93,16 +96,23 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
   // Type Conversions
 
   getActionDefinitionsBuilder(G_INTTOPTR)
-      .legalFor({{P, S16}})
+      .legalFor({{P, S16}, {ZP, S8}})
+      .customIf(typeIs(0, ZP))
       .widenScalarToNextPow2(1)
       .clampScalar(1, S16, S16)
       .unsupported();
   getActionDefinitionsBuilder(G_PTRTOINT)
-      .legalFor({{S16, P}})
+      .legalFor({{S16, P}, {S8, ZP}})
+      .customIf(typeIs(1, ZP))
       .widenScalarToNextPow2(0)
       .clampScalar(0, S16, S16)
       .unsupported();
 
+  // Zero page addresses are zero-extended to form 16-bit addresses.
+  getActionDefinitionsBuilder(G_ADDRSPACE_CAST)
+      .customFor({{P, ZP}, {ZP, P}})
+      .unsupported();
+
   // Scalar Operations
 
   getActionDefinitionsBuilder({G_EXTRACT, G_INSERT}).lower();
@@ -147,6 +157,13 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
       {G_SADDSAT, G_UADDSAT, G_SSUBSAT, G_USUBSAT, G_SSHLSAT, G_USHLSAT})
       .lower();
 
+  // Fixed-point operations are expanded inline at twice their width.
+  getActionDefinitionsBuilder({G_SMULFIX, G_UMULFIX, G_SMULFIXSAT,
+                               G_UMULFIXSAT, G_SDIVFIX, G_UDIVFIX,
+                               G_SDIVFIXSAT, G_UDIVFIXSAT})
+      .customFor({S8, S16, LLT::scalar(32)})
+      .unsupported();
+
   getActionDefinitionsBuilder({G_LSHR, G_SHL})
       .widenScalarToNextPow2(0)
       .clampScalar(0, S8, S64)
@@ -163,7 +180,7 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
   getActionDefinitionsBuilder(G_ROTR).customFor({S8}).lower();
 
   getActionDefinitionsBuilder(G_ICMP)
-      .customFor({{S1, P}, {S1, S8}})
+      .customFor({{S1, P}, {S1, ZP}, {S1, S8}})
       .minScalar(1, S8)
       .widenScalarIf(
           [](const LegalityQuery &Query) {
@@ -177,13 +194,15 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
       .custom();
 
   getActionDefinitionsBuilder(G_SELECT)
-      .customFor({P})
+      .customFor({P, ZP})
       .legalFor({S1, S8})
       .widenScalarToNextPow2(0)
       .clampScalar(0, S8, S8)
       .unsupported();
 
-  getActionDefinitionsBuilder(G_PTR_ADD).customFor({{P, S16}}).unsupported();
+  getActionDefinitionsBuilder(G_PTR_ADD)
+      .customFor({{P, S16}, {ZP, S8}})
+      .unsupported();
 
   getActionDefinitionsBuilder({G_SMIN, G_SMAX, G_UMIN, G_UMAX}).lower();
 
@@ -237,10 +256,10 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
   // Memory Operations
 
   getActionDefinitionsBuilder({G_LOAD, G_STORE})
-      .legalFor({{S8, P}})
+      .legalFor({{S8, P}, {S8, ZP}})
       // Convert to int to load/store; that way the operation can be narrowed to
       // 8 bits.
-      .customFor({{P, P}})
+      .customFor({{P, P}, {P, ZP}, {ZP, P}, {ZP, ZP}})
       .clampScalar(0, S8, S8)
       .unsupported();
 
@@ -248,10 +267,29 @@ MOSLegalizerInfo::MOSLegalizerInfo() {
 
   getActionDefinitionsBuilder({G_MEMCPY, G_MEMMOVE, G_MEMSET}).libcall();
 
+  // Atomic Operations
+
+  getActionDefinitionsBuilder(G_FENCE).custom();
+
+  getActionDefinitionsBuilder(
+      {G_ATOMICRMW_XCHG, G_ATOMICRMW_ADD, G_ATOMICRMW_SUB, G_ATOMICRMW_AND,
+       G_ATOMICRMW_NAND, G_ATOMICRMW_OR, G_ATOMICRMW_XOR, G_ATOMICRMW_MAX,
+       G_ATOMICRMW_MIN, G_ATOMICRMW_UMAX, G_ATOMICRMW_UMIN,
+       G_ATOMIC_CMPXCHG})
+      .customFor({{S8, P}, {S8, ZP}})
+      .unsupported();
+
+  getActionDefinitionsBuilder(G_ATOMIC_CMPXCHG_WITH_SUCCESS)
+      .customIf(all(typeIs(0, S8), typeIs(1, S1), typeInSet(2, {P, ZP})))
+      .unsupported();
+
+  getActionDefinitionsBuilder({G_ATOMICRMW_FADD, G_ATOMICRMW_FSUB})
+      .unsupported();
+
   // Control Flow
 
   getActionDefinitionsBuilder(G_PHI)
-      .customFor({P})
+      .customFor({P, ZP})
       .legalFor({S1, S8})
       .widenScalarToNextPow2(0)
       .clampScalar(0, S8, S8)
@@ -287,6 +325,13 @@ bool MOSLegalizerInfo::legalizeIntrinsic(LegalizerHelper &Helper,
     MI.eraseFromParent();
     return true;
   }
+  case Intrinsic::mos_bcd_add8:
+  case Intrinsic::mos_bcd_add16:
+  case Intrinsic::mos_bcd_add32:
+  case Intrinsic::mos_bcd_sub8:
+  case Intrinsic::mos_bcd_sub16:
+  case Intrinsic::mos_bcd_sub32:
+    return legalizeBCDAddSub(Helper, MI.getMF()->getRegInfo(), MI);
   }
   return false;
 }
@@ -304,6 +349,14 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper,
   case G_ZEXT:
     return legalizeZExt(Helper, MRI, MI);
 
+  // Type Conversions
+  case G_ADDRSPACE_CAST:
+    return legalizeAddrSpaceCast(Helper, MRI, MI);
+  case G_INTTOPTR:
+    return legalizeIntToPtr(Helper, MRI, MI);
+  case G_PTRTOINT:
+    return legalizePtrToInt(Helper, MRI, MI);
+
   // Scalar Operations
   case G_BSWAP:
     return legalizeBSwap(Helper, MRI, MI);
@@ -334,6 +387,16 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper,
   case G_USUBE:
   case G_SSUBE:
     return legalizeSubE(Helper, MRI, MI);
+  case G_SMULFIX:
+  case G_UMULFIX:
+  case G_SMULFIXSAT:
+  case G_UMULFIXSAT:
+    return legalizeMulFix(Helper, MRI, MI);
+  case G_SDIVFIX:
+  case G_UDIVFIX:
+  case G_SDIVFIXSAT:
+  case G_UDIVFIXSAT:
+    return legalizeDivFix(Helper, MRI, MI);
 
   // Memory Operations
   case G_LOAD:
@@ -341,6 +404,25 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper,
   case G_STORE:
     return legalizeStore(Helper, MRI, MI);
 
+  // Atomic Operations
+  case G_FENCE:
+    return legalizeFence(Helper, MRI, MI);
+  case G_ATOMICRMW_XCHG:
+  case G_ATOMICRMW_ADD:
+  case G_ATOMICRMW_SUB:
+  case G_ATOMICRMW_AND:
+  case G_ATOMICRMW_NAND:
+  case G_ATOMICRMW_OR:
+  case G_ATOMICRMW_XOR:
+  case G_ATOMICRMW_MAX:
+  case G_ATOMICRMW_MIN:
+  case G_ATOMICRMW_UMAX:
+  case G_ATOMICRMW_UMIN:
+    return legalizeAtomicRMW(Helper, MRI, MI);
+  case G_ATOMIC_CMPXCHG:
+  case G_ATOMIC_CMPXCHG_WITH_SUCCESS:
+    return legalizeAtomicCmpXchg(Helper, MRI, MI);
+
   // Control Flow
   case G_PHI:
     return legalizePhi(Helper, MRI, MI);
@@ -381,18 +463,6 @@ bool MOSLegalizerInfo::legalizeSExt(LegalizerHelper &Helper,
     auto Zero = Builder.buildConstant(DstTy, 0);
     Builder.buildSelect(Dst, Src, NegOne, Zero);
   } else {
-    // Note: We can't use ICMP_SLT 0 here, since that may in turn require SEXT.
-    // FIXME: Once the ICMP_SLT lowering is better, use that instead.
-    auto SignMask = APInt::getSignMask(SrcTy.getSizeInBits());
-    auto Sign =
-        Builder.buildAnd(SrcTy, Src, Builder.buildConstant(SrcTy, SignMask));
-    auto Pos = Builder.buildICmp(CmpInst::ICMP_EQ, S1, Sign,
-                                 Builder.buildConstant(SrcTy, 0));
-    auto NegOne = Builder.buildConstant(S8, -1);
-    auto Zero = Builder.buildConstant(S8, 0);
-
-    Register Fill = Builder.buildSelect(S8, Pos, Zero, NegOne).getReg(0);
-
     SmallVector<Register> Parts;
     unsigned Bits;
     if (SrcTy == S8) {
@@ -407,6 +477,15 @@ bool MOSLegalizerInfo::legalizeSExt(LegalizerHelper &Helper,
         Bits += 8;
       }
     }
+
+    // Only the sign bit of the high byte matters, so the comparison against
+    // zero can be made directly on it.
+    auto Neg = Builder.buildICmp(CmpInst::ICMP_SLT, S1, Parts.back(),
+                                 Builder.buildConstant(S8, 0));
+    auto NegOne = Builder.buildConstant(S8, -1);
+    auto Zero = Builder.buildConstant(S8, 0);
+    Register Fill = Builder.buildSelect(S8, Neg, NegOne, Zero).getReg(0);
+
     while (Bits < DstTy.getSizeInBits()) {
       Parts.push_back(Fill);
       Bits += 8;
@@ -436,6 +515,62 @@ bool MOSLegalizerInfo::legalizeZExt(LegalizerHelper &Helper,
   return true;
 }
 
+//===----------------------------------------------------------------------===//
+// Type Conversions
+//===----------------------------------------------------------------------===//
+
+bool MOSLegalizerInfo::legalizeAddrSpaceCast(LegalizerHelper &Helper,
+                                             MachineRegisterInfo &MRI,
+                                             MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  Register Dst = MI.getOperand(0).getReg();
+  Register Src = MI.getOperand(1).getReg();
+  LLT DstIntTy = LLT::scalar(MRI.getType(Dst).getSizeInBits());
+  LLT SrcIntTy = LLT::scalar(MRI.getType(Src).getSizeInBits());
+
+  // The zero page lies at the bottom of the 16-bit address space, so a zero
+  // page address converts to a general one by zero extension, and back by
+  // truncation.
+  auto SrcInt = Builder.buildPtrToInt(SrcIntTy, Src);
+  auto DstInt = DstIntTy.getSizeInBits() > SrcIntTy.getSizeInBits()
+                    ? Builder.buildZExt(DstIntTy, SrcInt)
+                    : Builder.buildTrunc(DstIntTy, SrcInt);
+  Builder.buildIntToPtr(Dst, DstInt);
+  MI.eraseFromParent();
+  return true;
+}
+
+// Zero page pointers are only legal to convert to and from 8-bit integers.
+// Other integer widths convert by truncation and zero extension, as with
+// address space casts.
+bool MOSLegalizerInfo::legalizeIntToPtr(LegalizerHelper &Helper,
+                                        MachineRegisterInfo &MRI,
+                                        MachineInstr &MI) const {
+  LLT S8 = LLT::scalar(8);
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  Register Dst = MI.getOperand(0).getReg();
+  Register Src = MI.getOperand(1).getReg();
+  assert(MRI.getType(Src) != S8);
+
+  Builder.buildIntToPtr(Dst, Builder.buildZExtOrTrunc(S8, Src));
+  MI.eraseFromParent();
+  return true;
+}
+
+bool MOSLegalizerInfo::legalizePtrToInt(LegalizerHelper &Helper,
+                                        MachineRegisterInfo &MRI,
+                                        MachineInstr &MI) const {
+  LLT S8 = LLT::scalar(8);
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  Register Dst = MI.getOperand(0).getReg();
+  Register Src = MI.getOperand(1).getReg();
+  assert(MRI.getType(Dst) != S8);
+
+  Builder.buildZExtOrTrunc(Dst, Builder.buildPtrToInt(S8, Src));
+  MI.eraseFromParent();
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // Scalar Operations
 //===----------------------------------------------------------------------===//
@@ -658,24 +793,105 @@ static void swapComparison(LegalizerHelper &Helper, MachineInstr &MI) {
   Helper.Observer.changedInstr(MI);
 }
 
-static std::pair<Register, Register> splitHighRest(Register Reg,
-                                                   MachineIRBuilder &Builder) {
-  LLT S8 = LLT::scalar(8);
+// Lowers a multi-byte equality comparison whose only use is a conditional
+// branch to a chain of byte comparisons, each followed by a branch, from the
+// low byte up. The chain leaves for the false destination at the first byte
+// that differs, so later bytes are never compared. Returns false if the
+// comparison doesn't feed a branch in this way.
+static bool lowerEqualityBranch(LegalizerHelper &Helper,
+                                MachineRegisterInfo &MRI, MachineInstr &MI,
+                                ArrayRef<Register> LHSBytes,
+                                ArrayRef<Register> RHSBytes) {
+  Register Dst = MI.getOperand(0).getReg();
+  MachineBasicBlock &MBB = *MI.getParent();
 
-  auto Unmerge = Builder.buildUnmerge(S8, Reg);
-  Register High = Unmerge.getReg(Unmerge->getNumOperands() - 2);
+  // Uses are legalized before definitions, so the branch is already a
+  // G_BRCOND_IMM, possibly on the negation of the comparison.
+  if (!MRI.hasOneNonDBGUse(Dst))
+    return false;
+  MachineInstr *Not = nullptr;
+  MachineInstr *BrCond = &*MRI.use_instr_nodbg_begin(Dst);
+  if (BrCond->getOpcode() == MOS::G_XOR &&
+      mi_match(BrCond->getOperand(0).getReg(), MRI, m_Not(m_Specific(Dst)))) {
+    Not = BrCond;
+    Register NotDst = Not->getOperand(0).getReg();
+    if (!MRI.hasOneNonDBGUse(NotDst))
+      return false;
+    BrCond = &*MRI.use_instr_nodbg_begin(NotDst);
+  }
+  if (BrCond->getOpcode() != MOS::G_BRCOND_IMM || BrCond->getParent() != &MBB)
+    return false;
+
+  MachineBasicBlock *TrueMBB = BrCond->getOperand(1).getMBB();
+  MachineInstr *Br = BrCond->getNextNode();
+  MachineBasicBlock *FalseMBB;
+  if (!Br)
+    FalseMBB = MBB.getNextNode();
+  else if (Br->getOpcode() == MOS::G_BR)
+    FalseMBB = Br->getOperand(0).getMBB();
+  else
+    return false;
+  if (!FalseMBB || TrueMBB == FalseMBB)
+    return false;
+  // The branch is taken when its condition matches the immediate.
+  bool BranchIfEqual = BrCond->getOperand(2).getImm() != (Not != nullptr);
+  if (!BranchIfEqual)
+    std::swap(TrueMBB, FalseMBB);
+
+  Helper.Observer.erasingInstr(*BrCond);
+  BrCond->eraseFromParent();
+  if (Br) {
+    Helper.Observer.erasingInstr(*Br);
+    Br->eraseFromParent();
+  }
+  if (Not) {
+    Helper.Observer.erasingInstr(*Not);
+    Not->eraseFromParent();
+  }
 
-  SmallVector<Register> RestParts;
-  for (unsigned Idx = 0, IdxEnd = Unmerge->getNumOperands() - 2; Idx < IdxEnd;
-       ++Idx)
-    RestParts.push_back(Unmerge.getReg(Idx));
-  Register Rest =
-      (RestParts.size() > 1)
-          ? Builder.buildMerge(LLT::scalar(RestParts.size() * 8), RestParts)
-                .getReg(0)
-          : RestParts[0];
+  // Each byte but the last gets a block of its own after MBB.
+  MachineFunction &MF = *MBB.getParent();
+  SmallVector<MachineBasicBlock *> Blocks = {&MBB};
+  for (unsigned Idx = 1; Idx < LHSBytes.size(); ++Idx) {
+    MachineBasicBlock *Next = MF.CreateMachineBasicBlock(MBB.getBasicBlock());
+    MF.insert(std::next(Blocks.back()->getIterator()), Next);
+    Blocks.push_back(Next);
+  }
+  MachineBasicBlock *Last = Blocks.back();
+  if (Last != &MBB) {
+    MBB.replaceSuccessor(TrueMBB, Blocks[1]);
+    TrueMBB->replacePhiUsesWith(&MBB, Last);
+  }
 
-  return {High, Rest};
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S1 = LLT::scalar(1);
+  for (unsigned Idx = 0; Idx < Blocks.size(); ++Idx) {
+    MachineBasicBlock *Cur = Blocks[Idx];
+    MachineBasicBlock *EqMBB = Cur == Last ? TrueMBB : Blocks[Idx + 1];
+    if (Cur != &MBB) {
+      Cur->addSuccessor(EqMBB);
+      Cur->addSuccessor(FalseMBB);
+      // Values flowing into the false destination are the same from every
+      // block in the chain.
+      for (MachineInstr &Phi : FalseMBB->phis()) {
+        for (unsigned I = 1, E = Phi.getNumOperands(); I != E; I += 2) {
+          if (Phi.getOperand(I + 1).getMBB() != &MBB)
+            continue;
+          Register Val = Phi.getOperand(I).getReg();
+          Phi.addOperand(MachineOperand::CreateReg(Val, /*isDef=*/false));
+          Phi.addOperand(MachineOperand::CreateMBB(Cur));
+          break;
+        }
+      }
+    }
+    Builder.setInsertPt(*Cur, Cur->end());
+    auto Eq = Builder.buildICmp(CmpInst::ICMP_EQ, S1, LHSBytes[Idx],
+                                RHSBytes[Idx]);
+    Builder.buildInstr(MOS::G_BRCOND_IMM, {}, {Eq}).addMBB(EqMBB).addImm(1);
+    Builder.buildBr(*FalseMBB);
+  }
+  MI.eraseFromParent();
+  return true;
 }
 
 bool MOSLegalizerInfo::legalizeICmp(LegalizerHelper &Helper,
@@ -712,11 +928,11 @@ bool MOSLegalizerInfo::legalizeICmp(LegalizerHelper &Helper,
   // Compare pointers by first converting to integer. This allows the comparison
   // to be reduced to 8-bit comparisons.
   if (Type.isPointer()) {
-    LLT S16 = LLT::scalar(16);
+    LLT IntTy = LLT::scalar(Type.getSizeInBits());
 
     Helper.Observer.changingInstr(MI);
-    MI.getOperand(2).setReg(Builder.buildPtrToInt(S16, LHS).getReg(0));
-    MI.getOperand(3).setReg(Builder.buildPtrToInt(S16, RHS).getReg(0));
+    MI.getOperand(2).setReg(Builder.buildPtrToInt(IntTy, LHS).getReg(0));
+    MI.getOperand(3).setReg(Builder.buildPtrToInt(IntTy, RHS).getReg(0));
     Helper.Observer.changedInstr(MI);
     return true;
   }
@@ -725,25 +941,65 @@ bool MOSLegalizerInfo::legalizeICmp(LegalizerHelper &Helper,
   LLT S8 = LLT::scalar(8);
 
   if (Type != S8) {
-    Register LHSHigh, LHSRest;
-    Register RHSHigh, RHSRest;
-    std::tie(LHSHigh, LHSRest) = splitHighRest(LHS, Builder);
-    std::tie(RHSHigh, RHSRest) = splitHighRest(RHS, Builder);
-
-    auto EqHigh = Builder.buildICmp(CmpInst::ICMP_EQ, S1, LHSHigh, RHSHigh);
-    // If EqHigh is false, we defer to CmpHigh, which is equal to EqHigh if
-    // Pred==ICMP_EQ.
-    auto CmpHigh = (Pred == CmpInst::ICMP_EQ)
-                       ? Builder.buildConstant(S1, 0)
-                       : Builder.buildICmp(Pred, S1, LHSHigh, RHSHigh);
-    auto RestPred = Pred;
-    if (CmpInst::isSigned(RestPred))
-      RestPred = CmpInst::getUnsignedPredicate(Pred);
-    auto CmpRest = Builder.buildICmp(RestPred, S1, LHSRest, RHSRest).getReg(0);
-
-    // If the high byte is equal, defer to the unsigned comparison on the rest.
-    // Otherwise, defer to the comparison on the high byte.
-    Builder.buildSelect(Dst, EqHigh, CmpRest, CmpHigh);
+    auto LHSUnmerge = Builder.buildUnmerge(S8, LHS);
+    auto RHSUnmerge = Builder.buildUnmerge(S8, RHS);
+    unsigned NumBytes = LHSUnmerge->getNumOperands() - 1;
+
+    switch (Pred) {
+    default:
+      llvm_unreachable("Unexpected integer comparison type.");
+    case CmpInst::ICMP_EQ: {
+      SmallVector<Register> LHSBytes, RHSBytes;
+      for (unsigned Idx = 0; Idx < NumBytes; ++Idx) {
+        LHSBytes.push_back(LHSUnmerge.getReg(Idx));
+        RHSBytes.push_back(RHSUnmerge.getReg(Idx));
+      }
+      if (lowerEqualityBranch(Helper, MRI, MI, LHSBytes, RHSBytes))
+        return true;
+
+      // Otherwise, compare from the low byte up, combining the byte results
+      // with selects that lower to control flow.
+      Register Eq;
+      for (unsigned Idx = 0; Idx < NumBytes; ++Idx) {
+        auto EqByte = Builder.buildICmp(CmpInst::ICMP_EQ, S1,
+                                        LHSUnmerge.getReg(Idx),
+                                        RHSUnmerge.getReg(Idx));
+        Eq = Idx ? Builder
+                       .buildSelect(S1, EqByte, Eq,
+                                    Builder.buildConstant(S1, 0))
+                       .getReg(0)
+                 : EqByte.getReg(0);
+      }
+      Builder.buildCopy(Dst, Eq);
+      break;
+    }
+    case CmpInst::ICMP_UGE:
+    case CmpInst::ICMP_SLT: {
+      // Signed comparisons against zero depend only on the sign bit.
+      if (Pred == CmpInst::ICMP_SLT && mi_match(RHS, MRI, m_SpecificICst(0))) {
+        Builder.buildICmp(Pred, Dst, LHSUnmerge.getReg(NumBytes - 1),
+                          Builder.buildConstant(S8, 0));
+        break;
+      }
+
+      // Ordered comparisons chain the borrow through a multi-byte subtraction,
+      // as in CMP, SBC, SBC, ... . The final carry gives the unsigned result,
+      // and the final N xor V gives the signed result.
+      Register Carry = Builder.buildConstant(S1, 1).getReg(0);
+      MachineInstrBuilder Sbc;
+      for (unsigned Idx = 0; Idx < NumBytes; ++Idx) {
+        Sbc = Builder.buildInstr(
+            MOS::G_SBC, {S8, S1, S1, S1, S1},
+            {LHSUnmerge.getReg(Idx), RHSUnmerge.getReg(Idx), Carry});
+        Carry = Sbc.getReg(1);
+      }
+      if (Pred == CmpInst::ICMP_UGE)
+        Builder.buildCopy(Dst, Carry);
+      else
+        Builder.buildXor(Dst, Sbc.getReg(2) /*=N*/, Sbc.getReg(3) /*=V*/);
+      break;
+    }
+    }
     MI.eraseFromParent();
     return true;
   }
@@ -794,23 +1050,23 @@ bool MOSLegalizerInfo::legalizeSelect(LegalizerHelper &Helper,
                                       MachineInstr &MI) const {
   MachineIRBuilder &Builder = Helper.MIRBuilder;
 
-  LLT P = LLT::pointer(0, 16);
-  LLT S16 = LLT::scalar(16);
-
   Register Dst = MI.getOperand(0).getReg();
   Register Test = MI.getOperand(1).getReg();
   Register LHS = MI.getOperand(2).getReg();
   Register RHS = MI.getOperand(3).getReg();
 
-  assert(MRI.getType(Dst) == P);
+  LLT P = MRI.getType(Dst);
+  LLT IntTy = LLT::scalar(P.getSizeInBits());
+
+  assert(P.isPointer());
   assert(MRI.getType(Test) == LLT::scalar(1));
   assert(MRI.getType(LHS) == P);
   assert(MRI.getType(RHS) == P);
 
   Helper.Observer.changingInstr(MI);
-  MI.getOperand(2).setReg(Builder.buildPtrToInt(S16, LHS).getReg(0));
-  MI.getOperand(3).setReg(Builder.buildPtrToInt(S16, RHS).getReg(0));
-  Register Tmp = MRI.createGenericVirtualRegister(S16);
+  MI.getOperand(2).setReg(Builder.buildPtrToInt(IntTy, LHS).getReg(0));
+  MI.getOperand(3).setReg(Builder.buildPtrToInt(IntTy, RHS).getReg(0));
+  Register Tmp = MRI.createGenericVirtualRegister(IntTy);
   MI.getOperand(0).setReg(Tmp);
   Helper.Observer.changedInstr(MI);
 
@@ -843,6 +1099,17 @@ bool MOSLegalizerInfo::legalizePtrAdd(LegalizerHelper &Helper,
     return true;
   }
 
+  // Zero page addresses wrap around within the zero page, as do the zero page
+  // indexed addressing modes, so any 8-bit offset can be used as an index.
+  // Instruction selection keeps such indices in X, since only the zp,X forms
+  // exist for every data register.
+  if (MRI.getType(Result.getReg()).getSizeInBits() == 8) {
+    Helper.Observer.changingInstr(MI);
+    MI.setDesc(Builder.getTII().get(MOS::G_INDEX));
+    Helper.Observer.changedInstr(MI);
+    return true;
+  }
+
   // Adds of zero-extended offsets can instead use G_INDEX, with the goal of
   // selecting indexed addressing modes.
   MachineInstr *ZExtOffset = getOpcodeDef(G_ZEXT, Offset.getReg(), MRI);
@@ -935,6 +1202,510 @@ bool MOSLegalizerInfo::legalizeSubE(LegalizerHelper &Helper,
   return true;
 }
 
+// Lower packed BCD addition and subtraction to a chain of bytewise decimal
+// mode operations, from least to most significant.
+bool MOSLegalizerInfo::legalizeBCDAddSub(LegalizerHelper &Helper,
+                                         MachineRegisterInfo &MRI,
+                                         MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+
+  if (!MI.getMF()->getSubtarget<MOSSubtarget>().has6502BCD())
+    report_fatal_error("BCD arithmetic requires decimal mode support.");
+
+  bool IsSub;
+  switch (MI.getIntrinsicID()) {
+  default:
+    llvm_unreachable("Unexpected intrinsic.");
+  case Intrinsic::mos_bcd_add8:
+  case Intrinsic::mos_bcd_add16:
+  case Intrinsic::mos_bcd_add32:
+    IsSub = false;
+    break;
+  case Intrinsic::mos_bcd_sub8:
+  case Intrinsic::mos_bcd_sub16:
+  case Intrinsic::mos_bcd_sub32:
+    IsSub = true;
+    break;
+  }
+
+  Register Dst = MI.getOperand(0).getReg();
+  Register L = MI.getOperand(2).getReg();
+  Register R = MI.getOperand(3).getReg();
+  LLT Ty = MRI.getType(Dst);
+  unsigned NumBytes = Ty.getSizeInBytes();
+
+  SmallVector<Register> LParts, RParts;
+  if (Ty == S8) {
+    LParts.push_back(L);
+    RParts.push_back(R);
+  } else {
+    auto LUnmerge = Builder.buildUnmerge(S8, L);
+    auto RUnmerge = Builder.buildUnmerge(S8, R);
+    for (unsigned I = 0; I < NumBytes; ++I) {
+      LParts.push_back(LUnmerge.getReg(I));
+      RParts.push_back(RUnmerge.getReg(I));
+    }
+  }
+
+  // SBC borrows on a clear carry, so a subtraction starts with carry set.
+  Register Carry = Builder.buildConstant(S1, IsSub).getReg(0);
+  SmallVector<Register> Parts;
+  for (unsigned I = 0; I < NumBytes; ++I) {
+    auto Op = Builder.buildInstr(IsSub ? MOS::G_BCD_SBCE : MOS::G_BCD_ADDE,
+                                 {S8, S1}, {LParts[I], RParts[I], Carry});
+    Parts.push_back(Op.getReg(0));
+    Carry = Op.getReg(1);
+  }
+
+  if (Ty == S8)
+    Builder.buildCopy(Dst, Parts.front());
+  else
+    Builder.buildMerge(Dst, Parts);
+  MI.eraseFromParent();
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Fixed-Point Operations
+//===----------------------------------------------------------------------===//
+
+// Shifts Val left by a constant amount using only whole-byte and single-bit
+// shifts, neither of which requires a libcall.
+static Register buildShlByConstant(MachineIRBuilder &Builder, Register Val,
+                                   unsigned Amt) {
+  LLT Ty = Builder.getMRI()->getType(Val);
+  LLT S8 = LLT::scalar(8);
+  if (Amt >= 8)
+    Val = Builder.buildShl(Ty, Val, Builder.buildConstant(S8, Amt / 8 * 8))
+              .getReg(0);
+  for (unsigned I = 0; I < Amt % 8; ++I)
+    Val = Builder.buildShl(Ty, Val, Builder.buildConstant(S8, 1)).getReg(0);
+  return Val;
+}
+
+// Extracts the Ty-sized field starting at bit Lo of the double-width value
+// Val. Bits above the field are never examined.
+static Register buildExtractField(MachineIRBuilder &Builder, Register Val,
+                                  unsigned Lo, LLT Ty) {
+  LLT WideTy = Builder.getMRI()->getType(Val);
+  LLT S8 = LLT::scalar(8);
+  unsigned Bytes = Lo / 8;
+  unsigned Bits = Lo % 8;
+
+  // Shifting right by more than half a byte is cheaper as a shift left to the
+  // next byte boundary. The bits shifted out the top lie above the field.
+  if (Bits > 4) {
+    assert((Bytes + 1) * 8 + Ty.getSizeInBits() <= WideTy.getSizeInBits());
+    Val = buildShlByConstant(Builder, Val, 8 - Bits);
+    ++Bytes;
+    Bits = 0;
+  }
+  if (Bytes)
+    Val = Builder.buildLShr(WideTy, Val, Builder.buildConstant(S8, Bytes * 8))
+              .getReg(0);
+  for (unsigned I = 0; I < Bits; ++I)
+    Val = Builder.buildLShr(WideTy, Val, Builder.buildConstant(S8, 1))
+              .getReg(0);
+  return Builder.buildTrunc(Ty, Val).getReg(0);
+}
+
+// Clamps Result to the range of Ty if the double-width value Wide lies outside
+// [Min, Max].
+static Register buildFixSaturate(MachineIRBuilder &Builder, Register Result,
+                                 Register Wide, const APInt &Min,
+                                 const APInt &Max, bool Signed, LLT Ty) {
+  LLT S1 = LLT::scalar(1);
+  LLT WideTy = Builder.getMRI()->getType(Wide);
+  unsigned Width = Ty.getSizeInBits();
+
+  auto TooBig =
+      Builder.buildICmp(Signed ? CmpInst::ICMP_SGT : CmpInst::ICMP_UGT, S1,
+                        Wide, Builder.buildConstant(WideTy, Max));
+  Result = Builder
+               .buildSelect(Ty, TooBig,
+                            Builder.buildConstant(
+                                Ty, Signed ? APInt::getSignedMaxValue(Width)
+                                           : APInt::getMaxValue(Width)),
+                            Result)
+               .getReg(0);
+  if (!Signed)
+    return Result;
+
+  auto TooSmall = Builder.buildICmp(CmpInst::ICMP_SLT, S1, Wide,
+                                    Builder.buildConstant(WideTy, Min));
+  return Builder
+      .buildSelect(Ty, TooSmall,
+                   Builder.buildConstant(Ty, APInt::getSignedMinValue(Width)),
+                   Result)
+      .getReg(0);
+}
+
+// Splits the block containing MI just after it and inserts an empty block
+// between the two halves, to hold a loop. MI's block falls through into the
+// loop, and the loop must end by branching back to itself, falling through to
+// the returned Tail when done.
+static MachineBasicBlock *insertLoopAfter(LegalizerHelper &Helper,
+                                          MachineInstr &MI,
+                                          MachineBasicBlock *&Tail) {
+  MachineBasicBlock *Head = MI.getParent();
+  MachineFunction &MF = *Head->getParent();
+
+  Tail = Head->splitAt(MI, /*UpdateLiveIns=*/false);
+  if (Tail == Head) {
+    // If MI is the last instruction, splitAt won't insert a new block, so make
+    // one to take over the successors of the head.
+    Tail = MF.CreateMachineBasicBlock(Head->getBasicBlock());
+    MF.insert(std::next(Head->getIterator()), Tail);
+    Tail->transferSuccessorsAndUpdatePHIs(Head);
+    Head->addSuccessor(Tail);
+  } else {
+    // The CSE info identifies instructions partly by their block, so tell it
+    // about the instructions that moved.
+    for (MachineInstr &Moved : *Tail) {
+      Helper.Observer.changingInstr(Moved);
+      Helper.Observer.changedInstr(Moved);
+    }
+  }
+
+  MachineBasicBlock *Loop = MF.CreateMachineBasicBlock(Head->getBasicBlock());
+  MF.insert(Tail->getIterator(), Loop);
+  Head->replaceSuccessor(Tail, Loop);
+  Loop->addSuccessor(Loop);
+  Loop->addSuccessor(Tail);
+  return Loop;
+}
+
+// Begins a G_PHI in the loop that takes Init on entry from Head. The value on
+// the back edge is added once the loop body is built.
+static MachineInstrBuilder buildLoopPHI(MachineIRBuilder &Builder, LLT Ty,
+                                        Register Init,
+                                        MachineBasicBlock *Head) {
+  return Builder.buildInstr(G_PHI)
+      .addDef(Builder.getMRI()->createGenericVirtualRegister(Ty))
+      .addUse(Init)
+      .addMBB(Head);
+}
+
+// Ends the loop with a count down from Width, branching back to its start
+// until the count reaches zero.
+static void buildLoopLatch(MachineIRBuilder &Builder, unsigned Width,
+                           MachineBasicBlock *Head, MachineBasicBlock *Loop) {
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+  Builder.setInsertPt(*Head, Head->end());
+  Register Init = Builder.buildConstant(S8, Width).getReg(0);
+  Builder.setInsertPt(*Loop, Loop->begin());
+  auto Count = buildLoopPHI(Builder, S8, Init, Head);
+
+  Builder.setInsertPt(*Loop, Loop->end());
+  auto Next = Builder.buildSub(S8, Count->getOperand(0).getReg(),
+                               Builder.buildConstant(S8, 1));
+  Count.addUse(Next.getReg(0)).addMBB(Loop);
+  auto More = Builder.buildICmp(CmpInst::ICMP_NE, S1, Next,
+                                Builder.buildConstant(S8, 0));
+  Builder.buildBrCond(More, *Loop);
+}
+
+// Returns whether the top bit of Val is set.
+static Register buildTestTopBit(MachineIRBuilder &Builder, Register Val) {
+  LLT Ty = Builder.getMRI()->getType(Val);
+  return Builder
+      .buildICmp(CmpInst::ICMP_SLT, LLT::scalar(1), Val,
+                 Builder.buildConstant(Ty, 0))
+      .getReg(0);
+}
+
+// Builds a loop computing the unsigned double-width product of LHS and RHS by
+// shift-and-add, one bit of RHS per iteration, from the top down:
+//
+//   P = 0
+//   repeat Width times:
+//     P = (P << 1) + (RHS's top bit ? LHS : 0)
+//     RHS <<= 1
+//
+// Returns the product, which is available at the new insertion point.
+static Register buildMulLoop(LegalizerHelper &Helper, MachineInstr &MI,
+                             Register LHS, Register RHS) {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  MachineRegisterInfo &MRI = *Builder.getMRI();
+  LLT S8 = LLT::scalar(8);
+  LLT Ty = MRI.getType(LHS);
+  unsigned Width = Ty.getSizeInBits();
+  LLT WideTy = LLT::scalar(2 * Width);
+
+  MachineBasicBlock *Head = MI.getParent();
+  Register Zero = Builder.buildConstant(WideTy, 0).getReg(0);
+  MachineBasicBlock *Tail;
+  MachineBasicBlock *Loop = insertLoopAfter(Helper, MI, Tail);
+
+  Builder.setInsertPt(*Loop, Loop->end());
+  auto P = buildLoopPHI(Builder, WideTy, Zero, Head);
+  auto R = buildLoopPHI(Builder, Ty, RHS, Head);
+
+  auto One = Builder.buildConstant(S8, 1);
+  auto PShl = Builder.buildShl(WideTy, P->getOperand(0).getReg(), One);
+  Register Top = buildTestTopBit(Builder, R->getOperand(0).getReg());
+  auto Addend = Builder.buildSelect(Ty, Top, LHS, Builder.buildConstant(Ty, 0));
+  auto PNext =
+      Builder.buildAdd(WideTy, PShl, Builder.buildZExt(WideTy, Addend));
+  auto RNext = Builder.buildShl(Ty, R->getOperand(0).getReg(), One);
+  P.addUse(PNext.getReg(0)).addMBB(Loop);
+  R.addUse(RNext.getReg(0)).addMBB(Loop);
+  buildLoopLatch(Builder, Width, Head, Loop);
+
+  Builder.setInsertPt(*Tail, Tail->getFirstNonPHI());
+  return PNext.getReg(0);
+}
+
+// Builds a loop dividing the double-width value Hi:Lo by Div by restoring
+// division, one quotient bit per iteration. Hi must be less than Div, so that
+// the quotient fits in Width bits. The dividend shifts out of Lo as the
+// quotient shifts in:
+//
+//   repeat Width times:
+//     Carry = Hi's top bit
+//     Hi:Lo <<= 1
+//     if (Carry || Hi >= Div) { Hi -= Div; Lo |= 1 }
+//
+// Returns the quotient, which is available at the new insertion point.
+static Register buildDivLoop(LegalizerHelper &Helper, MachineInstr &MI,
+                             Register Hi, Register Lo, Register Div) {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  MachineRegisterInfo &MRI = *Builder.getMRI();
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+  LLT Ty = MRI.getType(Div);
+  unsigned Width = Ty.getSizeInBits();
+
+  MachineBasicBlock *Head = MI.getParent();
+  MachineBasicBlock *Tail;
+  MachineBasicBlock *Loop = insertLoopAfter(Helper, MI, Tail);
+
+  Builder.setInsertPt(*Loop, Loop->end());
+  auto R = buildLoopPHI(Builder, Ty, Hi, Head);
+  auto Q = buildLoopPHI(Builder, Ty, Lo, Head);
+  Register RVal = R->getOperand(0).getReg();
+  Register QVal = Q->getOperand(0).getReg();
+
+  auto One = Builder.buildConstant(S8, 1);
+  Register Carry = buildTestTopBit(Builder, RVal);
+  Register QTop = buildTestTopBit(Builder, QVal);
+  auto RShl = Builder.buildOr(Ty, Builder.buildShl(Ty, RVal, One),
+                              Builder.buildZExt(Ty, QTop));
+  auto GE = Builder.buildICmp(CmpInst::ICMP_UGE, S1, RShl, Div);
+  auto Sub = Builder.buildOr(S1, Carry, GE);
+  auto RNext = Builder.buildSelect(Ty, Sub, Builder.buildSub(Ty, RShl, Div),
+                                   RShl);
+  auto QNext = Builder.buildOr(Ty, Builder.buildShl(Ty, QVal, One),
+                               Builder.buildZExt(Ty, Sub));
+  R.addUse(RNext.getReg(0)).addMBB(Loop);
+  Q.addUse(QNext.getReg(0)).addMBB(Loop);
+  buildLoopLatch(Builder, Width, Head, Loop);
+
+  Builder.setInsertPt(*Tail, Tail->getFirstNonPHI());
+  return QNext.getReg(0);
+}
+
+// Returns the magnitude of the signed value Val, as an unsigned value.
+static Register buildMagnitude(MachineIRBuilder &Builder, Register Val,
+                               Register IsNeg) {
+  LLT Ty = Builder.getMRI()->getType(Val);
+  return Builder
+      .buildSelect(Ty, IsNeg,
+                   Builder.buildSub(Ty, Builder.buildConstant(Ty, 0), Val), Val)
+      .getReg(0);
+}
+
+// Lower fixed-point multiplication to a double-width multiply followed by
+// extraction of the scaled field. Multiplication by a constant (e.g., scaling
+// by a coefficient) is expanded to shifts and adds over the set bits of the
+// constant; byte-aligned shifts are free, so no more than seven single-bit
+// shifts are needed per byte of the constant. Other multiplies use an inline
+// shift-and-add loop over the bits of one operand.
+bool MOSLegalizerInfo::legalizeMulFix(LegalizerHelper &Helper,
+                                      MachineRegisterInfo &MRI,
+                                      MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S8 = LLT::scalar(8);
+
+  Register Dst = MI.getOperand(0).getReg();
+  Register LHS = MI.getOperand(1).getReg();
+  Register RHS = MI.getOperand(2).getReg();
+  unsigned Scale = MI.getOperand(3).getImm();
+  bool Signed = MI.getOpcode() == G_SMULFIX || MI.getOpcode() == G_SMULFIXSAT;
+  bool Sat = MI.getOpcode() == G_SMULFIXSAT || MI.getOpcode() == G_UMULFIXSAT;
+
+  LLT Ty = MRI.getType(Dst);
+  unsigned Width = Ty.getSizeInBits();
+  LLT WideTy = LLT::scalar(2 * Width);
+  auto Extend = [&](Register Reg) {
+    return (Signed ? Builder.buildSExt(WideTy, Reg)
+                   : Builder.buildZExt(WideTy, Reg))
+        .getReg(0);
+  };
+
+  auto Const = getConstantVRegValWithLookThrough(RHS, MRI);
+  if (!Const) {
+    Const = getConstantVRegValWithLookThrough(LHS, MRI);
+    std::swap(LHS, RHS);
+  }
+
+  Register Product;
+  if (Const) {
+    APInt C = Signed ? Const->Value.sext(2 * Width)
+                     : Const->Value.zext(2 * Width);
+    bool Negate = C.isNegative();
+    if (Negate)
+      C.negate();
+
+    Register X = Extend(LHS);
+    for (unsigned Byte = 0; Byte < Width / 8; ++Byte) {
+      uint64_t Bits = C.extractBitsAsZExtValue(8, Byte * 8);
+      if (!Bits)
+        continue;
+      Register Shifted = buildShlByConstant(Builder, X, Byte * 8);
+      while (true) {
+        if (Bits & 1)
+          Product = Product ? Builder.buildAdd(WideTy, Product, Shifted)
+                                  .getReg(0)
+                            : Shifted;
+        Bits >>= 1;
+        if (!Bits)
+          break;
+        Shifted =
+            Builder.buildShl(WideTy, Shifted, Builder.buildConstant(S8, 1))
+                .getReg(0);
+      }
+    }
+    if (!Product)
+      Product = Builder.buildConstant(WideTy, 0).getReg(0);
+    else if (Negate)
+      Product =
+          Builder.buildSub(WideTy, Builder.buildConstant(WideTy, 0), Product)
+              .getReg(0);
+  } else {
+    Register LHSNeg, RHSNeg;
+    if (Signed) {
+      LHSNeg = buildTestTopBit(Builder, LHS);
+      RHSNeg = buildTestTopBit(Builder, RHS);
+    }
+    Product = buildMulLoop(Helper, MI, LHS, RHS);
+
+    // The loop multiplies the operands as unsigned. A negative operand is
+    // 2^Width too large as unsigned, which adds 2^Width times the other
+    // operand to the product; subtract it back out.
+    if (Signed) {
+      auto Zero = Builder.buildConstant(Ty, 0);
+      for (const auto &Fix : {std::make_pair(LHSNeg, RHS),
+                              std::make_pair(RHSNeg, LHS)}) {
+        auto Corr = Builder.buildSelect(Ty, Fix.first, Fix.second, Zero);
+        auto Shifted =
+            Builder.buildShl(WideTy, Builder.buildZExt(WideTy, Corr),
+                             Builder.buildConstant(S8, Width));
+        Product = Builder.buildSub(WideTy, Product, Shifted).getReg(0);
+      }
+    }
+  }
+
+  Register Result = buildExtractField(Builder, Product, Scale, Ty);
+  if (Sat) {
+    // The representable products are those whose bits above the field are a
+    // sign (or zero) extension of it; the bits below the field are truncated.
+    APInt LowBits = APInt::getLowBitsSet(2 * Width, Scale);
+    APInt Max = (Signed ? APInt::getSignedMaxValue(Width).sext(2 * Width)
+                        : APInt::getMaxValue(Width).zext(2 * Width))
+                    .shl(Scale) |
+                LowBits;
+    APInt Min = APInt::getSignedMinValue(Width).sext(2 * Width).shl(Scale);
+    Result = buildFixSaturate(Builder, Result, Product, Min, Max, Signed, Ty);
+  }
+
+  Builder.buildCopy(Dst, Result);
+  MI.eraseFromParent();
+  return true;
+}
+
+// Lower fixed-point division to an inline restoring division of the
+// pre-scaled dividend. Signed division divides the magnitudes and negates the
+// quotient if the signs differ; the rounding direction of fixed-point division
+// is unspecified, so truncation is fine.
+bool MOSLegalizerInfo::legalizeDivFix(LegalizerHelper &Helper,
+                                      MachineRegisterInfo &MRI,
+                                      MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S1 = LLT::scalar(1);
+
+  Register Dst = MI.getOperand(0).getReg();
+  Register LHS = MI.getOperand(1).getReg();
+  Register RHS = MI.getOperand(2).getReg();
+  unsigned Scale = MI.getOperand(3).getImm();
+  bool Signed = MI.getOpcode() == G_SDIVFIX || MI.getOpcode() == G_SDIVFIXSAT;
+  bool Sat = MI.getOpcode() == G_SDIVFIXSAT || MI.getOpcode() == G_UDIVFIXSAT;
+
+  LLT Ty = MRI.getType(Dst);
+  unsigned Width = Ty.getSizeInBits();
+  LLT WideTy = LLT::scalar(2 * Width);
+
+  Register Neg;
+  if (Signed) {
+    Register LHSNeg = buildTestTopBit(Builder, LHS);
+    Register RHSNeg = buildTestTopBit(Builder, RHS);
+    Neg = Builder.buildXor(S1, LHSNeg, RHSNeg).getReg(0);
+    LHS = buildMagnitude(Builder, LHS, LHSNeg);
+    RHS = buildMagnitude(Builder, RHS, RHSNeg);
+  }
+
+  // The quotient fits in Width bits exactly when the high half of the dividend
+  // is less than the divisor; otherwise, the result is out of range.
+  Register Dividend =
+      buildShlByConstant(Builder, Builder.buildZExt(WideTy, LHS).getReg(0),
+                         Scale);
+  auto Halves = Builder.buildUnmerge(Ty, Dividend);
+  Register Overflow;
+  if (Sat)
+    Overflow = Builder
+                   .buildICmp(CmpInst::ICMP_UGE, S1, Halves.getReg(1), RHS)
+                   .getReg(0);
+  Register Quotient =
+      buildDivLoop(Helper, MI, Halves.getReg(1), Halves.getReg(0), RHS);
+
+  Register Result = Quotient;
+  if (Signed)
+    Result = Builder
+                 .buildSelect(Ty, Neg,
+                              Builder.buildSub(Ty, Builder.buildConstant(Ty, 0),
+                                               Quotient),
+                              Quotient)
+                 .getReg(0);
+  if (Sat) {
+    // A positive result saturates if its magnitude has the sign bit set; a
+    // negative one if its magnitude exceeds that of the minimum value.
+    APInt Min = APInt::getSignedMinValue(Width);
+    Register TooBig = Overflow;
+    if (Signed) {
+      auto OutOfRange = Builder.buildSelect(
+          S1, Neg,
+          Builder.buildICmp(CmpInst::ICMP_UGT, S1, Quotient,
+                            Builder.buildConstant(Ty, Min)),
+          buildTestTopBit(Builder, Quotient));
+      TooBig = Builder.buildOr(S1, Overflow, OutOfRange).getReg(0);
+    }
+    APInt Max = Signed ? APInt::getSignedMaxValue(Width)
+                       : APInt::getMaxValue(Width);
+    auto Clamp = Builder.buildConstant(Ty, Max);
+    if (Signed)
+      Clamp = Builder.buildSelect(Ty, Neg, Builder.buildConstant(Ty, Min),
+                                  Clamp);
+    Result = Builder.buildSelect(Ty, TooBig, Clamp, Result).getReg(0);
+  }
+
+  Builder.buildCopy(Dst, Result);
+  MI.eraseFromParent();
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // Memory Operations
 //===----------------------------------------------------------------------===//
@@ -945,7 +1716,9 @@ bool MOSLegalizerInfo::legalizeLoad(LegalizerHelper &Helper,
                                     MachineRegisterInfo &MRI,
                                     MachineInstr &MI) const {
   MachineIRBuilder &Builder = Helper.MIRBuilder;
-  Register Tmp = MRI.createGenericVirtualRegister(LLT::scalar(16));
+  LLT IntTy =
+      LLT::scalar(MRI.getType(MI.getOperand(0).getReg()).getSizeInBits());
+  Register Tmp = MRI.createGenericVirtualRegister(IntTy);
   Builder.setInsertPt(Builder.getMBB(), std::next(Builder.getInsertPt()));
   Builder.buildIntToPtr(MI.getOperand(0), Tmp);
   Helper.Observer.changingInstr(MI);
@@ -960,14 +1733,282 @@ bool MOSLegalizerInfo::legalizeStore(LegalizerHelper &Helper,
                                      MachineRegisterInfo &MRI,
                                      MachineInstr &MI) const {
   MachineIRBuilder &Builder = Helper.MIRBuilder;
-  Register Tmp =
-      Builder.buildPtrToInt(LLT::scalar(16), MI.getOperand(0)).getReg(0);
+  LLT IntTy =
+      LLT::scalar(MRI.getType(MI.getOperand(0).getReg()).getSizeInBits());
+  Register Tmp = Builder.buildPtrToInt(IntTy, MI.getOperand(0)).getReg(0);
   Helper.Observer.changingInstr(MI);
   MI.getOperand(0).setReg(Tmp);
   Helper.Observer.changedInstr(MI);
   return true;
 }
 
+//===----------------------------------------------------------------------===//
+// Atomic Operations
+//===----------------------------------------------------------------------===//
+//
+// Interrupts are the only source of concurrency on the 6502, and a single
+// instruction can't be interrupted partway through. Single-byte loads and
+// stores are thus already atomic, as are read-modify-write instructions like
+// INC. Other operations are made atomic by disabling interrupts around them.
+//
+//===----------------------------------------------------------------------===//
+
+// The hardware never reorders memory accesses, so a fence only needs to keep
+// the compiler from moving memory accesses across it.
+bool MOSLegalizerInfo::legalizeFence(LegalizerHelper &Helper,
+                                     MachineRegisterInfo &MRI,
+                                     MachineInstr &MI) const {
+  Helper.MIRBuilder.buildInstr(MOS::CompilerBarrier);
+  MI.eraseFromParent();
+  return true;
+}
+
+// Returns a load or store memory operand for the atomic read-modify-write
+// MMO. By default, the access is one half of the read-modify-write, and
+// ordering is provided by the surrounding critical section, so it need only be
+// monotonic.
+static MachineMemOperand *
+getAccessMMO(MachineFunction &MF, const MachineMemOperand &MMO,
+             MachineMemOperand::Flags Kind,
+             AtomicOrdering Ordering = AtomicOrdering::Monotonic) {
+  MachineMemOperand::Flags Flags =
+      (MMO.getFlags() &
+       ~(MachineMemOperand::MOLoad | MachineMemOperand::MOStore)) |
+      Kind;
+  return MF.getMachineMemOperand(MMO.getPointerInfo(), Flags, MMO.getSize(),
+                                 MMO.getBaseAlign(), MMO.getAAInfo(),
+                                 /*Ranges=*/nullptr, MMO.getSyncScopeID(),
+                                 Ordering);
+}
+
+// Disables interrupts, saving the previous interrupt mask on the hardware
+// stack. Saving the mask allows critical sections to be used within interrupt
+// handlers and within other critical sections.
+static void buildCriticalSectionBegin(MachineIRBuilder &Builder) {
+  Builder.buildInstr(MOS::PH).addUse(MOS::P, RegState::Undef);
+  Builder.buildInstr(MOS::SEI_Implied);
+}
+
+// Restores the interrupt mask saved by buildCriticalSectionBegin. This also
+// restores the rest of the flags, so any flag values are lost.
+static void buildCriticalSectionEnd(MachineIRBuilder &Builder) {
+  Builder.buildInstr(MOS::PL).addDef(MOS::P, RegState::Dead);
+}
+
+// Determines whether Addr is a constant address usable by the absolute
+// addressing mode, and if so sets AddrOut to it.
+static bool matchAbsoluteAddr(Register Addr, MachineOperand &AddrOut,
+                              const MachineRegisterInfo &MRI) {
+  int64_t Offset = 0;
+  if (MachineInstr *PtrAdd = getOpcodeDef(G_PTR_ADD, Addr, MRI)) {
+    auto ConstOffset =
+        getConstantVRegSExtVal(PtrAdd->getOperand(2).getReg(), MRI);
+    if (!ConstOffset)
+      return false;
+    Addr = PtrAdd->getOperand(1).getReg();
+    Offset = *ConstOffset;
+  }
+
+  if (MachineInstr *GV = getOpcodeDef(G_GLOBAL_VALUE, Addr, MRI)) {
+    AddrOut = GV->getOperand(1);
+    AddrOut.setOffset(AddrOut.getOffset() + Offset);
+    return true;
+  }
+  if (auto ConstAddr = getConstantVRegValWithLookThrough(Addr, MRI)) {
+    AddrOut.ChangeToImmediate((ConstAddr->Value.getZExtValue() + Offset) &
+                              0xffff);
+    return true;
+  }
+  return false;
+}
+
+// Emits an atomic read-modify-write whose result is unused as a single
+// instruction, if the 6502 has one for it.
+static bool buildAtomicRMWInstr(MachineIRBuilder &Builder,
+                                MachineRegisterInfo &MRI, MachineInstr &MI) {
+  LLT S8 = LLT::scalar(8);
+  Register Addr = MI.getOperand(1).getReg();
+  Register Val = MI.getOperand(2).getReg();
+  const MachineMemOperand &MMO = **MI.memoperands_begin();
+  const MOSSubtarget &STI = Builder.getMF().getSubtarget<MOSSubtarget>();
+
+  // An exchange whose old value is unused is just a store. Nothing surrounds
+  // it, so it keeps the exchange's ordering.
+  if (MI.getOpcode() == G_ATOMICRMW_XCHG) {
+    Builder.buildStore(Val, Addr,
+                       *getAccessMMO(Builder.getMF(), MMO,
+                                     MachineMemOperand::MOStore,
+                                     MMO.getSuccessOrdering()));
+    return true;
+  }
+
+  MachineOperand AddrOp = MachineOperand::CreateImm(0);
+  if (!matchAbsoluteAddr(Addr, AddrOp, MRI))
+    return false;
+
+  unsigned Opcode;
+  Register Mask;
+  switch (MI.getOpcode()) {
+  default:
+    return false;
+  case G_ATOMICRMW_ADD:
+  case G_ATOMICRMW_SUB: {
+    auto ConstVal = getConstantVRegSExtVal(Val, MRI);
+    if (!ConstVal)
+      return false;
+    int64_t Inc = MI.getOpcode() == G_ATOMICRMW_ADD ? *ConstVal : -*ConstVal;
+    if (Inc == 1)
+      Opcode = MOS::INCAbs;
+    else if (Inc == -1)
+      Opcode = MOS::DECAbs;
+    else
+      return false;
+    break;
+  }
+  case G_ATOMICRMW_OR:
+    if (!STI.has65C02())
+      return false;
+    Opcode = MOS::TSBAbs;
+    Mask = Val;
+    break;
+  case G_ATOMICRMW_AND:
+    // TRB clears the bits set in A, so A must hold the bits to clear.
+    if (!STI.has65C02())
+      return false;
+    Opcode = MOS::TRBAbs;
+    Mask = Builder.buildNot(S8, Val).getReg(0);
+    break;
+  }
+
+  Register A;
+  if (Mask) {
+    A = MRI.createVirtualRegister(&MOS::AcRegClass);
+    Builder.buildCopy(A, Mask);
+  }
+  auto Instr = Builder.buildInstr(Opcode);
+  if (A)
+    Instr.addUse(A);
+  Instr.add(AddrOp).cloneMemRefs(MI);
+  return true;
+}
+
+bool MOSLegalizerInfo::legalizeAtomicRMW(LegalizerHelper &Helper,
+                                         MachineRegisterInfo &MRI,
+                                         MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  MachineFunction &MF = Builder.getMF();
+  LLT S8 = LLT::scalar(8);
+  Register Dst = MI.getOperand(0).getReg();
+  Register Addr = MI.getOperand(1).getReg();
+  Register Val = MI.getOperand(2).getReg();
+  const MachineMemOperand &MMO = **MI.memoperands_begin();
+
+  if (MRI.use_nodbg_empty(Dst) && buildAtomicRMWInstr(Builder, MRI, MI)) {
+    MI.eraseFromParent();
+    return true;
+  }
+
+  buildCriticalSectionBegin(Builder);
+  Builder.buildLoad(Dst, Addr,
+                    *getAccessMMO(MF, MMO, MachineMemOperand::MOLoad));
+  Register New;
+  switch (MI.getOpcode()) {
+  default:
+    llvm_unreachable("Unexpected atomic read-modify-write opcode.");
+  case G_ATOMICRMW_XCHG:
+    New = Val;
+    break;
+  case G_ATOMICRMW_NAND:
+    New = Builder.buildNot(S8, Builder.buildAnd(S8, Dst, Val)).getReg(0);
+    break;
+  case G_ATOMICRMW_ADD:
+  case G_ATOMICRMW_SUB:
+  case G_ATOMICRMW_AND:
+  case G_ATOMICRMW_OR:
+  case G_ATOMICRMW_XOR:
+  case G_ATOMICRMW_MAX:
+  case G_ATOMICRMW_MIN:
+  case G_ATOMICRMW_UMAX:
+  case G_ATOMICRMW_UMIN: {
+    unsigned Opcode;
+    switch (MI.getOpcode()) {
+    default:
+      llvm_unreachable("Unexpected atomic read-modify-write opcode.");
+    case G_ATOMICRMW_ADD:
+      Opcode = G_ADD;
+      break;
+    case G_ATOMICRMW_SUB:
+      Opcode = G_SUB;
+      break;
+    case G_ATOMICRMW_AND:
+      Opcode = G_AND;
+      break;
+    case G_ATOMICRMW_OR:
+      Opcode = G_OR;
+      break;
+    case G_ATOMICRMW_XOR:
+      Opcode = G_XOR;
+      break;
+    case G_ATOMICRMW_MAX:
+      Opcode = G_SMAX;
+      break;
+    case G_ATOMICRMW_MIN:
+      Opcode = G_SMIN;
+      break;
+    case G_ATOMICRMW_UMAX:
+      Opcode = G_UMAX;
+      break;
+    case G_ATOMICRMW_UMIN:
+      Opcode = G_UMIN;
+      break;
+    }
+    New = Builder.buildInstr(Opcode, {S8}, {Dst, Val}).getReg(0);
+    break;
+  }
+  }
+  Builder.buildStore(New, Addr,
+                     *getAccessMMO(MF, MMO, MachineMemOperand::MOStore));
+  buildCriticalSectionEnd(Builder);
+
+  MI.eraseFromParent();
+  return true;
+}
+
+// The exchange is performed as a store of either the new value or the old
+// value, depending on the comparison. Storing the old value back is harmless,
+// since interrupts are disabled, and it avoids a branch inside the critical
+// section.
+bool MOSLegalizerInfo::legalizeAtomicCmpXchg(LegalizerHelper &Helper,
+                                             MachineRegisterInfo &MRI,
+                                             MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  MachineFunction &MF = Builder.getMF();
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+
+  bool HasSuccess = MI.getOpcode() == G_ATOMIC_CMPXCHG_WITH_SUCCESS;
+  unsigned OpIdx = HasSuccess ? 2 : 1;
+  Register Dst = MI.getOperand(0).getReg();
+  Register Addr = MI.getOperand(OpIdx).getReg();
+  Register Cmp = MI.getOperand(OpIdx + 1).getReg();
+  Register NewVal = MI.getOperand(OpIdx + 2).getReg();
+  const MachineMemOperand &MMO = **MI.memoperands_begin();
+
+  buildCriticalSectionBegin(Builder);
+  Builder.buildLoad(Dst, Addr,
+                    *getAccessMMO(MF, MMO, MachineMemOperand::MOLoad));
+  DstOp SuccessDst =
+      HasSuccess ? DstOp(MI.getOperand(1).getReg()) : DstOp(S1);
+  auto Success = Builder.buildICmp(CmpInst::ICMP_EQ, SuccessDst, Dst, Cmp);
+  auto New = Builder.buildSelect(S8, Success, NewVal, Dst);
+  Builder.buildStore(New, Addr,
+                     *getAccessMMO(MF, MMO, MachineMemOperand::MOStore));
+  buildCriticalSectionEnd(Builder);
+
+  MI.eraseFromParent();
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // Control Flow
 //===----------------------------------------------------------------------===//
@@ -975,7 +2016,8 @@ bool MOSLegalizerInfo::legalizeStore(LegalizerHelper &Helper,
 bool MOSLegalizerInfo::legalizePhi(LegalizerHelper &Helper,
                                    MachineRegisterInfo &MRI,
                                    MachineInstr &MI) const {
-  LLT S16 = LLT::scalar(16);
+  LLT IntTy =
+      LLT::scalar(MRI.getType(MI.getOperand(0).getReg()).getSizeInBits());
   MachineIRBuilder &Builder = Helper.MIRBuilder;
 
   Helper.Observer.changingInstr(MI);
@@ -983,9 +2025,9 @@ bool MOSLegalizerInfo::legalizePhi(LegalizerHelper &Helper,
     Register Reg = MI.getOperand(I).getReg();
     MachineBasicBlock *Block = MI.getOperand(I + 1).getMBB();
     Builder.setInsertPt(*Block, Block->getFirstTerminator());
-    MI.getOperand(I).setReg(Builder.buildPtrToInt(S16, Reg).getReg(0));
+    MI.getOperand(I).setReg(Builder.buildPtrToInt(IntTy, Reg).getReg(0));
   }
-  Register Tmp = MRI.createGenericVirtualRegister(S16);
+  Register Tmp = MRI.createGenericVirtualRegister(IntTy);
   Builder.setInsertPt(*MI.getParent(), MI.getParent()->getFirstNonPHI());
   Builder.buildIntToPtr(MI.getOperand(0).getReg(), Tmp);
   MI.getOperand(0).setReg(Tmp);
@@ -34,6 +34,14 @@ private:
   bool legalizeZExt(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                     MachineInstr &MI) const;
 
+  // Type Conversions
+  bool legalizeAddrSpaceCast(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                             MachineInstr &MI) const;
+  bool legalizeIntToPtr(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                        MachineInstr &MI) const;
+  bool legalizePtrToInt(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                        MachineInstr &MI) const;
+
   // Scalar Operations
   bool legalizeBSwap(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                      MachineInstr &MI) const;
@@ -59,6 +67,14 @@ private:
                        MachineInstr &MI) const;
   bool legalizeSubE(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                     MachineInstr &MI) const;
+  bool legalizeBCDAddSub(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                         MachineInstr &MI) const;
+
+  // Fixed-Point Operations
+  bool legalizeMulFix(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                      MachineInstr &MI) const;
+  bool legalizeDivFix(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                      MachineInstr &MI) const;
 
   // Memory Operations
   bool legalizeLoad(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
@@ -66,6 +82,14 @@ private:
   bool legalizeStore(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                      MachineInstr &MI) const;
 
+  // Atomic Operations
+  bool legalizeFence(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                     MachineInstr &MI) const;
+  bool legalizeAtomicRMW(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                         MachineInstr &MI) const;
+  bool legalizeAtomicCmpXchg(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                             MachineInstr &MI) const;
+
   // Control Flow
   bool legalizePhi(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                    MachineInstr &MI) const;
@@ -0,0 +1,205 @@
+//===-- MOSLibcallRecursion.cpp - MOS Libcall Recursion Analysis ----------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS libcall recursion analysis pass.
+//
+// A function reachable from more than one interrupt context (main, an
+// interrupt-norecurse handler, or any invocation of a reentrant interrupt
+// handler) may have more than one invocation active at a time, so it can't be
+// norecurse. MOSNoRecurse determines this for ordinary functions, but calls to
+// runtime library functions don't exist until legalization, so it can't see
+// which handlers reach which libcalls.
+//
+// This pass runs immediately after the legalizer. Being a module pass, it only
+// runs once every function in the module has been legalized, and so it sees
+// each libcall that will actually be emitted. Since nothing before instruction
+// selection depends on whether a function is norecurse, it can still strip
+// norecurse from libcall bodies reachable from multiple interrupt contexts.
+// Calls to unknown functions are conservatively assumed to reach every
+// externally-visible or address-taken function, libcalls included.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSLibcallRecursion.h"
+
+#include "MOS.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-libcall-recursion"
+
+using namespace llvm;
+
+namespace {
+
+class MOSLibcallRecursion : public ModulePass {
+public:
+  static char ID;
+
+  MOSLibcallRecursion() : ModulePass(ID) {
+    llvm::initializeMOSLibcallRecursionPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  // Functions called directly by each function, including libcalls.
+  DenseMap<const Function *, SmallVector<const Function *>> Callees;
+  // Functions that make calls to unknown functions.
+  SmallPtrSet<const Function *, 8> CallsUnknown;
+  // Functions that unknown functions may call.
+  SmallVector<const Function *> ExternallyCallable;
+
+  void buildCallGraph(Module &M, MachineModuleInfo &MMI);
+  void collectReachable(const Function &Root,
+                        SmallPtrSetImpl<const Function *> &Reachable) const;
+};
+
+void MOSLibcallRecursion::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineModuleInfoWrapperPass>();
+  AU.addPreserved<MachineModuleInfoWrapperPass>();
+}
+
+void MOSLibcallRecursion::buildCallGraph(Module &M, MachineModuleInfo &MMI) {
+  Callees.clear();
+  CallsUnknown.clear();
+  ExternallyCallable.clear();
+
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    if (!F.hasLocalLinkage() || F.hasAddressTaken())
+      ExternallyCallable.push_back(&F);
+
+    const MachineFunction *MF = MMI.getMachineFunction(F);
+    if (!MF) {
+      // Without machine code, there's no telling what F calls.
+      CallsUnknown.insert(&F);
+      continue;
+    }
+
+    SmallVector<const Function *> &FCallees = Callees[&F];
+    for (const MachineBasicBlock &MBB : *MF) {
+      for (const MachineInstr &MI : MBB) {
+        if (!MI.isCall())
+          continue;
+        const Function *Callee = nullptr;
+        for (const MachineOperand &MO : MI.operands()) {
+          if (MO.isGlobal())
+            Callee = dyn_cast<Function>(MO.getGlobal());
+          else if (MO.isSymbol())
+            Callee = M.getFunction(MO.getSymbolName());
+          else
+            continue;
+          break;
+        }
+        if (Callee && !Callee->isDeclaration())
+          FCallees.push_back(Callee);
+        else
+          CallsUnknown.insert(&F);
+      }
+    }
+  }
+}
+
+void MOSLibcallRecursion::collectReachable(
+    const Function &Root, SmallPtrSetImpl<const Function *> &Reachable) const {
+  SmallVector<const Function *> Worklist = {&Root};
+  bool AddedExternallyCallable = false;
+  while (!Worklist.empty()) {
+    const Function *F = Worklist.pop_back_val();
+    if (!Reachable.insert(F).second)
+      continue;
+
+    auto It = Callees.find(F);
+    if (It != Callees.end())
+      Worklist.append(It->second.begin(), It->second.end());
+
+    if (CallsUnknown.contains(F) && !AddedExternallyCallable) {
+      Worklist.append(ExternallyCallable.begin(), ExternallyCallable.end());
+      AddedExternallyCallable = true;
+    }
+  }
+}
+
+bool MOSLibcallRecursion::runOnModule(Module &M) {
+  SmallVector<Function *> Libcalls;
+  for (const char *LibcallName : lto::LTO::getRuntimeLibcallSymbols()) {
+    Function *Libcall = M.getFunction(LibcallName);
+    if (Libcall && !Libcall->isDeclaration() && Libcall->doesNotRecurse())
+      Libcalls.push_back(Libcall);
+  }
+  if (Libcalls.empty())
+    return false;
+
+  SmallVector<const Function *> ReentrantRoots;
+  SmallVector<const Function *> NorecurseRoots;
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    if (F.hasFnAttribute("interrupt"))
+      ReentrantRoots.push_back(&F);
+    else if (F.hasFnAttribute("interrupt-norecurse") || F.getName() == "main")
+      NorecurseRoots.push_back(&F);
+  }
+  // Without interrupts, there's only one context.
+  if (ReentrantRoots.empty() && NorecurseRoots.size() <= 1)
+    return false;
+
+  buildCallGraph(M, getAnalysis<MachineModuleInfoWrapperPass>().getMMI());
+
+  // A reentrant interrupt may interrupt itself, so anything it reaches is
+  // reachable from multiple contexts. Otherwise, count the contexts reaching
+  // each function.
+  SmallPtrSet<const Function *, 8> MultipleContexts;
+  DenseMap<const Function *, unsigned> NumContexts;
+  for (const Function *Root : ReentrantRoots) {
+    SmallPtrSet<const Function *, 8> Reachable;
+    collectReachable(*Root, Reachable);
+    MultipleContexts.insert(Reachable.begin(), Reachable.end());
+  }
+  for (const Function *Root : NorecurseRoots) {
+    SmallPtrSet<const Function *, 8> Reachable;
+    collectReachable(*Root, Reachable);
+    for (const Function *F : Reachable)
+      if (++NumContexts[F] > 1)
+        MultipleContexts.insert(F);
+  }
+
+  bool Changed = false;
+  for (Function *Libcall : Libcalls) {
+    if (!MultipleContexts.contains(Libcall))
+      continue;
+    LLVM_DEBUG(dbgs() << "Marking libcall as possibly recursive: "
+                      << Libcall->getName() << "\n");
+    Libcall->removeFnAttr(Attribute::NoRecurse);
+    Changed = true;
+  }
+  return Changed;
+}
+
+} // namespace
+
+char MOSLibcallRecursion::ID = 0;
+
+INITIALIZE_PASS(MOSLibcallRecursion, DEBUG_TYPE,
+                "Detect libcalls reachable from multiple interrupt contexts",
+                false, false)
+
+ModulePass *llvm::createMOSLibcallRecursionPass() {
+  return new MOSLibcallRecursion();
+}
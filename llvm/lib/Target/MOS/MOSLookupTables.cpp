@@ -0,0 +1,493 @@
+//===-- MOSLookupTables.cpp - MOS Lookup Table Synthesis Pass -------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS lookup table synthesis pass.
+//
+// This pass replaces expensive pure computations on a single byte with loads
+// from a 256-entry constant table indexed by that byte ("LDA table,X"). The
+// table is filled in at compile time by evaluating the computation for every
+// byte value with the constant folder.
+//
+// Two kinds of computation are replaced:
+//  - Functions of one i8 argument that touch no memory. Their direct calls
+//    become table loads, and their bodies become a single table load.
+//  - Expression trees in loops whose only varying input is one byte defined in
+//    the loop. These are what remains of such functions after inlining.
+//
+// Multiplies, divides, variable shifts and calls are weighed heavily, since
+// each becomes a libcall or a loop on the 6502. A computation is only
+// replaced if its weight reaches -mos-lookup-table-min-cost. Tables come out
+// of a per-module ROM budget, -mos-lookup-table-budget; results wider than a
+// byte take several bytes per entry, and MOSSplitTables later splits their
+// tables into byte arrays.
+//===----------------------------------------------------------------------===//
+
+#include "MOSLookupTables.h"
+
+#include "MOS.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define DEBUG_TYPE "mos-lookup-tables"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+    TableBudget("mos-lookup-table-budget", cl::init(1024),
+                cl::desc("Maximum number of bytes of lookup tables "
+                         "synthesized for each module"),
+                cl::Hidden);
+
+static cl::opt<unsigned> TableMinCost(
+    "mos-lookup-table-min-cost", cl::init(8),
+    cl::desc("Minimum weight of a byte computation replaced by a lookup table"),
+    cl::Hidden);
+
+// Limits the instructions executed when evaluating a function for one input,
+// since its loops need not terminate.
+static constexpr unsigned MaxEvalSteps = 4096;
+
+// The weight of an instruction that becomes a libcall or a loop.
+static constexpr unsigned ExpensiveCost = 8;
+
+namespace {
+
+struct MOSLookupTables : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSLookupTables() : ModulePass(ID) {
+    initializeMOSLookupTablesPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  bool replaceFunction(Function &F);
+  bool replaceLoopExpressions(Function &F);
+  GlobalVariable *createTable(Module &M, Type *Ty, ArrayRef<Constant *> Entries,
+                              const Twine &Name);
+
+  unsigned Budget;
+};
+
+// An expression tree in a loop: the single byte it varies with and the total
+// weight of the instructions that compute it from that byte.
+struct ExprInfo {
+  Value *Leaf;
+  unsigned Cost;
+};
+
+} // namespace
+
+void MOSLookupTables::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<LoopInfoWrapperPass>();
+}
+
+static bool isTableType(Type *Ty, const DataLayout &DL) {
+  return Ty->isIntegerTy() && DL.getTypeAllocSize(Ty) <= 4;
+}
+
+static unsigned getCost(const Instruction &I) {
+  switch (I.getOpcode()) {
+  case Instruction::Mul:
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+  case Instruction::Call:
+    return ExpensiveCost;
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+    return isa<Constant>(I.getOperand(1)) ? 1 : ExpensiveCost;
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::Trunc:
+  case Instruction::BitCast:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+// Returns whether I can be evaluated from constant operands.
+static bool isEvaluable(const Instruction &I) {
+  if (isa<PHINode>(I) || I.isTerminator() || I.isEHPad())
+    return false;
+  if (const auto *Call = dyn_cast<CallBase>(&I)) {
+    const Function *Callee = Call->getCalledFunction();
+    return Callee && canConstantFoldCallTo(Call, Callee);
+  }
+  return !I.mayReadOrWriteMemory() && !isa<AllocaInst>(I);
+}
+
+// Evaluates I given the constant values of its operands.
+static Constant *evaluate(Instruction &I,
+                          const DenseMap<Value *, Constant *> &Vals,
+                          const DataLayout &DL) {
+  SmallVector<Constant *> Ops;
+  for (Value *Op : I.operands()) {
+    Constant *C = dyn_cast<Constant>(Op);
+    if (!C)
+      C = Vals.lookup(Op);
+    if (!C)
+      return nullptr;
+    Ops.push_back(C);
+  }
+  if (const auto *Cmp = dyn_cast<CmpInst>(&I))
+    return ConstantFoldCompareInstOperands(Cmp->getPredicate(), Ops[0], Ops[1],
+                                           DL);
+  return ConstantFoldInstOperands(&I, Ops, DL);
+}
+
+// Converts the result of an evaluation into a table entry. Results that are
+// undefined for an input may take any value.
+static Constant *toEntry(Constant *C, Type *Ty) {
+  if (!C)
+    return nullptr;
+  if (isa<UndefValue>(C))
+    return Constant::getNullValue(Ty);
+  return dyn_cast<ConstantInt>(C);
+}
+
+// Evaluates F for the argument value Arg by interpreting its body.
+static Constant *evaluateFunction(Function &F, Constant *Arg) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  DenseMap<Value *, Constant *> Vals;
+  Vals[F.getArg(0)] = Arg;
+  auto Lookup = [&](Value *V) -> Constant * {
+    if (auto *C = dyn_cast<Constant>(V))
+      return C;
+    return Vals.lookup(V);
+  };
+
+  BasicBlock *Pred = nullptr;
+  BasicBlock *BB = &F.getEntryBlock();
+  unsigned Steps = 0;
+  while (true) {
+    // The incoming values of all phis are read before any are written.
+    SmallVector<std::pair<PHINode *, Constant *>> PhiVals;
+    for (PHINode &PN : BB->phis()) {
+      Constant *C = Lookup(PN.getIncomingValueForBlock(Pred));
+      if (!C)
+        return nullptr;
+      PhiVals.push_back({&PN, C});
+    }
+    for (const auto &PhiVal : PhiVals)
+      Vals[PhiVal.first] = PhiVal.second;
+
+    BasicBlock *Next = nullptr;
+    for (Instruction &I : make_range(BB->getFirstNonPHI()->getIterator(),
+                                     BB->end())) {
+      if (++Steps > MaxEvalSteps)
+        return nullptr;
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+
+      if (auto *Ret = dyn_cast<ReturnInst>(&I))
+        return Lookup(Ret->getReturnValue());
+      if (auto *Br = dyn_cast<BranchInst>(&I)) {
+        if (Br->isUnconditional()) {
+          Next = Br->getSuccessor(0);
+          break;
+        }
+        auto *Cond = dyn_cast_or_null<ConstantInt>(Lookup(Br->getCondition()));
+        if (!Cond)
+          return nullptr;
+        Next = Br->getSuccessor(Cond->isZero());
+        break;
+      }
+      if (auto *Switch = dyn_cast<SwitchInst>(&I)) {
+        auto *Cond =
+            dyn_cast_or_null<ConstantInt>(Lookup(Switch->getCondition()));
+        if (!Cond)
+          return nullptr;
+        Next = Switch->findCaseValue(Cond)->getCaseSuccessor();
+        break;
+      }
+      if (!isEvaluable(I))
+        return nullptr;
+
+      Constant *C = evaluate(I, Vals, DL);
+      if (!C)
+        return nullptr;
+      Vals[&I] = C;
+    }
+    Pred = BB;
+    BB = Next;
+  }
+}
+
+// Returns the instructions of the expression tree rooted at Root that computes
+// it from Leaf, in an order that evaluates operands first.
+static void collectExpression(Instruction *Root, Value *Leaf,
+                              SmallVectorImpl<Instruction *> &Expr) {
+  SmallPtrSet<Instruction *, 8> Visited;
+  SmallVector<std::pair<Instruction *, bool>> Worklist = {{Root, false}};
+  while (!Worklist.empty()) {
+    auto Item = Worklist.pop_back_val();
+    Instruction *I = Item.first;
+    if (Item.second) {
+      Expr.push_back(I);
+      continue;
+    }
+    if (!Visited.insert(I).second)
+      continue;
+    Worklist.push_back({I, true});
+    for (Value *Op : I->operands())
+      if (auto *OpI = dyn_cast<Instruction>(Op))
+        if (OpI != Leaf && !Visited.contains(OpI))
+          Worklist.push_back({OpI, false});
+  }
+}
+
+GlobalVariable *MOSLookupTables::createTable(Module &M, Type *Ty,
+                                             ArrayRef<Constant *> Entries,
+                                             const Twine &Name) {
+  auto *ArrTy = ArrayType::get(Ty, Entries.size());
+  auto *Table = new GlobalVariable(M, ArrTy, /*isConstant=*/true,
+                                   GlobalValue::PrivateLinkage,
+                                   ConstantArray::get(ArrTy, Entries), Name);
+  Table->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  Table->setAlignment(Align(1));
+  Budget -= M.getDataLayout().getTypeAllocSize(ArrTy);
+  return Table;
+}
+
+// Loads the entry of Table for the byte Index.
+static Value *createLookup(IRBuilder<> &Builder, GlobalVariable *Table,
+                           Value *Index) {
+  auto *ArrTy = cast<ArrayType>(Table->getValueType());
+  const DataLayout &DL = Table->getParent()->getDataLayout();
+  Type *IndexTy = DL.getIndexType(Table->getType());
+  Value *Addr = Builder.CreateInBoundsGEP(
+      ArrTy, Table,
+      {ConstantInt::get(IndexTy, 0), Builder.CreateZExt(Index, IndexTy)});
+  return Builder.CreateAlignedLoad(ArrTy->getElementType(), Addr, Align(1),
+                                   "lookup");
+}
+
+bool MOSLookupTables::replaceFunction(Function &F) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  Type *RetTy = F.getReturnType();
+  if (F.isDeclaration() || F.isVarArg() || F.arg_size() != 1 ||
+      !F.getArg(0)->getType()->isIntegerTy(8) || !isTableType(RetTy, DL) ||
+      !F.hasExactDefinition() || F.hasOptSize() ||
+      F.hasFnAttribute("interrupt") || F.hasFnAttribute("interrupt-norecurse"))
+    return false;
+  if (256 * DL.getTypeAllocSize(RetTy) > Budget)
+    return false;
+
+  unsigned Cost = 0;
+  for (Instruction &I : instructions(F)) {
+    if (isa<DbgInfoIntrinsic>(I))
+      continue;
+    if (!I.isTerminator() && !isa<PHINode>(I) && !isEvaluable(I))
+      return false;
+    Cost += getCost(I);
+  }
+  if (Cost < TableMinCost)
+    return false;
+
+  SmallVector<Constant *> Entries;
+  for (unsigned X = 0; X < 256; ++X) {
+    Constant *Entry = toEntry(
+        evaluateFunction(F, ConstantInt::get(F.getArg(0)->getType(), X)),
+        RetTy);
+    if (!Entry) {
+      LLVM_DEBUG(dbgs() << "Could not evaluate " << F.getName() << "(" << X
+                        << ").\n");
+      return false;
+    }
+    Entries.push_back(Entry);
+  }
+
+  LLVM_DEBUG(dbgs() << "Replacing " << F.getName()
+                    << " with a lookup table.\n");
+  GlobalVariable *Table =
+      createTable(*F.getParent(), RetTy, Entries, F.getName() + ".table");
+
+  SmallVector<CallInst *> Calls;
+  for (User *U : F.users()) {
+    auto *Call = dyn_cast<CallInst>(U);
+    if (Call && Call->getCalledFunction() == &F && !Call->isMustTailCall())
+      Calls.push_back(Call);
+  }
+  for (CallInst *Call : Calls) {
+    IRBuilder<> Builder(Call);
+    Value *V = createLookup(Builder, Table, Call->getArgOperand(0));
+    V->takeName(Call);
+    Call->replaceAllUsesWith(V);
+    Call->eraseFromParent();
+  }
+
+  if (F.hasLocalLinkage() && F.use_empty()) {
+    F.eraseFromParent();
+    return true;
+  }
+
+  // Other uses remain, so the body becomes a lookup too.
+  for (BasicBlock &BB : F)
+    BB.dropAllReferences();
+  while (!F.empty())
+    F.begin()->eraseFromParent();
+  IRBuilder<> Builder(BasicBlock::Create(F.getContext(), "entry", &F));
+  Builder.CreateRet(createLookup(Builder, Table, F.getArg(0)));
+  return true;
+}
+
+bool MOSLookupTables::replaceLoopExpressions(Function &F) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+
+  // Find the byte each instruction in a loop varies with, if there's exactly
+  // one, and the weight of computing the instruction from it. Visiting blocks
+  // in reverse postorder sees operands first.
+  DenseMap<Instruction *, ExprInfo> Exprs;
+  SmallVector<Instruction *> Roots;
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT) {
+    Loop *L = LI.getLoopFor(BB);
+    if (!L)
+      continue;
+    for (Instruction &I : *BB) {
+      if (!isEvaluable(I) || !isTableType(I.getType(), DL))
+        continue;
+      Value *Leaf = nullptr;
+      unsigned Cost = getCost(I);
+      bool Valid = true;
+      for (Value *Op : I.operands()) {
+        if (isa<Constant>(Op))
+          continue;
+        Value *OpLeaf = Op;
+        auto *OpI = dyn_cast<Instruction>(Op);
+        auto It = OpI ? Exprs.find(OpI) : Exprs.end();
+        if (It != Exprs.end()) {
+          OpLeaf = It->second.Leaf;
+          Cost += It->second.Cost;
+        }
+        if (Leaf && Leaf != OpLeaf) {
+          Valid = false;
+          break;
+        }
+        Leaf = OpLeaf;
+      }
+      // The byte must vary within the loop; expressions of invariant bytes
+      // are hoisted instead.
+      auto *LeafI = dyn_cast_or_null<Instruction>(Leaf);
+      if (!Valid || !LeafI || !LeafI->getType()->isIntegerTy(8) ||
+          !L->contains(LeafI))
+        continue;
+      Exprs[&I] = {Leaf, Cost};
+      Roots.push_back(&I);
+    }
+  }
+
+  // Evaluate all of the tables before rewriting anything, since rewriting a
+  // root would hide the expressions that contain it.
+  SmallVector<std::pair<Instruction *, GlobalVariable *>> Replacements;
+  for (Instruction *Root : Roots) {
+    const ExprInfo &Info = Exprs[Root];
+    if (Info.Cost < TableMinCost ||
+        256 * DL.getTypeAllocSize(Root->getType()) > Budget)
+      continue;
+
+    // Only replace whole expressions, not parts of larger ones.
+    if (llvm::all_of(Root->users(), [&](User *U) {
+          auto It = Exprs.find(cast<Instruction>(U));
+          return It != Exprs.end() && It->second.Leaf == Info.Leaf;
+        }))
+      continue;
+
+    SmallVector<Instruction *> Expr;
+    collectExpression(Root, Info.Leaf, Expr);
+    SmallVector<Constant *> Entries;
+    for (unsigned X = 0; X < 256; ++X) {
+      DenseMap<Value *, Constant *> Vals;
+      Vals[Info.Leaf] = ConstantInt::get(Info.Leaf->getType(), X);
+      Constant *C = nullptr;
+      for (Instruction *I : Expr) {
+        C = evaluate(*I, Vals, DL);
+        if (!C)
+          break;
+        Vals[I] = C;
+      }
+      Constant *Entry = toEntry(C, Root->getType());
+      if (!Entry)
+        break;
+      Entries.push_back(Entry);
+    }
+    if (Entries.size() != 256)
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Replacing " << *Root << " with a lookup table.\n");
+    Replacements.push_back(
+        {Root, createTable(*F.getParent(), Root->getType(), Entries,
+                           F.getName() + ".table")});
+  }
+
+  SmallVector<WeakTrackingVH> Dead;
+  for (const auto &Replacement : Replacements) {
+    Instruction *Root = Replacement.first;
+    IRBuilder<> Builder(Root);
+    Value *V = createLookup(Builder, Replacement.second, Exprs[Root].Leaf);
+    V->takeName(Root);
+    Root->replaceAllUsesWith(V);
+    Dead.push_back(Root);
+  }
+  RecursivelyDeleteTriviallyDeadInstructionsPermissive(Dead);
+  return !Replacements.empty();
+}
+
+bool MOSLookupTables::runOnModule(Module &M) {
+  LLVM_DEBUG(dbgs() << "**** MOS Lookup Tables Pass ****\n");
+
+  if (MOS::wholeProgramPassesRan(M))
+    return false;
+
+  Budget = TableBudget;
+  SmallVector<Function *> Candidates;
+  for (Function &F : M)
+    Candidates.push_back(&F);
+
+  bool Changed = false;
+  for (Function *F : Candidates)
+    Changed |= replaceFunction(*F);
+
+  for (Function &F : M)
+    if (!F.isDeclaration() && !F.hasOptSize())
+      Changed |= replaceLoopExpressions(F);
+  return Changed;
+}
+
+char MOSLookupTables::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSLookupTables, DEBUG_TYPE,
+                      "Replace byte computations with lookup tables", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_END(MOSLookupTables, DEBUG_TYPE,
+                    "Replace byte computations with lookup tables", false,
+                    false)
+
+ModulePass *llvm::createMOSLookupTablesPass() { return new MOSLookupTables(); }
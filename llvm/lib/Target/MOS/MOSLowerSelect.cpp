@@ -8,6 +8,28 @@
 //
 // This file defines the MOS select pseudo lowering pass.
 //
+// Most G_SELECTs become a branch diamond. Small byte selects whose condition is
+// already in the carry flag can instead use a short branch-free sequence built
+// around ADC #0, which turns the carry into a value:
+//
+//   c ? k+1 : k          LDA #k; ADC #0                          4 cycles
+//   c ? 0 : $FF          LDA #$FF; ADC #0                        4 cycles
+//   c ? t : f            t ^ ((t ^ f) & (c ? 0 : $FF))          6+ cycles
+//
+// The diamond loads one of the values on each path:
+//
+//   Bcc true     2 not taken, 3 taken
+//   LDA f        2 immediate, 3 zero page
+//   JMP sink     3
+// true:
+//   LDA t        2 immediate, 3 zero page
+// sink:
+//
+// That's 5 cycles one way and 7 the other for two immediates; 6 on average.
+// The branch-free sequence is used if it takes no more than the average of the
+// two paths, since it's also smaller and its timing doesn't depend on the
+// condition. Both lowerings pay equally to compute the condition itself.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSLowerSelect.h"
@@ -20,11 +42,17 @@
 #include "llvm/CodeGen/MachineOperand.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/Support/CommandLine.h"
 
 #define DEBUG_TYPE "mos-lower-select"
 
 using namespace llvm;
 
+static cl::opt<bool> LowerBranchless(
+    "mos-select-branchless", cl::init(true),
+    cl::desc("Lower byte G_SELECTs without branches when it's cheaper"),
+    cl::Hidden);
+
 namespace {
 
 class MOSLowerSelect : public MachineFunctionPass {
@@ -48,6 +76,7 @@ public:
 
   bool runOnMachineFunction(MachineFunction &MF) override;
   void lowerSelect(MachineInstr &MI);
+  bool lowerSelectBranchless(MachineInstr &MI);
   void moveAwayFromCalls(MachineFunction &MF);
 };
 
@@ -143,8 +172,132 @@ void removePredecessorFromPhis(MachineBasicBlock *MBB,
         Idx += 2;
 }
 
+// Returns whether the condition of a G_SELECT can be moved into the carry flag
+// without a branch of its own. Branching on it would cost the same.
+static bool isCarryCondition(const MachineInstr &MI,
+                             const MachineRegisterInfo &MRI) {
+  Register Tst = MI.getOperand(1).getReg();
+  const MachineInstr &DefMI = *MRI.getVRegDef(Tst);
+
+  // Nothing may come between the definition of the condition and its use that
+  // could clobber the carry.
+  if (DefMI.getParent() != MI.getParent())
+    return false;
+  for (auto I = std::next(DefMI.getIterator()); &*I != &MI; ++I)
+    if (!I->isDebugInstr() && I->getOpcode() != MOS::G_CONSTANT)
+      return false;
+
+  switch (DefMI.getOpcode()) {
+  default:
+    return false;
+  case MOS::G_SBC:
+  case MOS::G_UADDE:
+  case MOS::G_USBCE:
+    // Already the carry out.
+    return DefMI.getOperand(1).getReg() == Tst;
+  case MOS::G_TRUNC:
+    // CMP #1
+    return true;
+  }
+}
+
+// Attempts to lower a byte G_SELECT to a branch-free sequence, if one is
+// estimated to be cheaper than a branch diamond.
+bool MOSLowerSelect::lowerSelectBranchless(MachineInstr &MI) {
+  assert(MI.getOpcode() == MOS::G_SELECT);
+  Register Dst = MI.getOperand(0).getReg();
+  Register Tst = MI.getOperand(1).getReg();
+  Register TrueValue = MI.getOperand(2).getReg();
+  Register FalseValue = MI.getOperand(3).getReg();
+  const MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
+
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+  if (MRI.getType(Dst) != S8)
+    return false;
+
+  if (!LowerBranchless || !isCarryCondition(MI, MRI))
+    return false;
+
+  auto TrueConst = getConstantVRegValWithLookThrough(TrueValue, MRI);
+  auto FalseConst = getConstantVRegValWithLookThrough(FalseValue, MRI);
+  const auto IsZero = [](const Optional<ValueAndVReg> &C) {
+    return C && C->Value.isNullValue();
+  };
+
+  // c ? k+1 : k => k + c
+  bool IsIncrement = TrueConst && FalseConst &&
+                     TrueConst->Value.getZExtValue() ==
+                         ((FalseConst->Value.getZExtValue() + 1) & 0xff);
+
+  // c ? t : f => t ^ ((t ^ f) & (c ? 0 : $FF))
+  Optional<uint64_t> Diff;
+  if (TrueConst && FalseConst)
+    Diff = (TrueConst->Value ^ FalseConst->Value).getZExtValue();
+
+  // Immediate operands take two cycles, and zero page operands three.
+  const auto OperandCycles = [](const Optional<ValueAndVReg> &C) -> unsigned {
+    return C ? 2 : 3;
+  };
+  unsigned Cycles = 4; // LDA #imm; ADC #0
+  if (!IsIncrement) {
+    if (!Diff && !IsZero(TrueConst) && !IsZero(FalseConst))
+      Cycles += 3; // EOR f
+    if (!Diff || *Diff != 0xff)
+      Cycles += Diff ? 2 : 3; // AND
+    if (!IsZero(TrueConst))
+      Cycles += OperandCycles(TrueConst); // EOR t
+  }
+
+  // Bcc (taken); LDA t, and Bcc (not taken); LDA f; JMP.
+  unsigned DiamondPathCycles = 3 + OperandCycles(TrueConst) + 2 +
+                               OperandCycles(FalseConst) + 3;
+  if (2 * Cycles > DiamondPathCycles) {
+    LLVM_DEBUG(dbgs() << "\tBranch-free lowering takes " << Cycles
+                      << " cycles; diamond paths total " << DiamondPathCycles
+                      << ".\n");
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "\tLowering branch-free in " << Cycles
+                    << " cycles.\n");
+  MachineIRBuilder Builder(MI);
+  auto Zero = Builder.buildConstant(S8, 0);
+  if (IsIncrement) {
+    Builder.buildInstr(MOS::G_UADDE, {Dst, S1}, {FalseValue, Zero, Tst});
+    MI.eraseFromParent();
+    return true;
+  }
+
+  Register Mask = Builder
+                      .buildInstr(MOS::G_UADDE, {S8, S1},
+                                  {Builder.buildConstant(S8, 0xff), Zero, Tst})
+                      .getReg(0);
+  Register DiffReg;
+  if (Diff)
+    DiffReg = Builder.buildConstant(S8, *Diff).getReg(0);
+  else if (IsZero(TrueConst))
+    DiffReg = FalseValue;
+  else if (IsZero(FalseConst))
+    DiffReg = TrueValue;
+  else
+    DiffReg = Builder.buildXor(S8, TrueValue, FalseValue).getReg(0);
+  Register Masked = Diff && *Diff == 0xff
+                        ? Mask
+                        : Builder.buildAnd(S8, DiffReg, Mask).getReg(0);
+  if (IsZero(TrueConst))
+    Builder.buildCopy(Dst, Masked);
+  else
+    Builder.buildXor(Dst, TrueValue, Masked);
+  MI.eraseFromParent();
+  return true;
+}
+
 void MOSLowerSelect::lowerSelect(MachineInstr &MI) {
   assert(MI.getOpcode() == MOS::G_SELECT);
+  if (lowerSelectBranchless(MI))
+    return;
+
   Register Dst = MI.getOperand(0).getReg();
   Register Tst = MI.getOperand(1).getReg();
   Register TrueValue = MI.getOperand(2).getReg();
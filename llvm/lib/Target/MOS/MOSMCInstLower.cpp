@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "MOSMCInstLower.h"
+#include "MOS.h"
 #include "MCTargetDesc/MOSMCExpr.h"
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOSInstrInfo.h"
@@ -199,10 +200,12 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     MCOperand Val;
     if (!lowerOperand(MI->getOperand(ImmIdx), Val))
       llvm_unreachable("Failed to lower operand");
+    lowerZeroPageAccess(*MI, OutMI, Val);
     OutMI.addOperand(Val);
     return;
   }
-  case MOS::LDAIdx: {
+  case MOS::LDAIdx:
+  case MOS::LDAIdxPatch: {
     switch (MI->getOperand(2).getReg()) {
     default:
       llvm_unreachable("Unexpected LDAIdx register.");
@@ -216,6 +219,7 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     MCOperand Val;
     if (!lowerOperand(MI->getOperand(1), Val))
       llvm_unreachable("Failed to lower operand");
+    lowerZeroPageAccess(*MI, OutMI, Val);
     OutMI.addOperand(Val);
     return;
   }
@@ -282,7 +286,36 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
       return;
     }
   }
-  case MOS::STIdx: {
+  case MOS::INCAbs:
+  case MOS::DECAbs:
+  case MOS::TSBAbs:
+  case MOS::TRBAbs: {
+    unsigned AddrIdx = 0;
+    switch (MI->getOpcode()) {
+    case MOS::INCAbs:
+      OutMI.setOpcode(MOS::INC_Absolute);
+      break;
+    case MOS::DECAbs:
+      OutMI.setOpcode(MOS::DEC_Absolute);
+      break;
+    case MOS::TSBAbs:
+      OutMI.setOpcode(MOS::TSB_Absolute);
+      AddrIdx = 1;
+      break;
+    case MOS::TRBAbs:
+      OutMI.setOpcode(MOS::TRB_Absolute);
+      AddrIdx = 1;
+      break;
+    }
+    MCOperand Val;
+    if (!lowerOperand(MI->getOperand(AddrIdx), Val))
+      llvm_unreachable("Failed to lower operand");
+    lowerZeroPageAccess(*MI, OutMI, Val);
+    OutMI.addOperand(Val);
+    return;
+  }
+  case MOS::STIdx:
+  case MOS::STIdxPatch: {
     switch (MI->getOperand(2).getReg()) {
     default:
       llvm_unreachable("Unexpected register.");
@@ -296,6 +329,7 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     MCOperand Val;
     if (!lowerOperand(MI->getOperand(1), Val))
       llvm_unreachable("Failed to lower operand");
+    lowerZeroPageAccess(*MI, OutMI, Val);
     OutMI.addOperand(Val);
     return;
   }
@@ -394,6 +428,62 @@ bool MOSMCInstLower::lowerOperand(const MachineOperand &MO, MCOperand &MCOp) {
   return true;
 }
 
+// Returns the zero page form of an absolute addressing mode instruction, or
+// zero if there isn't one.
+static unsigned getZeroPageOpcode(unsigned Opcode) {
+  switch (Opcode) {
+  default:
+    return 0;
+  case MOS::LDA_Absolute:
+    return MOS::LDA_ZeroPage;
+  case MOS::LDX_Absolute:
+    return MOS::LDX_ZeroPage;
+  case MOS::LDY_Absolute:
+    return MOS::LDY_ZeroPage;
+  case MOS::STA_Absolute:
+    return MOS::STA_ZeroPage;
+  case MOS::STX_Absolute:
+    return MOS::STX_ZeroPage;
+  case MOS::STY_Absolute:
+    return MOS::STY_ZeroPage;
+  case MOS::LDA_AbsoluteX:
+    return MOS::LDA_ZeroPageX;
+  case MOS::LDX_AbsoluteY:
+    return MOS::LDX_ZeroPageY;
+  case MOS::LDY_AbsoluteX:
+    return MOS::LDY_ZeroPageX;
+  case MOS::STA_AbsoluteX:
+    return MOS::STA_ZeroPageX;
+  case MOS::BIT_Absolute:
+    return MOS::BIT_ZeroPage;
+  case MOS::INC_Absolute:
+    return MOS::INC_ZeroPage;
+  case MOS::DEC_Absolute:
+    return MOS::DEC_ZeroPage;
+  case MOS::TSB_Absolute:
+    return MOS::TSB_ZeroPage;
+  case MOS::TRB_Absolute:
+    return MOS::TRB_ZeroPage;
+  }
+}
+
+// Accesses through zero page pointers use zero page addressing modes wherever
+// the 6502 has them. The address is marked as 8 bits wide so the assembler
+// doesn't relax it back to absolute when its symbol is defined elsewhere.
+void MOSMCInstLower::lowerZeroPageAccess(const MachineInstr &MI, MCInst &OutMI,
+                                         MCOperand &Addr) {
+  if (!MI.hasOneMemOperand() ||
+      (*MI.memoperands_begin())->getAddrSpace() != MOS::AS_ZeroPage)
+    return;
+  unsigned Opcode = getZeroPageOpcode(OutMI.getOpcode());
+  if (!Opcode)
+    return;
+  OutMI.setOpcode(Opcode);
+  if (Addr.isExpr())
+    Addr = MCOperand::createExpr(MOSMCExpr::create(
+        MOSMCExpr::VK_MOS_ADDR8, Addr.getExpr(), /*isNegated=*/false, Ctx));
+}
+
 const MCExpr *MOSMCInstLower::applyTargetFlags(unsigned Flags,
                                                const MCExpr *Expr) {
   switch (Flags) {
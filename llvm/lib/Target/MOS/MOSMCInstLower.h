@@ -25,6 +25,8 @@ public:
   bool lowerOperand(const MachineOperand &MO, MCOperand &MCOp);
 
 private:
+  void lowerZeroPageAccess(const MachineInstr &MI, MCInst &OutMI,
+                           MCOperand &Addr);
   const MCExpr *applyTargetFlags(unsigned Flags, const MCExpr *Expr);
 };
 
@@ -18,6 +18,14 @@
 // This pass is considerably more aggressive than LLVM's built-in NoRecurse
 // passes, as it examines the call graph SCCs themselves, not individual
 // functions in SCC order.
+//
+// Indirect calls are resolved to their !callees metadata if present. Otherwise,
+// if the module is the whole program (as under LTO), indirect calls are
+// resolved to the address-taken functions with a compatible signature. Without
+// this, every indirect call would be an edge to every address-taken function,
+// placing them all in one large SCC. A single translation unit can't be
+// resolved this way, even if it defines main, since other translation units may
+// hand it pointers to functions it can't see.
 //===----------------------------------------------------------------------===//
 
 #include "MOSNoRecurse.h"
@@ -26,8 +34,10 @@
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
-#include "llvm/LTO/LTO.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 
@@ -42,7 +52,10 @@ struct MOSNoRecurse : public ModulePass {
   SmallPtrSet<const CallGraphNode *, 8> ReachableFromMultipleInterrupts;
   SmallPtrSet<const CallGraphNode *, 8> ReachableFromCurrentNorecurseInterrupt;
   SmallPtrSet<const CallGraphNode *, 8> ReachableFromOtherNorecurseInterrupt;
-  bool HasInterrupts = false;
+
+  // Indirect calls whose edges to the calls-external node were replaced with
+  // edges to their possible callees.
+  SmallVector<std::pair<CallGraphNode *, CallBase *>> ResolvedCalls;
 
   MOSNoRecurse() : ModulePass(ID) {
     initializeMOSNoRecursePass(*PassRegistry::getPassRegistry());
@@ -51,9 +64,11 @@ struct MOSNoRecurse : public ModulePass {
   bool runOnModule(Module &M) override;
   void getAnalysisUsage(AnalysisUsage &Info) const override;
 
+  void resolveIndirectCalls(Module &M, CallGraph &CG);
+  void restoreIndirectCalls(CallGraph &CG);
   bool runOnSCC(CallGraphSCC &SCC);
-  void markReachableFromMultipleInterrupts(const CallGraphNode &CGN);
-  void visitNorecurseInterrupt(const CallGraphNode &CGN);
+  bool markReachableFromMultipleInterrupts(const CallGraphNode &CGN);
+  bool visitNorecurseInterrupt(const CallGraphNode &CGN);
 };
 
 static bool callsSelf(const CallGraphNode &N) {
@@ -63,11 +78,126 @@ static bool callsSelf(const CallGraphNode &N) {
   return false;
 }
 
+// Returns whether two types are passed the same way, allowing for the pointer
+// casts rife in C calls through function pointers.
+static bool isCompatibleType(Type *A, Type *B, const DataLayout &DL) {
+  if (A == B)
+    return true;
+  if (A->isVoidTy() || B->isVoidTy() || !A->isSized() || !B->isSized())
+    return false;
+  if (A->isPointerTy() != B->isPointerTy() ||
+      A->isFloatingPointTy() != B->isFloatingPointTy())
+    return false;
+  return DL.getTypeSizeInBits(A) == DL.getTypeSizeInBits(B);
+}
+
+static bool isCompatibleCallee(const CallBase &Call, const Function &F) {
+  FunctionType *CallTy = Call.getFunctionType();
+  FunctionType *FTy = F.getFunctionType();
+  if (CallTy == FTy)
+    return true;
+  if (CallTy->isVarArg() != FTy->isVarArg() ||
+      CallTy->getNumParams() != FTy->getNumParams())
+    return false;
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  if (!isCompatibleType(CallTy->getReturnType(), FTy->getReturnType(), DL))
+    return false;
+  for (unsigned I = 0, E = CallTy->getNumParams(); I != E; ++I)
+    if (!isCompatibleType(CallTy->getParamType(I), FTy->getParamType(I), DL))
+      return false;
+  return true;
+}
+
+// Finds the possible callees of an indirect call. Returns false if they can't
+// be determined.
+static bool getPossibleCallees(const CallBase &Call, bool IsWholeProgram,
+                               ArrayRef<Function *> AddressTaken,
+                               SmallVectorImpl<Function *> &Callees) {
+  if (MDNode *MD = Call.getMetadata(LLVMContext::MD_callees)) {
+    for (const MDOperand &Op : MD->operands()) {
+      auto *F = mdconst::dyn_extract_or_null<Function>(Op);
+      if (!F)
+        return false;
+      Callees.push_back(F);
+    }
+    return !Callees.empty();
+  }
+
+  if (!IsWholeProgram)
+    return false;
+  for (Function *F : AddressTaken)
+    if (isCompatibleCallee(Call, *F))
+      Callees.push_back(F);
+  // If nothing matches, the pointer came from somewhere unknown.
+  return !Callees.empty();
+}
+
+void MOSNoRecurse::resolveIndirectCalls(Module &M, CallGraph &CG) {
+  bool IsWholeProgram = MOS::isWholeProgram(M);
+
+  SmallVector<Function *> AddressTaken;
+  for (Function &F : M)
+    if (!F.isIntrinsic() && F.hasAddressTaken())
+      AddressTaken.push_back(&F);
+
+  CallGraphNode *CallsExternal = CG.getCallsExternalNode();
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    CallGraphNode *N = CG[&F];
+
+    SmallVector<CallBase *> IndirectCalls;
+    for (const CallGraphNode::CallRecord &CR : *N) {
+      if (CR.second != CallsExternal || !CR.first)
+        continue;
+      Value *V = *CR.first;
+      auto *Call = dyn_cast_or_null<CallBase>(V);
+      if (Call && Call->isIndirectCall())
+        IndirectCalls.push_back(Call);
+    }
+
+    for (CallBase *Call : IndirectCalls) {
+      SmallVector<Function *> Callees;
+      if (!getPossibleCallees(*Call, IsWholeProgram, AddressTaken, Callees))
+        continue;
+
+      LLVM_DEBUG(dbgs() << "Resolved indirect call in " << F.getName()
+                        << " to " << Callees.size() << " callees.\n");
+      N->removeCallEdgeFor(*Call);
+      for (Function *Callee : Callees)
+        N->addCalledFunction(Call, CG.getOrInsertFunction(Callee));
+      ResolvedCalls.push_back({N, Call});
+    }
+  }
+}
+
+void MOSNoRecurse::restoreIndirectCalls(CallGraph &CG) {
+  for (const auto &Resolved : ResolvedCalls) {
+    CallGraphNode *N = Resolved.first;
+    CallBase *Call = Resolved.second;
+    for (auto I = N->begin(); I != N->end();) {
+      if (I->first && static_cast<Value *>(*I->first) == Call)
+        N->removeCallEdge(I);
+      else
+        ++I;
+    }
+    N->addCalledFunction(Call, CG.getCallsExternalNode());
+  }
+  ResolvedCalls.clear();
+}
+
 bool MOSNoRecurse::runOnModule(Module &M) {
   LLVM_DEBUG(dbgs() << "**** MOS NoRecurse Pass ****\n");
 
+  if (MOS::wholeProgramPassesRan(M))
+    return false;
+
   CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
 
+  // Narrow indirect calls to the functions they can actually reach.
+  resolveIndirectCalls(M, CG);
+
   // For the conservative recursion analysis, any external call may call any
   // externally-callable function so add an edge from the calls-external node
   // to the called-by-external node.
@@ -87,45 +217,25 @@ bool MOSNoRecurse::runOnModule(Module &M) {
   // Mark all functions reachable from an interrupt function as possibly
   // recursive.
   for (Function &F : M.functions()) {
-    if (F.hasFnAttribute("interrupt")) {
-      HasInterrupts = true;
-      markReachableFromMultipleInterrupts(*CG[&F]);
-    }
+    if (F.hasFnAttribute("interrupt"))
+      Changed |= markReachableFromMultipleInterrupts(*CG[&F]);
   }
 
   // Mark all functions reachable from multiple interrupt-norecurse functions as
   // possibly recursive.
   for (Function &F : M.functions()) {
     if (F.hasFnAttribute("interrupt-norecurse") || F.getName() == "main") {
-      if (F.hasFnAttribute("interrupt-norecurse"))
-        HasInterrupts = true;
-      visitNorecurseInterrupt(*CG[&F]);
+      Changed |= visitNorecurseInterrupt(*CG[&F]);
       for (const auto *CGN : ReachableFromCurrentNorecurseInterrupt)
         ReachableFromOtherNorecurseInterrupt.insert(CGN);
       ReachableFromCurrentNorecurseInterrupt.clear();
     }
   }
 
-  if (HasInterrupts) {
-    Changed = true;
-
-    // Mark all libcalls as possibly recursive if we have interrupts, since
-    // there's no way to tell which will actually be called by an interrupt
-    // before the interrupt is compiled. But the compilation of the interrupt
-    // depends on whether or not it's norecurse, so we don't have much choice
-    // other than making the conservative assumption here.
-    for (const char *LibcallName : lto::LTO::getRuntimeLibcallSymbols()) {
-      Function *Libcall = M.getFunction(LibcallName);
-      if (Libcall && !Libcall->isDeclaration() && Libcall->doesNotRecurse()) {
-        LLVM_DEBUG(dbgs() << "Marking libcall as possibly recursive: "
-                          << Libcall->getName() << "\n");
-        Libcall->removeFnAttr(Attribute::NoRecurse);
-      }
-    }
-  }
-
-  // Remove the artificial edge.
+  // Remove the artificial edge and restore the call graph's view of indirect
+  // calls.
   CG.getCallsExternalNode()->removeAllCalledFunctions();
+  restoreIndirectCalls(CG);
   return Changed;
 }
 
@@ -163,31 +273,37 @@ bool MOSNoRecurse::runOnSCC(CallGraphSCC &SCC) {
   return true;
 }
 
-void MOSNoRecurse::markReachableFromMultipleInterrupts(
+bool MOSNoRecurse::markReachableFromMultipleInterrupts(
     const CallGraphNode &CGN) {
   if (ReachableFromMultipleInterrupts.contains(&CGN))
-    return;
+    return false;
   ReachableFromMultipleInterrupts.insert(&CGN);
 
+  bool Changed = false;
   Function *F = CGN.getFunction();
   if (F && !F->isDeclaration()) {
     LLVM_DEBUG(dbgs() << "Marking reachable from interrupt: " << F->getName()
                       << "\n");
-    if (F->doesNotRecurse())
+    if (F->doesNotRecurse()) {
       F->removeFnAttr(Attribute::NoRecurse);
+      Changed = true;
+    }
   }
 
   for (const auto &CallRecord : CGN)
-    markReachableFromMultipleInterrupts(*CallRecord.second);
+    Changed |= markReachableFromMultipleInterrupts(*CallRecord.second);
+  return Changed;
 }
 
-void MOSNoRecurse::visitNorecurseInterrupt(const CallGraphNode &CGN) {
+bool MOSNoRecurse::visitNorecurseInterrupt(const CallGraphNode &CGN) {
   if (ReachableFromMultipleInterrupts.contains(&CGN))
-    return;
+    return false;
   if (ReachableFromCurrentNorecurseInterrupt.contains(&CGN))
-    return;
+    return false;
   ReachableFromCurrentNorecurseInterrupt.insert(&CGN);
 
+  bool Changed = false;
+
   Function *F = CGN.getFunction();
   if (F && !F->isDeclaration() &&
       ReachableFromOtherNorecurseInterrupt.contains(&CGN)) {
@@ -195,11 +311,14 @@ void MOSNoRecurse::visitNorecurseInterrupt(const CallGraphNode &CGN) {
         dbgs() << "Marking reachable from multiple norecurse interrupts: "
                << F->getName() << "\n");
     ReachableFromMultipleInterrupts.insert(&CGN);
-    if (F->doesNotRecurse())
+    if (F->doesNotRecurse()) {
       F->removeFnAttr(Attribute::NoRecurse);
+      Changed = true;
+    }
   }
   for (const auto &CallRecord : CGN)
-    visitNorecurseInterrupt(*CallRecord.second);
+    Changed |= visitNorecurseInterrupt(*CallRecord.second);
+  return Changed;
 }
 } // namespace
 
@@ -0,0 +1,261 @@
+//===-- MOSPageCross.cpp - MOS Page Crossing Avoidance --------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS page crossing avoidance pass.
+//
+// On the 6502, an indexed access whose effective address lies in a different
+// page than its base address takes an extra cycle, as does a taken branch to a
+// different page. This pass marks the objects for which this matters:
+//
+//  - Tables of at most 256 bytes accessed through an absolute indexed
+//    addressing mode.
+//  - Functions that fit within a page and contain a hot loop.
+//
+// Marked objects are given sections of their own with the SHF_MOS_NOPAGECROSS
+// flag, which the linker keeps from straddling a page boundary. This costs
+// padding only where an object would actually cross a page.
+//
+// Hot loops in functions too large to fit in a page are instead aligned to the
+// next power of two above their size, provided that's small enough that the
+// padding is worth it. A block that falls into the loop would execute the
+// padding as NOPs, so it jumps over the padding instead when that's cheaper.
+// Either way, each entry through that block pays for the alignment, while
+// each iteration saves at most one cycle, so the loop is only aligned if it
+// iterates often enough. Since this changes branch distances, this pass runs
+// before branch relaxation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSPageCross.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+
+#define DEBUG_TYPE "mos-page-cross"
+
+using namespace llvm;
+
+static cl::opt<unsigned> HotLoopThreshold(
+    "mos-hot-loop-threshold", cl::init(8),
+    cl::desc("Minimum frequency of a loop header relative to the function "
+             "entry for the loop to be kept within a page"),
+    cl::Hidden);
+
+static cl::opt<unsigned> MaxLoopAlign(
+    "mos-max-loop-align", cl::init(64),
+    cl::desc("Maximum alignment given to a hot loop to keep it within a page"),
+    cl::Hidden);
+
+namespace {
+
+constexpr uint64_t PageSize = 256;
+
+class MOSPageCross : public MachineFunctionPass {
+public:
+  static char ID;
+
+  MOSPageCross() : MachineFunctionPass(ID) {
+    llvm::initializeMOSPageCrossPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  bool markIndexedTables(MachineFunction &MF);
+  bool placeHotLoops(MachineFunction &MF);
+};
+
+void MOSPageCross::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineLoopInfo>();
+  AU.addRequired<MachineBlockFrequencyInfo>();
+  AU.setPreservesAll();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+bool MOSPageCross::runOnMachineFunction(MachineFunction &MF) {
+  bool Changed = markIndexedTables(MF);
+  Changed |= placeHotLoops(MF);
+  return Changed;
+}
+
+bool MOSPageCross::markIndexedTables(MachineFunction &MF) {
+  const DataLayout &DL = MF.getDataLayout();
+
+  bool Changed = false;
+  for (const MachineBasicBlock &MBB : MF) {
+    for (const MachineInstr &MI : MBB) {
+      switch (MI.getOpcode()) {
+      default:
+        continue;
+      case MOS::LDAIdx:
+      case MOS::LDXIdx:
+      case MOS::LDYIdx:
+      case MOS::STIdx:
+        break;
+      }
+      const MachineOperand &Addr = MI.getOperand(1);
+      if (!Addr.isGlobal())
+        continue;
+      // Aliases and the like can't be given sections of their own.
+      auto *GV = dyn_cast<GlobalVariable>(
+          const_cast<GlobalValue *>(Addr.getGlobal()));
+      if (!GV || GV->isDeclaration() || GV->hasSection() ||
+          GV->getAddressSpace() == MOS::AS_ZeroPage ||
+          GV->hasAttribute(MOS::NoPageCrossAttr))
+        continue;
+      uint64_t Size = DL.getTypeAllocSize(GV->getValueType());
+      if (Size < 2 || Size > PageSize)
+        continue;
+
+      LLVM_DEBUG(dbgs() << "Keeping indexed table " << GV->getName()
+                        << " within a page.\n");
+      GV->addAttribute(MOS::NoPageCrossAttr);
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+static uint64_t getBlockSize(const MachineBasicBlock &MBB,
+                             const TargetInstrInfo &TII) {
+  uint64_t Size = 0;
+  for (const MachineInstr &MI : MBB)
+    Size += TII.getInstSizeInBytes(MI);
+  return Size;
+}
+
+// Returns the size of the loop if its blocks are laid out contiguously
+// starting at its top block, or zero otherwise.
+static uint64_t getContiguousLoopSize(MachineLoop &L,
+                                      const TargetInstrInfo &TII) {
+  const MachineBasicBlock *Top = L.getTopBlock();
+  const MachineFunction &MF = *Top->getParent();
+
+  uint64_t Size = 0;
+  unsigned NumBlocks = 0;
+  for (auto I = Top->getIterator(), E = MF.end();
+       I != E && L.contains(&*I); ++I) {
+    Size += getBlockSize(*I, TII);
+    ++NumBlocks;
+  }
+  return NumBlocks == L.getNumBlocks() ? Size : 0;
+}
+
+bool MOSPageCross::placeHotLoops(MachineFunction &MF) {
+  if (MF.getFunction().hasSection() || MF.getFunction().hasComdat())
+    return false;
+
+  auto &MLI = getAnalysis<MachineLoopInfo>();
+  const auto &MBFI = getAnalysis<MachineBlockFrequencyInfo>();
+  const MachineBranchProbabilityInfo &MBPI = *MBFI.getMBPI();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+
+  SmallVector<MachineLoop *> HotLoops;
+  SmallVector<MachineLoop *> Worklist(MLI.begin(), MLI.end());
+  while (!Worklist.empty()) {
+    MachineLoop *L = Worklist.pop_back_val();
+    if (!L->isInnermost()) {
+      Worklist.append(L->begin(), L->end());
+      continue;
+    }
+    if (MBFI.getBlockFreqRelativeToEntryBlock(L->getHeader()) >=
+        HotLoopThreshold)
+      HotLoops.push_back(L);
+  }
+  if (HotLoops.empty())
+    return false;
+
+  // getInstSizeInBytes overestimates, so a function that appears to fit in a
+  // page certainly does.
+  uint64_t FunctionSize = 0;
+  for (const MachineBasicBlock &MBB : MF)
+    FunctionSize += getBlockSize(MBB, TII);
+  if (FunctionSize <= PageSize) {
+    LLVM_DEBUG(dbgs() << "Keeping " << MF.getName() << " within a page.\n");
+    MF.getFunction().addFnAttr(MOS::NoPageCrossAttr);
+    return true;
+  }
+
+  // An aligned block no larger than its alignment can't cross a page, so long
+  // as the alignment is no larger than a page.
+  bool Changed = false;
+  for (MachineLoop *L : HotLoops) {
+    uint64_t Size = getContiguousLoopSize(*L, TII);
+    if (!Size || PowerOf2Ceil(Size) > MaxLoopAlign)
+      continue;
+    MachineBasicBlock *Top = L->getTopBlock();
+    Align A(PowerOf2Ceil(Size));
+    if (Top->getAlignment() >= A)
+      continue;
+
+    // Each iteration of the loop takes its back edge once.
+    MachineBasicBlock *Header = L->getHeader();
+    BlockFrequency Entries;
+    for (MachineBasicBlock *Pred : Header->predecessors())
+      if (!L->contains(Pred))
+        Entries += MBFI.getBlockFreq(Pred) *
+                   MBPI.getEdgeProbability(Pred, Header);
+    uint64_t Iterations =
+        (MBFI.getBlockFreq(Header) - Entries).getFrequency();
+
+    // The worst-case padding takes two cycles per NOP byte, and a JMP over it
+    // takes three.
+    MachineBasicBlock *Prev = Top->getPrevNode();
+    bool FallsIn = Prev && Prev->isSuccessor(Top) && Prev->canFallThrough();
+    uint64_t PaddingCycles = 2 * (A.value() - 1);
+    bool JumpOver = FallsIn && PaddingCycles > 3;
+    if (FallsIn) {
+      uint64_t FallInFreq =
+          (MBFI.getBlockFreq(Prev) * MBPI.getEdgeProbability(Prev, Top))
+              .getFrequency();
+      if (FallInFreq * std::min<uint64_t>(PaddingCycles, 3) >= Iterations) {
+        LLVM_DEBUG(dbgs() << "Hot loop at " << printMBBReference(*Top)
+                          << " iterates too rarely to align.\n");
+        continue;
+      }
+    }
+
+    LLVM_DEBUG(dbgs() << "Aligning hot loop at " << printMBBReference(*Top)
+                      << " to " << A.value() << " bytes.\n");
+    Top->setAlignment(A);
+    if (JumpOver)
+      TII.insertBranch(*Prev, Top, nullptr, {}, DebugLoc());
+    Changed = true;
+  }
+  return Changed;
+}
+
+} // namespace
+
+char MOSPageCross::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSPageCross, DEBUG_TYPE,
+                      "Keep tables and hot loops within a page", false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(MOSPageCross, DEBUG_TYPE,
+                    "Keep tables and hot loops within a page", false, false)
+
+MachineFunctionPass *llvm::createMOSPageCrossPass() {
+  return new MOSPageCross();
+}
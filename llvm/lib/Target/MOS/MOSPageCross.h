@@ -0,0 +1,24 @@
+//===-- MOSPageCross.h - MOS Page Crossing Avoidance ------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS page crossing avoidance pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSPAGECROSS_H
+#define LLVM_LIB_TARGET_MOS_MOSPAGECROSS_H
+
+#include "llvm/CodeGen/MachineFunctionPass.h"
+
+namespace llvm {
+
+MachineFunctionPass *createMOSPageCrossPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSPAGECROSS_H
@@ -15,6 +15,10 @@
 #include "MOSFrameLowering.h"
 #include "MOSInstrInfo.h"
 #include "MOSSubtarget.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallSet.h"
+#include "llvm/CodeGen/LiveInterval.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineOperand.h"
@@ -22,10 +26,13 @@
 #include "llvm/CodeGen/TargetFrameLowering.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
+#include "llvm/CodeGen/VirtRegMap.h"
 #include "llvm/IR/CallingConv.h"
 #include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <numeric>
+
 #define DEBUG_TYPE "mos-reginfo"
 
 #define GET_REGINFO_TARGET_DESC
@@ -503,6 +510,193 @@ bool MOSRegisterInfo::shouldCoalesce(
   return true;
 }
 
+// Returns the fewest instructions needed to copy between R and some register
+// in RC, in the direction given by IsDef, or None if RC has no usable register.
+static Optional<unsigned> getCopyCostToClass(const MOSRegisterInfo &TRI,
+                                             const MachineRegisterInfo &MRI,
+                                             MCPhysReg R, bool IsDef,
+                                             const TargetRegisterClass &RC) {
+  if (RC.contains(R))
+    return 0;
+  Optional<unsigned> MinCost;
+  for (MCPhysReg P : RC) {
+    if (MRI.isReserved(P))
+      continue;
+    unsigned Cost = IsDef ? TRI.getCopyCost(R, P) : TRI.getCopyCost(P, R);
+    if (!MinCost || Cost < *MinCost)
+      MinCost = Cost;
+    if (*MinCost <= 1)
+      break;
+  }
+  return MinCost;
+}
+
+// Collects the register classes required by the operands that read the value
+// of Reg, looking through copies into other unassigned virtual registers,
+// since those copies may yet be coalesced. This is how an index operand asks
+// for X or Y and a dereferenced pointer for an Imag16 register.
+static void
+collectUseConstraints(Register Reg, const MachineFunction &MF,
+                      const VirtRegMap *VRM, SmallSet<Register, 8> &Visited,
+                      SmallVectorImpl<const TargetRegisterClass *> &Classes) {
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetSubtargetInfo &STI = MF.getSubtarget();
+  const TargetInstrInfo &TII = *STI.getInstrInfo();
+  const TargetRegisterInfo &TRI = *STI.getRegisterInfo();
+  if (!Visited.insert(Reg).second)
+    return;
+
+  for (const MachineOperand &MO : MRI.use_nodbg_operands(Reg)) {
+    if (MO.getSubReg())
+      continue;
+    const MachineInstr &MI = *MO.getParent();
+    if (MI.isCopy()) {
+      Register Dst = MI.getOperand(0).getReg();
+      if (Dst.isVirtual() && !MI.getOperand(0).getSubReg() &&
+          !(VRM && VRM->hasPhys(Dst)))
+        collectUseConstraints(Dst, MF, VRM, Visited, Classes);
+      continue;
+    }
+    const TargetRegisterClass *RC =
+        MI.getRegClassConstraint(MI.getOperandNo(&MO), &TII, &TRI);
+    if (RC && !is_contained(Classes, RC))
+      Classes.push_back(RC);
+  }
+}
+
+// Steer virtual registers toward registers that make the copies they take part
+// in cheap. Copies on the 6502 vary widely in cost: A to X is one instruction,
+// X to Y goes through A, one imaginary register to another goes through a GPR,
+// and a bit copied into V takes a push, pull, and select. The generic hints only
+// ask for the copy to be coalesced away entirely.
+bool MOSRegisterInfo::getRegAllocationHints(Register VirtReg,
+                                            ArrayRef<MCPhysReg> Order,
+                                            SmallVectorImpl<MCPhysReg> &Hints,
+                                            const MachineFunction &MF,
+                                            const VirtRegMap *VRM,
+                                            const LiveRegMatrix *Matrix) const {
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  bool BaseImplRetVal = TargetRegisterInfo::getRegAllocationHints(
+      VirtReg, Order, Hints, MF, VRM, Matrix);
+
+  // The total cost of the copies involving VirtReg if it were assigned each
+  // register in Order.
+  SmallVector<unsigned> Costs(Order.size());
+  bool HasCosts = false;
+  for (const MachineInstr &MI : MRI.reg_nodbg_instructions(VirtReg)) {
+    if (!MI.isCopy() || MI.getOperand(0).getSubReg() ||
+        MI.getOperand(1).getSubReg())
+      continue;
+    bool IsDef = MI.getOperand(0).getReg() == VirtReg;
+    Register Other = MI.getOperand(IsDef ? 1 : 0).getReg();
+    if (Other == VirtReg)
+      continue;
+    if (Other.isVirtual() && VRM && VRM->hasPhys(Other))
+      Other = VRM->getPhys(Other);
+    HasCosts = true;
+
+    for (unsigned I = 0, E = Order.size(); I != E; ++I) {
+      Register R = Order[I];
+      if (Other.isPhysical()) {
+        Costs[I] += IsDef ? getCopyCost(R, Other) : getCopyCost(Other, R);
+        continue;
+      }
+
+      // The other register is yet to be allocated; assume it'll be allocated
+      // as well as it can be.
+      if (Optional<unsigned> Cost = getCopyCostToClass(
+              *this, MRI, R, IsDef, *MRI.getRegClass(Other)))
+        Costs[I] += *Cost;
+    }
+  }
+
+  // Each use that requires a particular class, directly or through copies,
+  // costs a copy out of any register outside of it.
+  SmallSet<Register, 8> Visited;
+  SmallVector<const TargetRegisterClass *> UseClasses;
+  collectUseConstraints(VirtReg, MF, VRM, Visited, UseClasses);
+  for (const TargetRegisterClass *RC : UseClasses) {
+    for (unsigned I = 0, E = Order.size(); I != E; ++I) {
+      Optional<unsigned> Cost =
+          getCopyCostToClass(*this, MRI, Order[I], /*IsDef=*/false, *RC);
+      if (Cost && *Cost) {
+        Costs[I] += *Cost;
+        HasCosts = true;
+      }
+    }
+  }
+  if (!HasCosts)
+    return BaseImplRetVal;
+
+  // Hint the registers in increasing order of cost. Registers that cost as
+  // much as the worst are no better than the rest of the allocation order.
+  unsigned MaxCost = *std::max_element(Costs.begin(), Costs.end());
+  SmallVector<unsigned> Indices(Order.size());
+  std::iota(Indices.begin(), Indices.end(), 0);
+  llvm::stable_sort(Indices,
+                    [&](unsigned A, unsigned B) { return Costs[A] < Costs[B]; });
+  for (unsigned I : Indices) {
+    if (Costs[I] == MaxCost)
+      break;
+    MCPhysReg R = Order[I];
+    if (!MRI.isReserved(R) && !is_contained(Hints, R))
+      Hints.push_back(R);
+  }
+  return BaseImplRetVal;
+}
+
+bool MOSRegisterInfo::shouldRegionSplitForVirtReg(
+    const MachineFunction &MF, const LiveInterval &VirtReg) const {
+  // Region splitting inserts copies at region boundaries, and these are
+  // expensive on the 6502. Rematerializing a value is never more expensive
+  // than copying it, so leave rematerializable values to the spiller, which
+  // will rematerialize them instead.
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  const MachineInstr *MI = MF.getRegInfo().getUniqueVRegDef(VirtReg.reg());
+  if (MI && TII.isTriviallyReMaterializable(*MI))
+    return false;
+  return TargetRegisterInfo::shouldRegionSplitForVirtReg(MF, VirtReg);
+}
+
+// This mirrors the expansions in MOSInstrInfo::copyPhysRegImpl.
+unsigned MOSRegisterInfo::getCopyCost(Register Dst, Register Src) const {
+  if (Dst == Src)
+    return 0;
+
+  const auto &IsGPR = [](Register R) { return MOS::GPRRegClass.contains(R); };
+  const auto &IsImag8 = [](Register R) {
+    return MOS::Imag8RegClass.contains(R);
+  };
+
+  // TAX, TXA, etc. X and Y are copied through A.
+  if (IsGPR(Dst) && IsGPR(Src))
+    return Dst == MOS::A || Src == MOS::A ? 1 : 2;
+  // STA zp, LDA zp, etc.
+  if ((IsGPR(Dst) && IsImag8(Src)) || (IsImag8(Dst) && IsGPR(Src)))
+    return 1;
+  // Through a GPR.
+  if (IsImag8(Dst) && IsImag8(Src))
+    return 2;
+  // Two Imag8 copies.
+  if (MOS::Imag16RegClass.contains(Dst) && MOS::Imag16RegClass.contains(Src))
+    return 4;
+
+  if (MOS::Anyi1RegClass.contains(Dst) && MOS::Anyi1RegClass.contains(Src)) {
+    Register Dst8 = getMatchingSuperReg(Dst, MOS::sublsb, &MOS::Anyi8RegClass);
+    Register Src8 = getMatchingSuperReg(Src, MOS::sublsb, &MOS::Anyi8RegClass);
+    if (Dst8 && Src8)
+      return getCopyCost(Dst8, Src8);
+    // PHA, PLA, and a select.
+    if (Dst == MOS::V)
+      return 4;
+    // A compare or a select, possibly with a copy.
+    return 3;
+  }
+
+  // Nothing cheaper is known.
+  return 4;
+}
+
 void MOSRegisterInfo::reserveAllSubregs(BitVector *Reserved,
                                         Register Reg) const {
   for (Register R : subregs_inclusive(Reg))
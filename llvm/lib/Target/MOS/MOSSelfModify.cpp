@@ -0,0 +1,177 @@
+//===-- MOSSelfModify.cpp - MOS Self-Modifying Code Pass ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS self-modifying code pass.
+//
+// Functions with the "mos-self-modifying" attribute are meant to run from RAM.
+// In such functions, this pass rewrites (zp),Y accesses in loops whose pointer
+// is loop-invariant into abs,X or abs,Y accesses. The pointer is stored into
+// the operand field of the access in the preheader of the outermost loop it's
+// invariant in. This frees the imaginary pointer register for the duration of
+// the loop and saves a cycle per access.
+//
+// Each patched access carries a label, which the patching stores refer to. The
+// patched instructions thus can't be duplicated, and the code must be linked at
+// the address it runs from. Since the operand is shared by every activation of
+// the function, only non-recursive functions are handled.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSelfModify.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Target/TargetMachine.h"
+
+#define DEBUG_TYPE "mos-self-modify"
+
+using namespace llvm;
+
+namespace {
+
+class MOSSelfModify : public MachineFunctionPass {
+public:
+  static char ID;
+
+  MOSSelfModify() : MachineFunctionPass(ID) {
+    llvm::initializeMOSSelfModifyPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  bool patchAccess(MachineInstr &MI, unsigned Num);
+};
+
+void MOSSelfModify::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineLoopInfo>();
+  AU.addPreserved<MachineLoopInfo>();
+  AU.setPreservesCFG();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+bool MOSSelfModify::runOnMachineFunction(MachineFunction &MF) {
+  const Function &F = MF.getFunction();
+  if (!F.hasFnAttribute(MOS::SelfModifyingAttr))
+    return false;
+  if (!F.doesNotRecurse()) {
+    LLVM_DEBUG(dbgs() << F.getName()
+                      << " may recurse; not patching its accesses.\n");
+    return false;
+  }
+
+  SmallVector<MachineInstr *> Accesses;
+  for (MachineBasicBlock &MBB : MF)
+    for (MachineInstr &MI : MBB)
+      if (MI.getOpcode() == MOS::LDYIndir || MI.getOpcode() == MOS::STYIndir)
+        Accesses.push_back(&MI);
+
+  unsigned NumPatched = 0;
+  for (MachineInstr *MI : Accesses)
+    if (patchAccess(*MI, NumPatched))
+      ++NumPatched;
+  return NumPatched;
+}
+
+// Rewrites MI into an absolute indexed access patched in a loop preheader, if
+// its pointer is invariant in a loop containing it. Num distinguishes the
+// labels of the accesses patched within the function.
+bool MOSSelfModify::patchAccess(MachineInstr &MI, unsigned Num) {
+  MachineFunction &MF = *MI.getMF();
+  MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+
+  // Volatile accesses keep a zero index; see selectLoadStore.
+  if (!MI.hasOneMemOperand() || (*MI.memoperands_begin())->isVolatile())
+    return false;
+
+  Register Base = MI.getOperand(1).getReg();
+  Register Offset = MI.getOperand(2).getReg();
+  if (!Base.isVirtual())
+    return false;
+  MachineBasicBlock *BaseMBB = MRI.getVRegDef(Base)->getParent();
+
+  MachineLoop *L = MLI.getLoopFor(MI.getParent());
+  if (!L || L->contains(BaseMBB))
+    return false;
+  while (L->getParentLoop() && !L->getParentLoop()->contains(BaseMBB))
+    L = L->getParentLoop();
+  MachineBasicBlock *Preheader = L->getLoopPreheader();
+  if (!Preheader)
+    return false;
+
+  std::string Name =
+      (MF.getTarget().getMCAsmInfo()->getPrivateLabelPrefix() + "smc" +
+       Twine(MF.getFunctionNumber()) + "_" + Twine(Num))
+          .str();
+  const char *Label = MF.createExternalSymbolName(Name);
+  LLVM_DEBUG(dbgs() << "Patching " << MI << " at " << Label << " in "
+                    << printMBBReference(*Preheader) << ".\n");
+
+  // Store each byte of the pointer into the operand field, which follows the
+  // opcode byte.
+  MRI.clearKillFlags(Base);
+  auto InsertPt = Preheader->getFirstTerminator();
+  for (unsigned Byte : {0, 1}) {
+    Register Val = MRI.createVirtualRegister(&MOS::GPRRegClass);
+    BuildMI(*Preheader, InsertPt, MI.getDebugLoc(), TII.get(MOS::COPY), Val)
+        .addReg(Base, 0, Byte ? MOS::subhi : MOS::sublo);
+    MachineOperand Addr = MachineOperand::CreateES(Label);
+    Addr.setOffset(1 + Byte);
+    BuildMI(*Preheader, InsertPt, MI.getDebugLoc(), TII.get(MOS::STAbs))
+        .addUse(Val)
+        .add(Addr);
+  }
+
+  // The operand's initial value is never used; the label's own address just
+  // keeps the assembler from choosing a zero page form.
+  bool IsLoad = MI.getOpcode() == MOS::LDYIndir;
+  auto Patched =
+      BuildMI(*MI.getParent(), MI, MI.getDebugLoc(),
+              TII.get(IsLoad ? MOS::LDAIdxPatch : MOS::STIdxPatch));
+  if (IsLoad)
+    Patched.addDef(MI.getOperand(0).getReg());
+  else
+    Patched.addUse(MI.getOperand(0).getReg());
+  Patched.addExternalSymbol(Label).addUse(Offset).cloneMemRefs(MI);
+  Patched->setPreInstrSymbol(MF, MF.getContext().getOrCreateSymbol(Label));
+  MI.eraseFromParent();
+
+  // The index no longer has to be Y.
+  MRI.recomputeRegClass(Offset);
+  return true;
+}
+
+} // namespace
+
+char MOSSelfModify::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSSelfModify, DEBUG_TYPE,
+                      "Patch loop-invariant pointers into RAM-resident code",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_END(MOSSelfModify, DEBUG_TYPE,
+                    "Patch loop-invariant pointers into RAM-resident code",
+                    false, false)
+
+MachineFunctionPass *llvm::createMOSSelfModifyPass() {
+  return new MOSSelfModify();
+}
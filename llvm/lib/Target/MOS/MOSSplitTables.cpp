@@ -0,0 +1,285 @@
+//===-- MOSSplitTables.cpp - MOS Table Splitting Pass ---------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS table splitting pass.
+//
+// This pass splits internal arrays of multi-byte elements into parallel arrays
+// of bytes, one per byte of the element. Each access to a 16-bit table entry
+// then becomes a pair of 8-bit indexed loads or stores ("LDA lo,X; LDA hi,X")
+// sharing a single unscaled index, instead of a 16-bit multiply-and-add of the
+// index followed by an indirect access.
+//
+// This is only done for arrays of at most 256 elements (so the index fits in
+// X or Y) whose every use is a simple load or store of an element or of one
+// integer field of a struct element. The pass runs on the full module during
+// LTO code generation, where most globals have been internalized.
+//===----------------------------------------------------------------------===//
+
+#include "MOSSplitTables.h"
+
+#include "MOS.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-split-tables"
+
+using namespace llvm;
+
+namespace {
+
+// Tables with more elements than this can't be indexed by an 8-bit register.
+constexpr uint64_t MaxNumElements = 256;
+
+// Elements wider than this are left alone; each byte costs another array.
+constexpr uint64_t MaxElementSize = 4;
+
+// A load or store of one element (or one field of a struct element) of a
+// table.
+struct TableAccess {
+  Instruction *I;
+  Value *Index;
+  uint64_t Offset;
+};
+
+struct MOSSplitTables : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSSplitTables() : ModulePass(ID) {
+    initializeMOSSplitTablesPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+static bool isSplittableInteger(Type *Ty) {
+  return Ty->isIntegerTy() && Ty->getIntegerBitWidth() % 8 == 0;
+}
+
+static bool isSplittableElement(Type *Ty, const DataLayout &DL) {
+  uint64_t Size = DL.getTypeAllocSize(Ty);
+  if (Size < 2 || Size > MaxElementSize)
+    return false;
+  if (isSplittableInteger(Ty))
+    return true;
+  auto *STy = dyn_cast<StructType>(Ty);
+  return STy && !STy->isOpaque() && llvm::all_of(STy->elements(), [](Type *T) {
+           return isSplittableInteger(T);
+         });
+}
+
+// Finds all accesses to the table GV. Returns false if any use of GV isn't an
+// access to a single element or field.
+static bool collectAccesses(GlobalVariable &GV,
+                            SmallVectorImpl<TableAccess> &Accesses) {
+  const DataLayout &DL = GV.getParent()->getDataLayout();
+  auto *ArrTy = cast<ArrayType>(GV.getValueType());
+  Type *ElemTy = ArrTy->getElementType();
+
+  for (User *U : GV.users()) {
+    auto *GEP = dyn_cast<GEPOperator>(U);
+    if (!GEP || GEP->getPointerOperand() != &GV ||
+        GEP->getSourceElementType() != ArrTy || GEP->getNumIndices() < 2)
+      return false;
+
+    auto *Zero = dyn_cast<ConstantInt>(GEP->getOperand(1));
+    if (!Zero || !Zero->isZero())
+      return false;
+    Value *Index = GEP->getOperand(2);
+
+    uint64_t Offset = 0;
+    Type *AccessTy = ElemTy;
+    if (auto *STy = dyn_cast<StructType>(ElemTy)) {
+      if (GEP->getNumIndices() != 3)
+        return false;
+      unsigned Field = cast<ConstantInt>(GEP->getOperand(3))->getZExtValue();
+      Offset = DL.getStructLayout(STy)->getElementOffset(Field);
+      AccessTy = STy->getElementType(Field);
+    } else if (GEP->getNumIndices() != 2) {
+      return false;
+    }
+
+    for (User *GEPUser : GEP->users()) {
+      if (auto *LI = dyn_cast<LoadInst>(GEPUser)) {
+        if (!LI->isSimple() || LI->getType() != AccessTy)
+          return false;
+      } else if (auto *SI = dyn_cast<StoreInst>(GEPUser)) {
+        if (!SI->isSimple() || SI->getPointerOperand() != GEP ||
+            SI->getValueOperand()->getType() != AccessTy)
+          return false;
+      } else {
+        return false;
+      }
+      Accesses.push_back({cast<Instruction>(GEPUser), Index, Offset});
+    }
+  }
+  return true;
+}
+
+// Returns the initializer for the array holding byte Byte of each element of
+// the table GV, or nullptr if the initializer can't be split.
+static Constant *getPlaneInitializer(GlobalVariable &GV, uint64_t Byte) {
+  const DataLayout &DL = GV.getParent()->getDataLayout();
+  auto *ArrTy = cast<ArrayType>(GV.getValueType());
+  Constant *Init = GV.getInitializer();
+
+  SmallVector<uint8_t> Bytes;
+  for (uint64_t I = 0, E = ArrTy->getNumElements(); I != E; ++I) {
+    Constant *Field = Init->getAggregateElement(I);
+    if (!Field)
+      return nullptr;
+
+    uint64_t FieldOffset = 0;
+    if (auto *STy = dyn_cast<StructType>(ArrTy->getElementType())) {
+      const StructLayout *SL = DL.getStructLayout(STy);
+      unsigned Idx = SL->getElementContainingOffset(Byte);
+      FieldOffset = SL->getElementOffset(Idx);
+      Field = Field->getAggregateElement(Idx);
+      if (!Field)
+        return nullptr;
+    }
+
+    if (isa<UndefValue>(Field) ||
+        Byte - FieldOffset >= DL.getTypeStoreSize(Field->getType())) {
+      Bytes.push_back(0);
+      continue;
+    }
+    auto *CI = dyn_cast<ConstantInt>(Field);
+    if (!CI)
+      return nullptr;
+    Bytes.push_back(
+        CI->getValue().extractBitsAsZExtValue(8, (Byte - FieldOffset) * 8));
+  }
+  return ConstantDataArray::get(GV.getContext(), makeArrayRef(Bytes));
+}
+
+static void rewriteAccess(const TableAccess &Access,
+                          ArrayRef<GlobalVariable *> Planes) {
+  IRBuilder<> Builder(Access.I);
+  Type *Int8Ty = Builder.getInt8Ty();
+  const DataLayout &DL = Access.I->getModule()->getDataLayout();
+
+  auto PlaneAddr = [&](uint64_t Byte) {
+    GlobalVariable *Plane = Planes[Access.Offset + Byte];
+    return Builder.CreateInBoundsGEP(
+        Plane->getValueType(), Plane,
+        {ConstantInt::get(Access.Index->getType(), 0), Access.Index});
+  };
+
+  if (auto *LI = dyn_cast<LoadInst>(Access.I)) {
+    Type *Ty = LI->getType();
+    Value *Val = nullptr;
+    for (uint64_t I = 0, E = DL.getTypeStoreSize(Ty); I != E; ++I) {
+      Value *Byte = Builder.CreateAlignedLoad(Int8Ty, PlaneAddr(I), Align(1));
+      Byte = Builder.CreateZExt(Byte, Ty);
+      if (I)
+        Byte = Builder.CreateShl(Byte, I * 8);
+      Val = Val ? Builder.CreateOr(Val, Byte) : Byte;
+    }
+    Val->takeName(LI);
+    LI->replaceAllUsesWith(Val);
+    LI->eraseFromParent();
+    return;
+  }
+
+  auto *SI = cast<StoreInst>(Access.I);
+  Value *Val = SI->getValueOperand();
+  for (uint64_t I = 0, E = DL.getTypeStoreSize(Val->getType()); I != E; ++I) {
+    Value *Byte = I ? Builder.CreateLShr(Val, I * 8) : Val;
+    Builder.CreateAlignedStore(Builder.CreateTrunc(Byte, Int8Ty), PlaneAddr(I),
+                               Align(1));
+  }
+  SI->eraseFromParent();
+}
+
+static bool splitTable(GlobalVariable &GV) {
+  const DataLayout &DL = GV.getParent()->getDataLayout();
+
+  if (!GV.hasLocalLinkage() || !GV.hasInitializer() ||
+      GV.isExternallyInitialized() || GV.hasSection() || GV.hasComdat())
+    return false;
+  auto *ArrTy = dyn_cast<ArrayType>(GV.getValueType());
+  if (!ArrTy || !ArrTy->getNumElements() ||
+      ArrTy->getNumElements() > MaxNumElements ||
+      !isSplittableElement(ArrTy->getElementType(), DL))
+    return false;
+
+  SmallVector<TableAccess> Accesses;
+  if (!collectAccesses(GV, Accesses))
+    return false;
+
+  uint64_t ElementSize = DL.getTypeAllocSize(ArrTy->getElementType());
+  SmallVector<Constant *> Inits;
+  for (uint64_t Byte = 0; Byte != ElementSize; ++Byte) {
+    Constant *Init = getPlaneInitializer(GV, Byte);
+    if (!Init)
+      return false;
+    Inits.push_back(Init);
+  }
+
+  LLVM_DEBUG(dbgs() << "Splitting " << GV.getName() << " into " << ElementSize
+                    << " byte arrays.\n");
+
+  SmallVector<GlobalVariable *> Planes;
+  for (uint64_t Byte = 0; Byte != ElementSize; ++Byte) {
+    auto *Plane = new GlobalVariable(
+        *GV.getParent(), Inits[Byte]->getType(), GV.isConstant(),
+        GV.getLinkage(), Inits[Byte], GV.getName() + "." + Twine(Byte), &GV,
+        GV.getThreadLocalMode(), GV.getAddressSpace());
+    Plane->setUnnamedAddr(GV.getUnnamedAddr());
+    Planes.push_back(Plane);
+  }
+
+  SmallPtrSet<Instruction *, 8> GEPs;
+  for (const TableAccess &Access : Accesses) {
+    if (auto *GEP = dyn_cast<GetElementPtrInst>(getLoadStorePointerOperand(
+            Access.I)))
+      GEPs.insert(GEP);
+    rewriteAccess(Access, Planes);
+  }
+  for (Instruction *GEP : GEPs)
+    GEP->eraseFromParent();
+
+  GV.removeDeadConstantUsers();
+  assert(GV.use_empty());
+  GV.eraseFromParent();
+  return true;
+}
+
+bool MOSSplitTables::runOnModule(Module &M) {
+  LLVM_DEBUG(dbgs() << "**** MOS Split Tables Pass ****\n");
+
+  if (MOS::wholeProgramPassesRan(M))
+    return false;
+
+  SmallVector<GlobalVariable *> Candidates;
+  for (GlobalVariable &GV : M.globals())
+    Candidates.push_back(&GV);
+
+  bool Changed = false;
+  for (GlobalVariable *GV : Candidates)
+    Changed |= splitTable(*GV);
+  return Changed;
+}
+
+char MOSSplitTables::ID = 0;
+
+INITIALIZE_PASS(MOSSplitTables, DEBUG_TYPE,
+                "Split tables of multi-byte values into byte arrays", false,
+                false)
+
+ModulePass *llvm::createMOSSplitTablesPass() { return new MOSSplitTables(); }
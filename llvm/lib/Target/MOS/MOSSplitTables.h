@@ -0,0 +1,24 @@
+//===-- MOSSplitTables.h - MOS Table Splitting Pass -------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS table splitting pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSPLITTABLES_H
+#define LLVM_LIB_TARGET_MOS_MOSSPLITTABLES_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+ModulePass *createMOSSplitTablesPass();
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSPLITTABLES_H
@@ -0,0 +1,217 @@
+//===-- MOSStripMine.cpp - MOS Strip Mine Pass ----------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS Strip Mine pass.
+//
+// MOSIndexIV can only give a pointer an 8-bit index if the index stays within
+// 8 bits over the whole loop. This pass splits counted loops that walk further
+// than that into an outer loop over strips and an inner loop over at most 256
+// bytes of each strip. Every value carried around the original loop is carried
+// around the outer loop too, so the pointers advance by a whole strip each
+// outer iteration. The inner loop is controlled by an 8-bit counter, and its
+// pointers can then be given 8-bit indices by MOSIndexIV. This is the shape of
+// the usual hand-written 6502 block copy: (zp),Y; INY; BNE in the inner loop,
+// and an increment of the pointer high byte in the outer loop.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSStripMine.h"
+
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Transforms/Scalar/LoopPassManager.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+#define DEBUG_TYPE "mos-stripmine"
+
+using namespace llvm;
+
+// Returns the largest constant step in bytes of a pointer recurrence in L
+// whose index does not fit in 8 bits over the whole loop. Returns zero if there
+// are no such pointers, since strip mining would not help them.
+static uint64_t maxWideStep(Loop &L, ScalarEvolution &SE) {
+  uint64_t MaxStep = 0;
+  for (BasicBlock *B : L.blocks()) {
+    for (Instruction &I : *B) {
+      auto *GEP = dyn_cast<GetElementPtrInst>(&I);
+      if (!GEP)
+        continue;
+
+      const auto *R = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(GEP));
+      if (!R || R->getLoop() != &L || !R->isAffine())
+        continue;
+      const auto *Step = dyn_cast<SCEVConstant>(R->getStepRecurrence(SE));
+      if (!Step || Step->getAPInt().isNonPositive() ||
+          Step->getAPInt().ugt(255))
+        continue;
+
+      const auto *Index =
+          SE.getAddRecExpr(/*Start=*/SE.getConstant(R->getType(), 0), Step, &L,
+                           R->getNoWrapFlags());
+      const auto IndexRange = SE.getSignedRange(Index);
+      if (IndexRange.isAllNonNegative() &&
+          IndexRange.getUpper().ule(
+              APInt::getMaxValue(8).zext(IndexRange.getBitWidth())))
+        continue;
+
+      LLVM_DEBUG(dbgs() << "Wide index: " << *GEP << "\n");
+      MaxStep = std::max(MaxStep, Step->getAPInt().getZExtValue());
+    }
+  }
+  return MaxStep;
+}
+
+PreservedAnalyses MOSStripMine::run(Loop &L, LoopAnalysisManager &AM,
+                                    LoopStandardAnalysisResults &AR,
+                                    LPMUpdater &U) {
+  LLVM_DEBUG(dbgs() << "***************************** MOS STRIP MINE PASS "
+                       "*****************************\n");
+
+  auto &SE = AR.SE;
+  auto &DT = AR.DT;
+  auto &LI = AR.LI;
+  BasicBlock *Header = L.getHeader();
+  const DataLayout &DL = Header->getModule()->getDataLayout();
+
+  // The outer loop costs a few bytes of code per loop.
+  if (Header->getParent()->hasMinSize())
+    return PreservedAnalyses::all();
+
+  // The inner loop's trip count replaces the loop's exit condition, so the
+  // latch must be the only way out.
+  BasicBlock *Preheader = L.getLoopPreheader();
+  BasicBlock *Latch = L.getLoopLatch();
+  BasicBlock *Exit = L.getUniqueExitBlock();
+  if (AR.MSSA || !L.isInnermost() || !L.isLoopSimplifyForm() || !Exit ||
+      L.getExitingBlock() != Latch)
+    return PreservedAnalyses::all();
+  auto *LatchBr = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!LatchBr || !LatchBr->isConditional())
+    return PreservedAnalyses::all();
+
+  const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+  if (isa<SCEVCouldNotCompute>(BTC) || !isSafeToExpand(BTC, SE) ||
+      SE.getTypeSizeInBits(BTC->getType()) <= 8)
+    return PreservedAnalyses::all();
+  LLVM_DEBUG(dbgs() << "Considering: " << L);
+  LLVM_DEBUG(dbgs() << "Backedge taken count: " << *BTC << "\n");
+
+  uint64_t MaxStep = maxWideStep(L, SE);
+  if (!MaxStep) {
+    LLVM_DEBUG(dbgs() << "No pointers with wide indices.\n");
+    return PreservedAnalyses::all();
+  }
+
+  // Each strip must keep the largest index within 8 bits. A step of one
+  // gives 256 iterations.
+  uint64_t StripLen = 255 / MaxStep + 1;
+  if (SE.getUnsignedRangeMax(BTC).ult(StripLen)) {
+    LLVM_DEBUG(dbgs() << "Loop already fits in one strip.\n");
+    return PreservedAnalyses::all();
+  }
+  LLVM_DEBUG(dbgs() << "Strip mining into strips of " << StripLen << ".\n");
+
+  SE.forgetLoop(&L);
+  for (PHINode &PN : Exit->phis())
+    SE.forgetValue(&PN);
+
+  LLVMContext &Ctx = Header->getContext();
+  Function &F = *Header->getParent();
+  Type *CountTy = BTC->getType();
+  Type *i8 = Type::getInt8Ty(Ctx);
+
+  SCEVExpander Rewriter(SE, DL, "mos-stripmine");
+  Value *TotalBTC =
+      Rewriter.expandCodeFor(BTC, CountTy, Preheader->getTerminator());
+
+  auto *OuterHeader =
+      BasicBlock::Create(Ctx, Header->getName() + ".strip", &F, Header);
+  auto *OuterLatch = BasicBlock::Create(Ctx, Latch->getName() + ".strip", &F,
+                                        Latch->getNextNode());
+
+  // The outer header tracks the number of backedges left to take, and each
+  // strip takes up to one fewer backedge than its length.
+  IRBuilder<> Builder(OuterHeader);
+  PHINode *Remaining = Builder.CreatePHI(CountTy, 2, "strip.remaining");
+  Remaining->addIncoming(TotalBTC, Preheader);
+
+  // Every value carried by the loop is carried by the outer loop, starting
+  // each strip where the previous strip ended.
+  for (PHINode &PN : Header->phis()) {
+    PHINode *Outer =
+        Builder.CreatePHI(PN.getType(), 2, PN.getName() + ".strip");
+    Outer->addIncoming(PN.getIncomingValueForBlock(Preheader), Preheader);
+    Outer->addIncoming(PN.getIncomingValueForBlock(Latch), OuterLatch);
+    PN.setIncomingValueForBlock(Preheader, Outer);
+    PN.replaceIncomingBlockWith(Preheader, OuterHeader);
+  }
+
+  Constant *MaxStripBTC = ConstantInt::get(CountTy, StripLen - 1);
+  Value *StripBTC = Builder.CreateSelect(
+      Builder.CreateICmpULT(Remaining, MaxStripBTC), Remaining, MaxStripBTC,
+      "strip.btc");
+  Value *StripBTC8 = Builder.CreateTrunc(StripBTC, i8);
+  Builder.CreateBr(Header);
+  Preheader->getTerminator()->replaceUsesOfWith(Header, OuterHeader);
+
+  // The inner loop counts up from zero in 8 bits until it has taken each
+  // backedge of the strip.
+  Builder.SetInsertPoint(&Header->front());
+  PHINode *Counter = Builder.CreatePHI(i8, 2, "strip.idx");
+  Counter->addIncoming(ConstantInt::get(i8, 0), OuterHeader);
+  Builder.SetInsertPoint(LatchBr);
+  Value *NextCounter = Builder.CreateAdd(Counter, ConstantInt::get(i8, 1));
+  Counter->addIncoming(NextCounter, Latch);
+  Value *StripDone = Builder.CreateICmpEQ(Counter, StripBTC8);
+  BranchInst *NewLatchBr = Builder.CreateCondBr(StripDone, OuterLatch, Header);
+  NewLatchBr->copyMetadata(*LatchBr, {LLVMContext::MD_loop});
+  Value *OldCond = LatchBr->getCondition();
+  LatchBr->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(OldCond);
+
+  // The outer latch exits after a strip shorter than the maximum.
+  Builder.SetInsertPoint(OuterLatch);
+  Value *NextRemaining = Builder.CreateSub(
+      Remaining, ConstantInt::get(CountTy, StripLen), "strip.remaining.next");
+  Remaining->addIncoming(NextRemaining, OuterLatch);
+  Builder.CreateCondBr(Builder.CreateICmpUGT(Remaining, MaxStripBTC),
+                       OuterHeader, Exit);
+  for (PHINode &PN : Exit->phis())
+    PN.replaceIncomingBlockWith(Latch, OuterLatch);
+
+  DT.applyUpdates({{DominatorTree::Insert, Preheader, OuterHeader},
+                   {DominatorTree::Insert, OuterHeader, Header},
+                   {DominatorTree::Delete, Preheader, Header},
+                   {DominatorTree::Insert, Latch, OuterLatch},
+                   {DominatorTree::Insert, OuterLatch, OuterHeader},
+                   {DominatorTree::Insert, OuterLatch, Exit},
+                   {DominatorTree::Delete, Latch, Exit}});
+
+  // L becomes the outer loop, and its original blocks move to a new inner
+  // loop.
+  Loop *Inner = LI.AllocateLoop();
+  Inner->reserveBlocks(L.getNumBlocks());
+  for (BasicBlock *B : L.blocks()) {
+    Inner->addBlockEntry(B);
+    LI.changeLoopFor(B, Inner);
+  }
+  L.addChildLoop(Inner);
+  L.addBasicBlockToLoop(OuterHeader, LI);
+  L.addBasicBlockToLoop(OuterLatch, LI);
+  L.moveToHeader(OuterHeader);
+
+  formLCSSARecursively(L, DT, &LI, &SE);
+  U.addChildLoops({Inner});
+
+  LLVM_DEBUG(dbgs() << "*****************************************************"
+                       "***************************\n");
+  return getLoopPassPreservedAnalyses();
+}
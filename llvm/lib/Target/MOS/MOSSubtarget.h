@@ -97,7 +97,9 @@ public:
   void ParseSubtargetFeatures(StringRef CPU, StringRef TuneCPU, StringRef FS);
 
   bool has6502() const { return Has6502Insns; }
+  bool has6502BCD() const { return Has6502BCDInsns; }
   bool has65C02() const { return Has65C02Insns; }
+  bool hasSWEET16() const { return HasSWEET16Insns; }
 
 private:
   /// The ELF e_flags architecture features.
@@ -0,0 +1,499 @@
+//===-- MOSSweet16.cpp - MOS SWEET16 Compression Pass ---------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS SWEET16 compression pass.
+//
+// SWEET16 is a 16-bit virtual machine interpreted by 6502 code. Its bytecode is
+// far denser than the equivalent 6502 code, but far slower. On targets with
+// the SWEET16 feature, this pass rewrites runs of 16-bit operations on
+// imaginary pointer registers into SWEET16 bytecode that follows a call to the
+// interpreter, __sweet16. This is done in functions with the "mos-sweet16"
+// attribute, in cold functions compiled for minimum size, and in the blocks of
+// other such functions that run rarely relative to their entry.
+//
+// The following operations are compiled:
+//
+//  - Constants:  SET rD, #imm
+//  - Copies:     LD rS; ST rD
+//  - Additions:  LD rL; ADD rR; ST rD
+//  - Subtracts:  LD rL; SUB rR; ST rD
+//
+// SWEET16 register n is imaginary pointer register n + 1. This keeps the soft
+// stack pointer out of the register file, and makes the accumulator R0 the
+// caller-saved RS1. Device linker scripts must place the imaginary registers
+// accordingly. Only R1 through R13 appear as operands, since R14 and R15 hold
+// the interpreter's status and program counter.
+//
+// The interpreter must preserve A, X, Y, P, R14, and R15. Each rewritten run
+// thus clobbers only R0, and its native code's effects on the other real
+// registers must be dead.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSweet16.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSFrameLowering.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-sweet16"
+
+using namespace llvm;
+
+STATISTIC(NumRegions, "Number of SWEET16 regions emitted");
+STATISTIC(NumBytesSaved, "Number of code bytes saved by SWEET16 regions");
+
+static cl::opt<unsigned> ColdThreshold(
+    "mos-sweet16-cold-threshold", cl::init(8),
+    cl::desc("Minimum ratio of function entry frequency to block frequency "
+             "for a block to be compiled to SWEET16 at -Oz"),
+    cl::Hidden);
+
+namespace {
+
+// The SWEET16 interpreter, which executes the bytecode following the JSR that
+// calls it until an RTN.
+constexpr const char *InterpreterName = "__sweet16";
+
+// Size of JSR __sweet16 and the final RTN.
+constexpr unsigned RegionOverhead = 4;
+
+// A 16-bit operation on imaginary pointer registers, along with the native
+// code that performs it.
+struct Sweet16Op {
+  enum { Set, Copy, Add, Sub } Kind;
+  Register Dst;
+  Register L;
+  Register R;
+  uint16_t Imm = 0;
+  SmallVector<MachineInstr *, 7> Native;
+  unsigned NativeSize = 0;
+  // Bit mask over TrackedRegs of the real registers written by Native.
+  unsigned Defs = 0;
+  // Bit mask over TrackedRegs of the real registers live after Native.
+  unsigned LiveAfter = 0;
+};
+
+// A SWEET16 instruction to emit.
+struct Sweet16Inst {
+  unsigned Opcode;
+  unsigned Reg;
+  uint16_t Imm = 0;
+};
+
+// The real registers whose values the interpreter either preserves, making
+// native writes to them disappear, or clobbers.
+const MCPhysReg TrackedRegs[] = {MOS::A, MOS::X,  MOS::Y,
+                                 MOS::C, MOS::NZ, MOS::V};
+// The bit for R0, which is clobbered by every region.
+constexpr unsigned R0Bit = 1 << array_lengthof(TrackedRegs);
+
+class MOSSweet16 : public MachineFunctionPass {
+public:
+  static char ID;
+
+  MOSSweet16() : MachineFunctionPass(ID) {
+    llvm::initializeMOSSweet16Pass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+
+  bool runOnBlock(MachineBasicBlock &MBB);
+  bool matchMoves(MachineBasicBlock::iterator I,
+                  MachineBasicBlock::iterator E, Sweet16Op &Op) const;
+  bool matchAddSub(MachineBasicBlock::iterator I,
+                   MachineBasicBlock::iterator E, Sweet16Op &Op) const;
+  Register getPair(Register Reg, unsigned &SubIdx) const;
+  unsigned getDefMask(const MachineInstr &MI) const;
+  void emitRegion(MachineBasicBlock &MBB, ArrayRef<Sweet16Op> Ops,
+                  ArrayRef<Sweet16Inst> Code);
+};
+
+void MOSSweet16::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineBlockFrequencyInfo>();
+  AU.setPreservesCFG();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+// Returns the SWEET16 register that holds the imaginary pointer register
+// Pair, or zero if it's unavailable as an operand.
+static unsigned getSweet16Reg(Register Pair) {
+  unsigned Idx = Pair - MOS::RS0;
+  if (Idx < 2 || Idx > 14)
+    return 0;
+  return Idx - 1;
+}
+
+static unsigned getNativeSize(const MachineInstr &MI) {
+  return MI.getOpcode() == MOS::LDCImm ? 1 : 2;
+}
+
+bool MOSSweet16::runOnMachineFunction(MachineFunction &MF) {
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  if (!STI.hasSWEET16() || STI.getFrameLowering()->isISR(MF))
+    return false;
+  TII = STI.getInstrInfo();
+  TRI = STI.getRegisterInfo();
+
+  const Function &F = MF.getFunction();
+  bool WholeFunction =
+      F.hasFnAttribute(MOS::Sweet16Attr) ||
+      (F.hasMinSize() && F.hasFnAttribute(Attribute::Cold));
+  if (!WholeFunction && !F.hasMinSize())
+    return false;
+
+  const auto &MBFI = getAnalysis<MachineBlockFrequencyInfo>();
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    if (!WholeFunction &&
+        MBFI.getBlockFreqRelativeToEntryBlock(&MBB) * ColdThreshold > 1)
+      continue;
+    Changed |= runOnBlock(MBB);
+  }
+  return Changed;
+}
+
+Register MOSSweet16::getPair(Register Reg, unsigned &SubIdx) const {
+  if (!MOS::Imag8RegClass.contains(Reg))
+    return 0;
+  for (unsigned Idx : {MOS::sublo, MOS::subhi}) {
+    if (Register Pair =
+            TRI->getMatchingSuperReg(Reg, Idx, &MOS::Imag16RegClass)) {
+      SubIdx = Idx;
+      return getSweet16Reg(Pair) ? Pair : Register();
+    }
+  }
+  return 0;
+}
+
+unsigned MOSSweet16::getDefMask(const MachineInstr &MI) const {
+  unsigned Mask = 0;
+  for (const MachineOperand &MO : MI.operands()) {
+    if (!MO.isReg() || !MO.isDef())
+      continue;
+    for (unsigned I = 0; I < array_lengthof(TrackedRegs); ++I)
+      if (TRI->regsOverlap(MO.getReg(), TrackedRegs[I]))
+        Mask |= 1 << I;
+  }
+  return Mask;
+}
+
+// Matches a pair of byte moves that together set an imaginary pointer register
+// to a constant or copy one to another. Each move is a load of a GPR from an
+// immediate or imaginary register, followed by stores of the GPR.
+bool MOSSweet16::matchMoves(MachineBasicBlock::iterator I,
+                            MachineBasicBlock::iterator E,
+                            Sweet16Op &Op) const {
+  struct ByteMove {
+    Register Dst;
+    Register Src;
+    int64_t Imm;
+  };
+  SmallVector<ByteMove, 2> Moves;
+
+  I = skipDebugInstructionsForward(I, E);
+  while (Moves.size() < 2 && I != E) {
+    MachineInstr &Load = *I;
+    Register Src;
+    int64_t Imm = 0;
+    if (Load.getOpcode() == MOS::LDImag8)
+      Src = Load.getOperand(1).getReg();
+    else if (Load.getOpcode() == MOS::LDImm)
+      Imm = Load.getOperand(1).getImm() & 0xff;
+    else
+      break;
+    Register Val = Load.getOperand(0).getReg();
+    Op.Native.push_back(&Load);
+
+    bool Stored = false;
+    for (I = skipDebugInstructionsForward(std::next(I), E);
+         Moves.size() < 2 && I != E && I->getOpcode() == MOS::STImag8 &&
+         I->getOperand(1).getReg() == Val;
+         I = skipDebugInstructionsForward(std::next(I), E)) {
+      Moves.push_back({I->getOperand(0).getReg(), Src, Imm});
+      Op.Native.push_back(&*I);
+      Stored = true;
+    }
+    if (!Stored)
+      return false;
+  }
+  if (Moves.size() != 2)
+    return false;
+
+  unsigned DstIdx[2], SrcIdx[2];
+  Register Dst = getPair(Moves[0].Dst, DstIdx[0]);
+  if (!Dst || getPair(Moves[1].Dst, DstIdx[1]) != Dst ||
+      DstIdx[0] == DstIdx[1])
+    return false;
+  if (DstIdx[0] == MOS::subhi)
+    std::swap(Moves[0], Moves[1]);
+  Op.Dst = Dst;
+
+  if (!Moves[0].Src && !Moves[1].Src) {
+    Op.Kind = Sweet16Op::Set;
+    Op.Imm = Moves[0].Imm | Moves[1].Imm << 8;
+  } else {
+    if (!Moves[0].Src || !Moves[1].Src)
+      return false;
+    Register Src = getPair(Moves[0].Src, SrcIdx[0]);
+    if (!Src || SrcIdx[0] != MOS::sublo ||
+        getPair(Moves[1].Src, SrcIdx[1]) != Src || SrcIdx[1] != MOS::subhi)
+      return false;
+    Op.Kind = Sweet16Op::Copy;
+    Op.L = Src;
+  }
+  return true;
+}
+
+// Matches a 16-bit addition or subtraction of imaginary pointer registers, as
+// a carry chain through A from the low byte to the high byte.
+bool MOSSweet16::matchAddSub(MachineBasicBlock::iterator I,
+                             MachineBasicBlock::iterator E,
+                             Sweet16Op &Op) const {
+  I = skipDebugInstructionsForward(I, E);
+  if (I == E || I->getOpcode() != MOS::LDCImm)
+    return false;
+  bool IsSub = I->getOperand(1).getImm() != 0;
+  Op.Kind = IsSub ? Sweet16Op::Sub : Sweet16Op::Add;
+  Op.Native.push_back(&*I);
+
+  for (unsigned Idx : {MOS::sublo, MOS::subhi}) {
+    MachineInstr *MIs[3];
+    for (MachineInstr *&MI : MIs) {
+      I = skipDebugInstructionsForward(std::next(I), E);
+      if (I == E)
+        return false;
+      MI = &*I;
+      Op.Native.push_back(MI);
+    }
+    MachineInstr &Load = *MIs[0], &Arith = *MIs[1], &Store = *MIs[2];
+    if (Load.getOpcode() != MOS::LDImag8 ||
+        Load.getOperand(0).getReg() != MOS::A ||
+        Arith.getOpcode() != (IsSub ? MOS::SBCImag8 : MOS::ADCImag8) ||
+        Store.getOpcode() != MOS::STImag8 ||
+        Store.getOperand(1).getReg() != MOS::A)
+      return false;
+
+    Register Regs[3];
+    Register Bytes[3] = {Load.getOperand(1).getReg(),
+                         Arith.getOperand(4).getReg(),
+                         Store.getOperand(0).getReg()};
+    for (unsigned J = 0; J < 3; ++J) {
+      unsigned SubIdx;
+      Regs[J] = getPair(Bytes[J], SubIdx);
+      if (!Regs[J] || SubIdx != Idx)
+        return false;
+    }
+    if (Idx == MOS::sublo) {
+      Op.L = Regs[0];
+      Op.R = Regs[1];
+      Op.Dst = Regs[2];
+    } else if (Regs[0] != Op.L || Regs[1] != Op.R || Regs[2] != Op.Dst) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Generates the bytecode for Ops, keeping track of the value left in R0 by
+// each operation to avoid reloading it.
+static SmallVector<Sweet16Inst> generateCode(ArrayRef<Sweet16Op> Ops) {
+  SmallVector<Sweet16Inst> Code;
+  unsigned InR0 = 0;
+  auto Load = [&](Register Reg) {
+    if (getSweet16Reg(Reg) != InR0)
+      Code.push_back({MOS::LD_Sweet16, getSweet16Reg(Reg)});
+  };
+  for (const Sweet16Op &Op : Ops) {
+    unsigned Dst = getSweet16Reg(Op.Dst);
+    switch (Op.Kind) {
+    case Sweet16Op::Set:
+      Code.push_back({MOS::SET_Sweet16, Dst, Op.Imm});
+      if (Dst == InR0)
+        InR0 = 0;
+      continue;
+    case Sweet16Op::Copy:
+      Load(Op.L);
+      break;
+    case Sweet16Op::Add:
+      if (getSweet16Reg(Op.R) == InR0) {
+        Code.push_back({MOS::ADD_Sweet16, getSweet16Reg(Op.L)});
+        break;
+      }
+      Load(Op.L);
+      Code.push_back({MOS::ADD_Sweet16, getSweet16Reg(Op.R)});
+      break;
+    case Sweet16Op::Sub:
+      Load(Op.L);
+      Code.push_back({MOS::SUB_Sweet16, getSweet16Reg(Op.R)});
+      break;
+    }
+    Code.push_back({MOS::ST_Sweet16, Dst});
+    InR0 = Dst;
+  }
+  return Code;
+}
+
+static unsigned getCodeSize(ArrayRef<Sweet16Inst> Code) {
+  unsigned Size = RegionOverhead;
+  for (const Sweet16Inst &Inst : Code)
+    Size += Inst.Opcode == MOS::SET_Sweet16 ? 3 : 1;
+  return Size;
+}
+
+bool MOSSweet16::runOnBlock(MachineBasicBlock &MBB) {
+  // Find runs of adjacent operations.
+  SmallVector<SmallVector<Sweet16Op, 4>> Runs;
+  MachineBasicBlock::iterator RunEnd;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E;) {
+    if (I->isDebugInstr()) {
+      ++I;
+      continue;
+    }
+    Sweet16Op Op;
+    if (!matchMoves(I, E, Op)) {
+      Op = Sweet16Op();
+      if (!matchAddSub(I, E, Op)) {
+        ++I;
+        continue;
+      }
+    }
+    if (Runs.empty() || I != RunEnd)
+      Runs.emplace_back();
+    for (MachineInstr *MI : Op.Native) {
+      Op.NativeSize += getNativeSize(*MI);
+      Op.Defs |= getDefMask(*MI);
+    }
+    I = skipDebugInstructionsForward(
+        std::next(Op.Native.back()->getIterator()), E);
+    RunEnd = I;
+    Runs.back().push_back(std::move(Op));
+  }
+  if (Runs.empty())
+    return false;
+
+  // Record which tracked registers are live after each operation.
+  DenseMap<const MachineInstr *, Sweet16Op *> OpEnds;
+  for (auto &Run : Runs)
+    for (Sweet16Op &Op : Run)
+      OpEnds[Op.Native.back()] = &Op;
+  const MachineRegisterInfo &MRI = MBB.getParent()->getRegInfo();
+  LivePhysRegs LiveRegs(*TRI);
+  LiveRegs.addLiveOuts(MBB);
+  for (MachineInstr &MI : reverse(MBB)) {
+    if (Sweet16Op *Op = OpEnds.lookup(&MI)) {
+      for (unsigned I = 0; I < array_lengthof(TrackedRegs); ++I)
+        if (!LiveRegs.available(MRI, TrackedRegs[I]))
+          Op->LiveAfter |= 1 << I;
+      if (!LiveRegs.available(MRI, MOS::RS1))
+        Op->LiveAfter |= R0Bit;
+    }
+    LiveRegs.stepBackward(MI);
+  }
+
+  // Emit the longest profitable regions whose effects on real registers are
+  // dead.
+  bool Changed = false;
+  for (auto &Run : Runs) {
+    for (size_t Begin = 0; Begin < Run.size();) {
+      size_t End = Run.size();
+      for (; End > Begin; --End) {
+        ArrayRef<Sweet16Op> Ops = makeArrayRef(Run).slice(Begin, End - Begin);
+        unsigned Defs = R0Bit;
+        unsigned NativeSize = 0;
+        for (const Sweet16Op &Op : Ops) {
+          Defs |= Op.Defs;
+          NativeSize += Op.NativeSize;
+        }
+        if (Defs & Ops.back().LiveAfter)
+          continue;
+        SmallVector<Sweet16Inst> Code = generateCode(Ops);
+        unsigned Size = getCodeSize(Code);
+        if (Size >= NativeSize)
+          continue;
+        LLVM_DEBUG(dbgs() << "Compiling " << Ops.size()
+                          << " operations in " << printMBBReference(MBB)
+                          << " to SWEET16, saving " << NativeSize - Size
+                          << " bytes.\n");
+        emitRegion(MBB, Ops, Code);
+        ++NumRegions;
+        NumBytesSaved += NativeSize - Size;
+        Changed = true;
+        break;
+      }
+      Begin = End > Begin ? End : Begin + 1;
+    }
+  }
+  return Changed;
+}
+
+void MOSSweet16::emitRegion(MachineBasicBlock &MBB, ArrayRef<Sweet16Op> Ops,
+                            ArrayRef<Sweet16Inst> Code) {
+  MachineInstr &First = *Ops.front().Native.front();
+  const DebugLoc &DL = First.getDebugLoc();
+
+  // The call reads and writes the imaginary registers on behalf of the
+  // bytecode.
+  SmallSetVector<Register, 8> Uses, Defs;
+  for (const Sweet16Op &Op : Ops) {
+    if (Op.L)
+      Uses.insert(Op.L);
+    if (Op.R)
+      Uses.insert(Op.R);
+    Defs.insert(Op.Dst);
+  }
+  auto Call =
+      BuildMI(MBB, First, DL, TII->get(MOS::JSR)).addExternalSymbol(
+          InterpreterName);
+  for (Register Reg : Uses)
+    Call.addUse(Reg, RegState::Implicit);
+  for (Register Reg : Defs)
+    Call.addDef(Reg, RegState::Implicit);
+  Call.addDef(MOS::RS1, RegState::Implicit | RegState::Dead);
+
+  for (const Sweet16Inst &Inst : Code) {
+    auto MIB = BuildMI(MBB, First, DL, TII->get(Inst.Opcode)).addImm(Inst.Reg);
+    if (Inst.Opcode == MOS::SET_Sweet16)
+      MIB.addImm(Inst.Imm);
+  }
+  BuildMI(MBB, First, DL, TII->get(MOS::RTN_Sweet16));
+
+  for (const Sweet16Op &Op : Ops)
+    for (MachineInstr *MI : Op.Native)
+      MI->eraseFromParent();
+}
+
+} // namespace
+
+char MOSSweet16::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSSweet16, DEBUG_TYPE,
+                      "Compile cold code to SWEET16 bytecode", false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfo)
+INITIALIZE_PASS_END(MOSSweet16, DEBUG_TYPE,
+                    "Compile cold code to SWEET16 bytecode", false, false)
+
+MachineFunctionPass *llvm::createMOSSweet16Pass() { return new MOSSweet16(); }
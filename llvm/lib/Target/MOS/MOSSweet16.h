@@ -0,0 +1,24 @@
+//===-- MOSSweet16.h - MOS SWEET16 Compression Pass -------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS SWEET16 compression pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSWEET16_H
+#define LLVM_LIB_TARGET_MOS_MOSSWEET16_H
+
+#include "llvm/CodeGen/MachineFunctionPass.h"
+
+namespace llvm {
+
+MachineFunctionPass *createMOSSweet16Pass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSWEET16_H
@@ -12,6 +12,8 @@
 
 #include "MOSTargetMachine.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/CodeGen/GlobalISel/CSEInfo.h"
 #include "llvm/CodeGen/GlobalISel/IRTranslator.h"
 #include "llvm/CodeGen/GlobalISel/InstructionSelect.h"
@@ -23,6 +25,7 @@
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/InitializePasses.h"
+#include "llvm/LTO/LTO.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Transforms/Scalar/IndVarSimplify.h"
@@ -30,13 +33,23 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSBranchPlacement.h"
 #include "MOSCombiner.h"
 #include "MOSIndexIV.h"
+#include "MOSInternalCC.h"
+#include "MOSInterruptClone.h"
+#include "MOSLibcallRecursion.h"
+#include "MOSLookupTables.h"
 #include "MOSLowerSelect.h"
 #include "MOSMachineScheduler.h"
 #include "MOSNoRecurse.h"
+#include "MOSPageCross.h"
 #include "MOSPostRAScavenging.h"
+#include "MOSSelfModify.h"
+#include "MOSSplitTables.h"
 #include "MOSStaticStackAlloc.h"
+#include "MOSStripMine.h"
+#include "MOSSweet16.h"
 #include "MOSTargetObjectFile.h"
 #include "MOSTargetTransformInfo.h"
 
@@ -48,15 +61,24 @@ extern "C" void LLVM_EXTERNAL_VISIBILITY LLVMInitializeMOSTarget() {
 
   PassRegistry &PR = *PassRegistry::getPassRegistry();
   initializeGlobalISel(PR);
+  initializeMOSBranchPlacementPass(PR);
   initializeMOSCombinerPass(PR);
+  initializeMOSInternalCCPass(PR);
+  initializeMOSInterruptClonePass(PR);
+  initializeMOSLibcallRecursionPass(PR);
+  initializeMOSLookupTablesPass(PR);
   initializeMOSLowerSelectPass(PR);
   initializeMOSNoRecursePass(PR);
+  initializeMOSPageCrossPass(PR);
   initializeMOSPostRAScavengingPass(PR);
+  initializeMOSSelfModifyPass(PR);
+  initializeMOSSplitTablesPass(PR);
   initializeMOSStaticStackAllocPass(PR);
+  initializeMOSSweet16Pass(PR);
 }
 
 static const char *MOSDataLayout =
-    "e-p:16:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
+    "e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
 
 /// Processes a CPU name.
 static StringRef getCPU(StringRef CPU) {
@@ -120,12 +142,20 @@ void MOSTargetMachine::registerPassBuilderCallbacks(PassBuilder &PB,
           PM.addPass(MOSIndexIV());
           return true;
         }
+        if (Name == "mos-stripmine") {
+          // Split loops with wide indices into page-sized inner loops.
+          PM.addPass(MOSStripMine());
+          return true;
+        }
         return false;
       });
 
   PB.registerLateLoopOptimizationsEPCallback(
       [](LoopPassManager &PM, PassBuilder::OptimizationLevel Level) {
         if (Level != PassBuilder::OptimizationLevel::O0) {
+          // Give loops with wide indices inner loops that MOSIndexIV can
+          // handle.
+          PM.addPass(MOSStripMine());
           PM.addPass(MOSIndexIV());
 
           // New induction variables may have been added.
@@ -167,6 +197,7 @@ public:
   // allocation.
   void addFastRegAlloc() override { addOptimizedRegAlloc(); }
 
+  void addPreRegAlloc() override;
   void addPreSched2() override;
   void addPreEmitPass() override;
 
@@ -181,12 +212,90 @@ TargetPassConfig *MOSTargetMachine::createPassConfig(PassManagerBase &PM) {
   return new MOSPassConfig(*this, PM);
 }
 
-void MOSPassConfig::addIRPasses() {
+// Adds the IR passes that need to see the whole program at once, as they do
+// under LTO. When LTO code generation is split into partitions, these run once
+// on the merged module before it's split; see prepareForSplitCodeGen.
+static void addWholeProgramPasses(CodeGenOpt::Level OptLevel,
+                                  function_ref<void(Pass *)> AddPass) {
+  // Replace expensive byte computations with lookup tables. Tables cost ROM,
+  // so this is only done when optimizing aggressively for speed.
+  if (OptLevel == CodeGenOpt::Aggressive)
+    AddPass(createMOSLookupTablesPass());
+
+  // Split tables of multi-byte values into byte tables indexable by X or Y.
+  if (OptLevel != CodeGenOpt::None)
+    AddPass(createMOSSplitTablesPass());
+
+  // Give each interrupt its own copies of small shared functions, so that
+  // MOSNoRecurse can leave them all norecurse.
+  if (OptLevel != CodeGenOpt::None)
+    AddPass(createMOSInterruptClonePass());
+
   // Aggressively find provably non-recursive functions.
-  addPass(createMOSNoRecursePass());
+  AddPass(createMOSNoRecursePass());
+
+  // Pass arguments of local functions where they're used.
+  if (OptLevel != CodeGenOpt::None)
+    AddPass(createMOSInternalCCPass());
+}
+
+void MOSPassConfig::addIRPasses() {
+  addWholeProgramPasses(getOptLevel(), [&](Pass *P) { addPass(P); });
+
+  // Turn atomics wider than a byte into libcalls.
+  addPass(createAtomicExpandPass());
+
   TargetPassConfig::addIRPasses();
 }
 
+bool MOS::isWholeProgram(const Module &M) {
+  return M.getModuleFlag(WholeProgramFlag) != nullptr;
+}
+
+bool MOS::wholeProgramPassesRan(const Module &M) {
+  return M.getModuleFlag(WholeProgramPassesFlag) != nullptr;
+}
+
+// Returns whether more than one interrupt context may be active at once.
+static bool hasMultipleContexts(const Module &M) {
+  unsigned NumNorecurseRoots = 0;
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    if (F.hasFnAttribute("interrupt"))
+      return true;
+    if (F.hasFnAttribute("interrupt-norecurse") || F.getName() == "main")
+      ++NumNorecurseRoots;
+  }
+  return NumNorecurseRoots > 1;
+}
+
+void MOSTargetMachine::markWholeProgram(Module &M) {
+  M.addModuleFlag(Module::Max, MOS::WholeProgramFlag, 1);
+}
+
+bool MOSTargetMachine::prepareForSplitCodeGen(Module &M) {
+  legacy::PassManager PM;
+  PM.add(createTargetTransformInfoWrapperPass(getTargetIRAnalysis()));
+  addWholeProgramPasses(getOptLevel(), [&](Pass *P) { PM.add(P); });
+  PM.run(M);
+  // The flag is copied into each partition, where it keeps the passes from
+  // running again on only part of the program.
+  M.addModuleFlag(Module::Max, MOS::WholeProgramPassesFlag, 1);
+
+  // MOSLibcallRecursion can only tell which contexts reach each libcall once
+  // every function in the program has been legalized. If it might strip
+  // norecurse from a libcall, the program can't be split.
+  if (!hasMultipleContexts(M))
+    return true;
+  for (const char *LibcallName : lto::LTO::getRuntimeLibcallSymbols()) {
+    const Function *Libcall = M.getFunction(LibcallName);
+    if (Libcall && !Libcall->isDeclaration() && Libcall->doesNotRecurse())
+      return false;
+  }
+  return true;
+}
+
 bool MOSPassConfig::addPreISel() {
   addPass(createLowerSwitchPass());
   return false;
@@ -201,6 +310,9 @@ void MOSPassConfig::addPreLegalizeMachineIR() { addPass(createMOSCombiner()); }
 
 bool MOSPassConfig::addLegalizeMachineIR() {
   addPass(new Legalizer());
+  // Once every function has been legalized, the libcalls reachable from each
+  // interrupt are known.
+  addPass(createMOSLibcallRecursionPass());
   return false;
 }
 
@@ -226,6 +338,11 @@ bool MOSPassConfig::addGlobalInstructionSelect() {
   return false;
 }
 
+void MOSPassConfig::addPreRegAlloc() {
+  // Patch loop-invariant pointers into the code of RAM-resident functions.
+  addPass(createMOSSelfModifyPass());
+}
+
 void MOSPassConfig::addPreSched2() {
   addPass(createMOSPostRAScavengingPass());
   // Lower control flow pseudos.
@@ -235,7 +352,20 @@ void MOSPassConfig::addPreSched2() {
   addPass(createMOSStaticStackAllocPass());
 }
 
-void MOSPassConfig::addPreEmitPass() { addPass(&BranchRelaxationPassID); }
+void MOSPassConfig::addPreEmitPass() {
+  // Compile cold 16-bit code to SWEET16 bytecode. This shrinks blocks, so it
+  // goes before anything that depends on their sizes.
+  addPass(createMOSSweet16Pass());
+  // Move cold blocks out from between conditional branches and their
+  // destinations, so fewer branches need relaxation.
+  if (getOptLevel() != CodeGenOpt::None)
+    addPass(createMOSBranchPlacementPass());
+  // Keep indexed tables and hot loops from crossing pages. This may align
+  // blocks, so it must precede branch relaxation.
+  if (getOptLevel() != CodeGenOpt::None)
+    addPass(createMOSPageCrossPass());
+  addPass(&BranchRelaxationPassID);
+}
 
 ScheduleDAGInstrs *
 MOSPassConfig::createMachineScheduler(MachineSchedContext *C) const {
@@ -45,6 +45,9 @@ public:
 
   TargetPassConfig *createPassConfig(PassManagerBase &PM) override;
 
+  void markWholeProgram(Module &M) override;
+  bool prepareForSplitCodeGen(Module &M) override;
+
   // The 6502 has only register-related scheduling concerns, so disable PostRA
   // scheduling by claiming to emit it ourselves, then never doing so.
   bool targetSchedulesPostRAScheduling() const override { return true; };
@@ -8,5 +8,97 @@
 
 #include "MOSTargetObjectFile.h"
 
+#include "MOS.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalObject.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/ProfileData/InstrProfData.inc"
+#include "llvm/Target/TargetMachine.h"
+
 namespace llvm {
+
+MCSection *MOSTargetObjectFile::getExplicitSectionGlobal(
+    const GlobalObject *GO, SectionKind Kind, const TargetMachine &TM) const {
+  // Profile data records and names are only ever read out of the executable by
+  // llvm-mos-profdump. Keeping them out of the target's address space matters
+  // a great deal when that's only 64KiB.
+  StringRef Name = GO->getSection();
+  if (Name == INSTR_PROF_QUOTE(INSTR_PROF_DATA_COMMON) ||
+      Name == INSTR_PROF_QUOTE(INSTR_PROF_NAME_COMMON))
+    Kind = SectionKind::getMetadata();
+  return Base::getExplicitSectionGlobal(GO, Kind, TM);
+}
+
+static bool mustNotCrossPage(const GlobalObject *GO) {
+  if (const auto *F = dyn_cast<Function>(GO))
+    return F->hasFnAttribute(MOS::NoPageCrossAttr);
+  if (const auto *GV = dyn_cast<GlobalVariable>(GO))
+    return GV->hasAttribute(MOS::NoPageCrossAttr);
+  return false;
+}
+
+MCSection *MOSTargetObjectFile::SelectSectionForGlobal(
+    const GlobalObject *GO, SectionKind Kind, const TargetMachine &TM) const {
+  if (GO->getAddressSpace() != MOS::AS_ZeroPage) {
+    if (mustNotCrossPage(GO) && !GO->hasComdat() && !Kind.isThreadLocal())
+      return selectNoPageCrossSection(GO, Kind, TM);
+    return Base::SelectSectionForGlobal(GO, Kind, TM);
+  }
+
+  // Globals addressed by 8-bit pointers must be placed in the zero page. The
+  // section flag also tells the assembler that references to them fit in a
+  // byte. Constants get a read-only section, just as they would outside the
+  // zero page.
+  StringRef Prefix = ".zp.data";
+  unsigned Type = ELF::SHT_PROGBITS;
+  unsigned Flags = ELF::SHF_ALLOC | ELF::SHF_MOS_ZEROPAGE;
+  if (Kind.isReadOnly()) {
+    Prefix = ".zp.rodata";
+  } else if (Kind.isBSS()) {
+    Prefix = ".zp.bss";
+    Type = ELF::SHT_NOBITS;
+    Flags |= ELF::SHF_WRITE;
+  } else {
+    Flags |= ELF::SHF_WRITE;
+  }
+  SmallString<32> Name(Prefix);
+  if (TM.getDataSections()) {
+    Name += '.';
+    Name += TM.getSymbol(GO)->getName();
+  }
+  return getContext().getELFSection(Name, Type, Flags);
+}
+
+MCSection *MOSTargetObjectFile::selectNoPageCrossSection(
+    const GlobalObject *GO, SectionKind Kind, const TargetMachine &TM) const {
+  // The linker keeps whole sections from straddling a page, so the object
+  // needs a section of its own, whether or not function or data sections were
+  // requested. The name matches the one those options would give, so every
+  // request for the object's section gets the same flagged section.
+  StringRef Prefix;
+  unsigned Type = ELF::SHT_PROGBITS;
+  unsigned Flags = ELF::SHF_ALLOC | ELF::SHF_MOS_NOPAGECROSS;
+  if (Kind.isText()) {
+    Prefix = ".text";
+    Flags |= ELF::SHF_EXECINSTR;
+  } else if (Kind.isReadOnly()) {
+    Prefix = ".rodata";
+  } else if (Kind.isBSS()) {
+    Prefix = ".bss";
+    Type = ELF::SHT_NOBITS;
+    Flags |= ELF::SHF_WRITE;
+  } else {
+    Prefix = ".data";
+    Flags |= ELF::SHF_WRITE;
+  }
+  return getContext().getELFSection(
+      Prefix + "." + TM.getSymbol(GO)->getName(), Type, Flags);
+}
+
 } // end of namespace llvm
@@ -16,6 +16,16 @@ namespace llvm {
 /// Lowering for an MOS ELF32 object file.
 class MOSTargetObjectFile : public TargetLoweringObjectFileELF {
   typedef TargetLoweringObjectFileELF Base;
+
+public:
+  MCSection *getExplicitSectionGlobal(const GlobalObject *GO, SectionKind Kind,
+                                      const TargetMachine &TM) const override;
+  MCSection *SelectSectionForGlobal(const GlobalObject *GO, SectionKind Kind,
+                                    const TargetMachine &TM) const override;
+
+private:
+  MCSection *selectNoPageCrossSection(const GlobalObject *GO, SectionKind Kind,
+                                      const TargetMachine &TM) const;
 };
 
 } // end namespace llvm
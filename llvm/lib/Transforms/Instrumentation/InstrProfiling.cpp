@@ -69,6 +69,12 @@ cl::opt<bool> RuntimeCounterRelocation(
     cl::desc("Enable relocating counters at runtime."),
     cl::init(false));
 
+cl::opt<unsigned> MOSCounterWidth(
+    "mos-instrprof-counter-width",
+    cl::desc("Width in bits of the saturating profile counters used on MOS "
+             "(8 or 16)"),
+    cl::init(16));
+
 cl::opt<bool> ValueProfileStaticAlloc(
     "vp-static-alloc",
     cl::desc("Do static counter allocation for value profiler"),
@@ -453,7 +459,11 @@ bool InstrProfiling::lowerIntrinsics(Function *F) {
         lowerIncrement(Inc);
         MadeChange = true;
       } else if (auto *Ind = dyn_cast<InstrProfValueProfileInst>(Instr)) {
-        lowerValueProfileInst(Ind);
+        // Value profiling requires a runtime to record the values.
+        if (usesSaturatingCounters())
+          Ind->eraseFromParent();
+        else
+          lowerValueProfileInst(Ind);
         MadeChange = true;
       }
     }
@@ -474,12 +484,28 @@ bool InstrProfiling::isRuntimeCounterRelocationEnabled() const {
 }
 
 bool InstrProfiling::isCounterPromotionEnabled() const {
+  // Promoted counters are summed on loop exit, which would undo saturation.
+  if (usesSaturatingCounters())
+    return false;
+
   if (DoCounterPromotion.getNumOccurrences() > 0)
     return DoCounterPromotion;
 
   return Options.DoCounterPromotion;
 }
 
+bool InstrProfiling::usesSaturatingCounters() const {
+  return TT.getArch() == Triple::mos;
+}
+
+Type *InstrProfiling::getCounterType() const {
+  if (!usesSaturatingCounters())
+    return Type::getInt64Ty(M->getContext());
+  if (MOSCounterWidth != 8 && MOSCounterWidth != 16)
+    report_fatal_error("MOS profile counters must be 8 or 16 bits wide");
+  return Type::getIntNTy(M->getContext(), MOSCounterWidth);
+}
+
 void InstrProfiling::promoteCounterLoadStores(Function *F) {
   if (!isCounterPromotionEnabled())
     return;
@@ -701,8 +727,23 @@ void InstrProfiling::lowerIncrement(InstrProfIncrementInst *Inc) {
     Addr = Builder.CreateIntToPtr(Add, Int64PtrTy);
   }
 
-  if (Options.Atomic || AtomicCounterUpdateAll ||
-      (Index == 0 && AtomicFirstCounter)) {
+  if (usesSaturatingCounters()) {
+    // There is no room for 64-bit counters on MOS, so the counters are narrow
+    // instead. They saturate rather than wrap, so hot blocks stay hot.
+    auto *CounterTy = cast<IntegerType>(getCounterType());
+    Value *Step = Inc->getStep();
+    if (auto *CStep = dyn_cast<ConstantInt>(Step))
+      Step = ConstantInt::get(CounterTy,
+                              std::min(CStep->getZExtValue(),
+                                       CounterTy->getBitMask()));
+    else
+      Step = Builder.CreateZExtOrTrunc(Step, CounterTy);
+    Value *Load = Builder.CreateLoad(CounterTy, Addr, "pgocount");
+    Value *Count =
+        Builder.CreateBinaryIntrinsic(Intrinsic::uadd_sat, Load, Step);
+    Builder.CreateStore(Count, Addr);
+  } else if (Options.Atomic || AtomicCounterUpdateAll ||
+             (Index == 0 && AtomicFirstCounter)) {
     Builder.CreateAtomicRMW(AtomicRMWInst::Add, Addr, Inc->getStep(),
                             MaybeAlign(), AtomicOrdering::Monotonic);
   } else {
@@ -782,6 +823,9 @@ static bool needsRuntimeRegistrationOfSectionRange(const Triple &TT) {
   // Don't do this for Darwin.  compiler-rt uses linker magic.
   if (TT.isOSDarwin())
     return false;
+  // MOS has no profile runtime; the counters are read from a memory dump.
+  if (TT.getArch() == Triple::mos)
+    return false;
   // Use linker script magic to get data/cnts/name start/end.
   if (TT.isOSLinux() || TT.isOSFreeBSD() || TT.isOSNetBSD() ||
       TT.isOSSolaris() || TT.isOSFuchsia() || TT.isPS4CPU() ||
@@ -848,7 +892,7 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
 
   uint64_t NumCounters = Inc->getNumCounters()->getZExtValue();
   LLVMContext &Ctx = M->getContext();
-  ArrayType *CounterTy = ArrayType::get(Type::getInt64Ty(Ctx), NumCounters);
+  ArrayType *CounterTy = ArrayType::get(getCounterType(), NumCounters);
 
   // Create the counters variable.
   auto *CounterPtr =
@@ -856,9 +900,16 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
                          Constant::getNullValue(CounterTy),
                          getVarName(Inc, getInstrProfCountersVarPrefix()));
   CounterPtr->setVisibility(Visibility);
-  CounterPtr->setSection(
-      getInstrProfSectionName(IPSK_cnts, TT.getObjectFormat()));
-  CounterPtr->setAlignment(Align(8));
+  if (usesSaturatingCounters()) {
+    // Place the counters with the other zero-initialized data, so that they
+    // end up in RAM and are cleared on startup.
+    CounterPtr->setSection(".bss.__llvm_prf_cnts");
+    CounterPtr->setAlignment(Align(1));
+  } else {
+    CounterPtr->setSection(
+        getInstrProfSectionName(IPSK_cnts, TT.getObjectFormat()));
+    CounterPtr->setAlignment(Align(8));
+  }
   MaybeSetComdat(CounterPtr);
   CounterPtr->setLinkage(Linkage);
 
@@ -866,7 +917,8 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
   // Allocate statically the array of pointers to value profile nodes for
   // the current function.
   Constant *ValuesPtrExpr = ConstantPointerNull::get(Int8PtrTy);
-  if (ValueProfileStaticAlloc && !needsRuntimeRegistrationOfSectionRange(TT)) {
+  if (ValueProfileStaticAlloc && !needsRuntimeRegistrationOfSectionRange(TT) &&
+      !usesSaturatingCounters()) {
     uint64_t NS = 0;
     for (uint32_t Kind = IPVK_First; Kind <= IPVK_Last; ++Kind)
       NS += PD.NumValueSites[Kind];
@@ -913,7 +965,10 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
                          ConstantStruct::get(DataTy, DataVals), DataVarName);
   Data->setVisibility(Visibility);
   Data->setSection(getInstrProfSectionName(IPSK_data, TT.getObjectFormat()));
-  Data->setAlignment(Align(INSTR_PROF_DATA_ALIGNMENT));
+  // On MOS, the data records are read from the executable by
+  // llvm-mos-profdump, which expects them to be packed.
+  Data->setAlignment(
+      Align(usesSaturatingCounters() ? 1 : INSTR_PROF_DATA_ALIGNMENT));
   MaybeSetComdat(Data);
   Data->setLinkage(Linkage);
 
@@ -1063,6 +1118,10 @@ bool InstrProfiling::emitRuntimeHook() {
   if (TT.isOSLinux() || TT.isOSFuchsia())
     return false;
 
+  // MOS has no profile runtime to pull in.
+  if (usesSaturatingCounters())
+    return false;
+
   // If the module's provided its own runtime, we don't need to do anything.
   if (M->getGlobalVariable(getInstrProfRuntimeHookVarName()))
     return false;
@@ -0,0 +1,20 @@
+; RUN: llc -mtriple=mos -stop-after=legalizer -verify-machineinstrs < %s | FileCheck %s
+
+; An exchange whose old value is unused becomes a store, which must keep the
+; exchange's ordering.
+
+@x = global i8 0
+
+define void @xchg_seq_cst() {
+; CHECK-LABEL: name: xchg_seq_cst
+; CHECK: G_STORE {{.*}} :: (store seq_cst 1 into @x)
+  %old = atomicrmw xchg i8* @x, i8 5 seq_cst
+  ret void
+}
+
+define void @xchg_release() {
+; CHECK-LABEL: name: xchg_release
+; CHECK: G_STORE {{.*}} :: (store release 1 into @x)
+  %old = atomicrmw xchg i8* @x, i8 5 release
+  ret void
+}
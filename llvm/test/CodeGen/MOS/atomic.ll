@@ -0,0 +1,135 @@
+; RUN: llc -mtriple=mos -stop-after=legalizer -verify-machineinstrs < %s | FileCheck %s
+; RUN: llc -mtriple=mos -mcpu=mos65c02 -stop-after=legalizer -verify-machineinstrs < %s | FileCheck %s --check-prefix=CMOS
+
+@x = global i8 0
+
+; Adding or subtracting one with an unused result is a single INC or DEC.
+
+define void @inc() {
+; CHECK-LABEL: name: inc
+; CHECK-NOT: SEI_Implied
+; CHECK: INCAbs @x
+  %old = atomicrmw add i8* @x, i8 1 monotonic
+  ret void
+}
+
+define void @dec() {
+; CHECK-LABEL: name: dec
+; CHECK-NOT: SEI_Implied
+; CHECK: DECAbs @x
+  %old = atomicrmw sub i8* @x, i8 1 monotonic
+  ret void
+}
+
+; The 65C02 sets and clears bits with TSB and TRB. TRB clears the bits set in
+; A, so an and takes the complement of its mask.
+
+define void @or_unused() {
+; CMOS-LABEL: name: or_unused
+; CMOS-NOT: SEI_Implied
+; CMOS: [[A:%[0-9]+]]:ac = COPY
+; CMOS: TSBAbs [[A]], @x
+; CHECK-LABEL: name: or_unused
+; CHECK: SEI_Implied
+; CHECK: G_OR
+  %old = atomicrmw or i8* @x, i8 4 monotonic
+  ret void
+}
+
+define void @and_unused() {
+; CMOS-LABEL: name: and_unused
+; CMOS-NOT: SEI_Implied
+; CMOS: [[A:%[0-9]+]]:ac = COPY
+; CMOS: TRBAbs [[A]], @x
+; CHECK-LABEL: name: and_unused
+; CHECK: SEI_Implied
+; CHECK: G_AND
+  %old = atomicrmw and i8* @x, i8 -5 monotonic
+  ret void
+}
+
+; A used result needs the critical section even on the 65C02.
+
+define i8 @or_used() {
+; CMOS-LABEL: name: or_used
+; CMOS: SEI_Implied
+; CMOS: G_OR
+  %old = atomicrmw or i8* @x, i8 4 monotonic
+  ret i8 %old
+}
+
+; Other operations are wrapped in PHP; SEI ... PLP.
+
+define i8 @xor(i8 %v) {
+; CHECK-LABEL: name: xor
+; CHECK: PH undef $p
+; CHECK-NEXT: SEI_Implied
+; CHECK: [[OLD:%[0-9]+]]:_(s8) = G_LOAD {{.*}} :: (load monotonic 1 from @x)
+; CHECK: [[NEW:%[0-9]+]]:_(s8) = G_XOR [[OLD]], {{%[0-9]+}}
+; CHECK: G_STORE [[NEW]](s8), {{.*}} :: (store monotonic 1 into @x)
+; CHECK: dead $p = PL
+  %old = atomicrmw xor i8* @x, i8 %v seq_cst
+  ret i8 %old
+}
+
+define i8 @nand(i8 %v) {
+; CHECK-LABEL: name: nand
+; CHECK: PH undef $p
+; CHECK-NEXT: SEI_Implied
+; CHECK: G_AND
+; CHECK: G_XOR
+; CHECK: G_STORE
+; CHECK: dead $p = PL
+  %old = atomicrmw nand i8* @x, i8 %v seq_cst
+  ret i8 %old
+}
+
+define i8 @umax(i8 %v) {
+; CHECK-LABEL: name: umax
+; CHECK: PH undef $p
+; CHECK-NEXT: SEI_Implied
+; CHECK: G_STORE
+; CHECK: dead $p = PL
+  %old = atomicrmw umax i8* @x, i8 %v seq_cst
+  ret i8 %old
+}
+
+; Compare-exchange stores either the new or the old value back, inside the
+; critical section.
+
+define i8 @cmpxchg(i8 %cmp, i8 %new) {
+; CHECK-LABEL: name: cmpxchg
+; CHECK: PH undef $p
+; CHECK-NEXT: SEI_Implied
+; CHECK: G_LOAD
+; CHECK: G_STORE
+; CHECK: dead $p = PL
+  %pair = cmpxchg i8* @x, i8 %cmp, i8 %new seq_cst seq_cst
+  %old = extractvalue { i8, i1 } %pair, 0
+  ret i8 %old
+}
+
+define i1 @cmpxchg_success(i8 %cmp, i8 %new) {
+; CHECK-LABEL: name: cmpxchg_success
+; CHECK: PH undef $p
+; CHECK-NEXT: SEI_Implied
+; CHECK: G_LOAD
+; CHECK: G_STORE
+; CHECK: dead $p = PL
+  %pair = cmpxchg i8* @x, i8 %cmp, i8 %new seq_cst seq_cst
+  %ok = extractvalue { i8, i1 } %pair, 1
+  ret i1 %ok
+}
+
+; Fences emit nothing, but stay as barriers to code motion.
+
+define void @fence() {
+; CHECK-LABEL: name: fence
+; CHECK: G_STORE
+; CHECK: CompilerBarrier
+; CHECK: G_STORE
+  store volatile i8 1, i8* @x
+  fence seq_cst
+  store volatile i8 2, i8* @x
+  ret void
+}
@@ -0,0 +1,42 @@
+; RUN: llc -mtriple=mos -verify-machineinstrs < %s | FileCheck %s --check-prefix=NMOS
+; RUN: llc -mtriple=mos -mcpu=mos65c02 -verify-machineinstrs < %s | FileCheck %s --check-prefix=CMOS
+
+; NMOS processors keep decimal mode on interrupt, so interrupts are masked for
+; the decimal-mode region. The 65C02 clears decimal mode on interrupt itself.
+
+define i16 @add16(i16 %a, i16 %b) {
+; NMOS-LABEL: add16:
+; NMOS:       php
+; NMOS-NEXT:  sei
+; NMOS-NEXT:  sed
+; NMOS:       adc
+; NMOS:       adc
+; NMOS:       plp
+; NMOS-NOT:   cld
+; NMOS:       rts
+; CMOS-LABEL: add16:
+; CMOS-NOT:   php
+; CMOS:       sed
+; CMOS:       adc
+; CMOS:       adc
+; CMOS:       cld
+; CMOS-NOT:   plp
+; CMOS:       rts
+  %r = call i16 @llvm.mos.bcd.add16(i16 %a, i16 %b)
+  ret i16 %r
+}
+
+define i8 @sub8(i8 %a, i8 %b) {
+; NMOS-LABEL: sub8:
+; NMOS:       php
+; NMOS-NEXT:  sei
+; NMOS-NEXT:  sed
+; NMOS:       sbc
+; NMOS:       plp
+; NMOS:       rts
+  %r = call i8 @llvm.mos.bcd.sub8(i8 %a, i8 %b)
+  ret i8 %r
+}
+
+declare i16 @llvm.mos.bcd.add16(i16, i16)
+declare i8 @llvm.mos.bcd.sub8(i8, i8)
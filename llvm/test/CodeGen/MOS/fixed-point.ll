@@ -0,0 +1,59 @@
+; RUN: llc -mtriple=mos -verify-machineinstrs < %s | FileCheck %s
+
+; Fixed-point multiplies and divides by variables are expanded inline, rather
+; than calling the wide multiply and divide routines.
+
+define i8 @smul_fix_i8(i8 %a, i8 %b) {
+; CHECK-LABEL: smul_fix_i8:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i8 @llvm.smul.fix.i8(i8 %a, i8 %b, i32 7)
+  ret i8 %r
+}
+
+define i16 @smul_fix_i16(i16 %a, i16 %b) {
+; CHECK-LABEL: smul_fix_i16:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i16 @llvm.smul.fix.i16(i16 %a, i16 %b, i32 7)
+  ret i16 %r
+}
+
+define i16 @umul_fix_sat_i16(i16 %a, i16 %b) {
+; CHECK-LABEL: umul_fix_sat_i16:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i16 @llvm.umul.fix.sat.i16(i16 %a, i16 %b, i32 8)
+  ret i16 %r
+}
+
+define i32 @smul_fix_i32(i32 %a, i32 %b) {
+; CHECK-LABEL: smul_fix_i32:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i32 @llvm.smul.fix.i32(i32 %a, i32 %b, i32 15)
+  ret i32 %r
+}
+
+define i8 @udiv_fix_i8(i8 %a, i8 %b) {
+; CHECK-LABEL: udiv_fix_i8:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i8 @llvm.udiv.fix.i8(i8 %a, i8 %b, i32 4)
+  ret i8 %r
+}
+
+define i16 @sdiv_fix_sat_i16(i16 %a, i16 %b) {
+; CHECK-LABEL: sdiv_fix_sat_i16:
+; CHECK-NOT: jsr
+; CHECK: rts
+  %r = call i16 @llvm.sdiv.fix.sat.i16(i16 %a, i16 %b, i32 7)
+  ret i16 %r
+}
+
+declare i8 @llvm.smul.fix.i8(i8, i8, i32)
+declare i16 @llvm.smul.fix.i16(i16, i16, i32)
+declare i16 @llvm.umul.fix.sat.i16(i16, i16, i32)
+declare i32 @llvm.smul.fix.i32(i32, i32, i32)
+declare i8 @llvm.udiv.fix.i8(i8, i8, i32)
+declare i16 @llvm.sdiv.fix.sat.i16(i16, i16, i32)
@@ -0,0 +1,54 @@
+; RUN: llc -mtriple=mos -stop-after=legalizer -verify-machineinstrs < %s | FileCheck %s
+
+; A wide equality comparison that feeds a branch becomes a chain of byte
+; comparisons, each followed by a branch, from the low byte up. The chain
+; leaves for the false destination at the first byte that differs.
+
+declare void @g()
+
+define void @eq(i16 %a, i16 %b) {
+; CHECK-LABEL: name: eq
+; CHECK:      [[A:%[0-9]+]]:_(s8), [[AH:%[0-9]+]]:_(s8) = G_UNMERGE_VALUES
+; CHECK:      [[B:%[0-9]+]]:_(s8), [[BH:%[0-9]+]]:_(s8) = G_UNMERGE_VALUES
+; CHECK:      G_SBC [[A]], [[B]]
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[HI:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[FALSE:[0-9]+]]
+; CHECK:    bb.[[HI]]
+; CHECK:      G_SBC [[AH]], [[BH]]
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[TRUE:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[FALSE]]
+; CHECK:    bb.[[TRUE]]
+; CHECK:      JSR
+; CHECK:    bb.[[FALSE]]
+; CHECK:      RTS
+  %c = icmp eq i16 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  call void @g()
+  ret void
+f:
+  ret void
+}
+
+; With ne, the byte chain branches to the other destination when equal.
+define void @ne(i32 %a, i32 %b) {
+; CHECK-LABEL: name: ne
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[B1:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[NE:[0-9]+]]
+; CHECK:    bb.[[B1]]
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[B2:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[NE]]
+; CHECK:    bb.[[B2]]
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[B3:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[NE]]
+; CHECK:    bb.[[B3]]
+; CHECK:      G_BRCOND_IMM {{%[0-9]+}}(s1), %bb.[[EQ:[0-9]+]], 1
+; CHECK-NEXT: G_BR %bb.[[NE]]
+  %c = icmp ne i32 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  call void @g()
+  ret void
+f:
+  ret void
+}
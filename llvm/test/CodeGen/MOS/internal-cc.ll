@@ -0,0 +1,38 @@
+; RUN: llc -mtriple=mos -stop-after=irtranslator < %s | FileCheck %s
+
+@arr = global [16 x i8] zeroinitializer
+
+; Index arguments are assigned before the others, so an earlier byte can't
+; take X from them. Y only carries index arguments.
+
+; CHECK-LABEL: name: callee
+; CHECK: liveins:
+; CHECK-DAG: $x
+; CHECK-DAG: $y
+; CHECK-DAG: $a
+; CHECK-DAG: $rc2
+; CHECK: [[I:%[0-9]+]]:_(s8) = COPY $x
+; CHECK: [[J:%[0-9]+]]:_(s8) = COPY $y
+; CHECK: [[A:%[0-9]+]]:_(s8) = COPY $a
+; CHECK: [[B:%[0-9]+]]:_(s8) = COPY $rc2
+define internal fastcc i8 @callee(i8 %a, i8 %b, i8 inreg %i, i8 inreg %j) {
+  %p = getelementptr [16 x i8], [16 x i8]* @arr, i8 0, i8 %i
+  %q = getelementptr [16 x i8], [16 x i8]* @arr, i8 0, i8 %j
+  %v = load i8, i8* %p
+  %w = load i8, i8* %q
+  %s = add i8 %v, %w
+  %t = add i8 %s, %a
+  %u = add i8 %t, %b
+  ret i8 %u
+}
+
+; CHECK-LABEL: name: caller
+; CHECK-DAG: $x = COPY
+; CHECK-DAG: $y = COPY
+; CHECK-DAG: $a = COPY
+; CHECK-DAG: $rc2 = COPY
+; CHECK: JSR @callee
+define i8 @caller(i8 %a, i8 %b, i8 %i, i8 %j) {
+  %r = call fastcc i8 @callee(i8 %a, i8 %b, i8 inreg %i, i8 inreg %j)
+  ret i8 %r
+}
@@ -0,0 +1,27 @@
+; RUN: llc -mtriple=mos -O2 < %s | FileCheck %s
+; RUN: sed -e '/mos-whole-program/d' -e 's/!{!0}/!{}/' %s | llc -mtriple=mos -O2 | FileCheck %s --check-prefix=PARTIAL
+
+; A function shared by main and an interrupt-norecurse handler is cloned for
+; the handler, but only when the module is the whole program. Otherwise, code
+; outside the module could call it from either context.
+
+define internal void @shared() noinline {
+  store volatile i8 1, i8* inttoptr (i16 512 to i8*)
+  ret void
+}
+
+define void @main() {
+  call void @shared()
+  ret void
+}
+
+define void @isr() "interrupt-norecurse" {
+  call void @shared()
+  ret void
+}
+
+; CHECK: shared.isr:
+; PARTIAL-NOT: shared.isr
+
+!llvm.module.flags = !{!0}
+!0 = !{i32 7, !"mos-whole-program", i32 1}
@@ -0,0 +1,47 @@
+; RUN: llc -mtriple=mos -stop-after=legalizer < %s | FileCheck %s --check-prefix=LEGAL
+; RUN: llc -mtriple=mos < %s | FileCheck %s
+
+@arr = addrspace(1) global [16 x i8] zeroinitializer
+
+; Zero page pointers convert to and from wider integers through their 8-bit
+; form.
+
+; LEGAL-LABEL: name: int_to_zp
+; LEGAL: [[TRUNC:%[0-9]+]]:_(s8) = G_TRUNC
+; LEGAL: G_INTTOPTR [[TRUNC]](s8)
+define i8 @int_to_zp(i16 %a) {
+  %p = inttoptr i16 %a to i8 addrspace(1)*
+  %v = load i8, i8 addrspace(1)* %p
+  ret i8 %v
+}
+
+; LEGAL-LABEL: name: zp_to_int
+; LEGAL: [[INT:%[0-9]+]]:_(s8) = G_PTRTOINT
+; LEGAL: G_ZEXT [[INT]](s8)
+define i16 @zp_to_int(i8 addrspace(1)* %p) {
+  %a = ptrtoint i8 addrspace(1)* %p to i16
+  ret i16 %a
+}
+
+; A zero page index of unknown sign relies on wrapping around within the zero
+; page, so it must use the zp,X forms; abs,Y would reach into page one.
+
+; CHECK-LABEL: load_signed_index:
+; CHECK-NOT: ,y
+; CHECK: lda arr,x
+; CHECK: rts
+define i8 @load_signed_index(i8 %i) {
+  %p = getelementptr [16 x i8], [16 x i8] addrspace(1)* @arr, i8 0, i8 %i
+  %v = load i8, i8 addrspace(1)* %p
+  ret i8 %v
+}
+
+; CHECK-LABEL: store_signed_index:
+; CHECK-NOT: ,y
+; CHECK: sta arr,x
+; CHECK: rts
+define void @store_signed_index(i8 %i, i8 %v) {
+  %p = getelementptr [16 x i8], [16 x i8] addrspace(1)* @arr, i8 0, i8 %i
+  store i8 %v, i8 addrspace(1)* %p
+  ret void
+}
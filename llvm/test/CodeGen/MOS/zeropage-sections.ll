@@ -0,0 +1,16 @@
+; RUN: llc -mtriple=mos < %s | FileCheck %s
+
+; Zero page globals are placed in sections flagged for the zero page, and
+; constants among them stay read-only.
+
+; CHECK: .section .zp.rodata,"az",@progbits
+; CHECK: ro:
+@ro = addrspace(1) constant i8 1
+
+; CHECK: .section .zp.data,"awz",@progbits
+; CHECK: rw:
+@rw = addrspace(1) global i8 1
+
+; CHECK: .section .zp.bss,"awz",@nobits
+; CHECK: bss:
+@bss = addrspace(1) global i8 0
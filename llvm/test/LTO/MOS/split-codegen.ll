@@ -0,0 +1,75 @@
+; Full LTO code generation split into partitions gets the results of the
+; whole-program passes, which run once on the merged module beforehand.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-lto2 run %t.bc -o %t.one -filetype=asm -lto-whole-program-visibility \
+; RUN:   -r %t.bc,main,px -r %t.bc,isr,px
+; RUN: llvm-lto2 run %t.bc -o %t.two -filetype=asm -lto-whole-program-visibility \
+; RUN:   -lto-partitions=2 -r %t.bc,main,px -r %t.bc,isr,px
+; RUN: FileCheck %s < %t.one.0
+; RUN: sed -n '/^shared:/,/rts/p' %t.one.0 | FileCheck %s --check-prefix=SHARED
+; RUN: cat %t.two.0 %t.two.1 | FileCheck %s
+; RUN: cat %t.two.0 %t.two.1 | sed -n '/^shared:/,/rts/p' | \
+; RUN:   FileCheck %s --check-prefix=SHARED
+
+; The interrupt gets its own copy of @shared. Both copies stay norecurse, so
+; both get static stack frames, wherever they end up.
+; CHECK-DAG: {{^}}shared:
+; CHECK-DAG: {{^}}shared.isr:
+; CHECK-DAG: __shared_sstk
+; CHECK-DAG: __shared.isr_sstk
+
+; @shared uses the internal calling convention, which passes its index in X
+; rather than A.
+; SHARED: shared:
+; SHARED-NOT: ta{{[xy]}}
+; SHARED: arr,x
+
+; When several interrupt contexts exist and the program defines a libcall that
+; is still norecurse, the program is not split, since MOSLibcallRecursion
+; needs to see the whole program after legalization.
+
+; RUN: sed -e 's/^;LIBCALL: //' %s | llvm-as -o %t.libcall.bc
+; RUN: llvm-lto2 run %t.libcall.bc -o %t.libcall -filetype=asm \
+; RUN:   -lto-whole-program-visibility -lto-partitions=2 \
+; RUN:   -r %t.libcall.bc,main,px -r %t.libcall.bc,isr,px \
+; RUN:   -r %t.libcall.bc,__mulqi3,px
+; RUN: FileCheck %s --check-prefix=LIBCALL < %t.libcall.0
+; RUN: not ls %t.libcall.1
+
+; LIBCALL-DAG: {{^}}main:
+; LIBCALL-DAG: {{^}}isr:
+; LIBCALL-DAG: {{^}}__mulqi3:
+
+target datalayout = "e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8"
+target triple = "mos"
+
+@arr = internal global [16 x i8] zeroinitializer
+@out = internal global i8 0
+
+define internal void @shared(i8 %i) noinline {
+  %buf = alloca [4 x i8]
+  %idx = zext i8 %i to i16
+  %p = getelementptr [16 x i8], [16 x i8]* @arr, i16 0, i16 %idx
+  %v = load volatile i8, i8* %p
+  %b = getelementptr [4 x i8], [4 x i8]* %buf, i16 0, i16 0
+  store volatile i8 %v, i8* %b
+  %w = load volatile i8, i8* %b
+  store volatile i8 %w, i8* @out
+  ret void
+}
+
+define void @main() {
+  call void @shared(i8 1)
+  ret void
+}
+
+define void @isr() "interrupt-norecurse" {
+  call void @shared(i8 2)
+  ret void
+}
+
+;LIBCALL: define i8 @__mulqi3(i8 %a, i8 %b) norecurse {
+;LIBCALL:   %r = add i8 %a, %b
+;LIBCALL:   ret i8 %r
+;LIBCALL: }
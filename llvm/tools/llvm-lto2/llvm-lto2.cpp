@@ -163,6 +163,15 @@ static cl::opt<bool> EnableFreestanding(
     cl::desc("Enable Freestanding (disable builtins / TLI) during LTO"),
     cl::init(false), cl::Hidden);
 
+static cl::opt<unsigned>
+    Partitions("lto-partitions", cl::init(1),
+               cl::desc("Number of partitions for regular LTO code generation"));
+
+static cl::opt<bool> WholeProgramVisibility(
+    "lto-whole-program-visibility",
+    cl::desc("Assert that the LTO link sees every definition in the program"),
+    cl::init(false));
+
 static void check(Error E, std::string Msg) {
   if (!E)
     return;
@@ -275,6 +284,7 @@ static int run(int argc, char **argv) {
   Conf.OptLevel = OptLevel - '0';
   Conf.UseNewPM = UseNewPM;
   Conf.Freestanding = EnableFreestanding;
+  Conf.HasWholeProgramVisibility = WholeProgramVisibility;
   for (auto &PluginFN : PassPlugins)
     Conf.PassPlugins.push_back(PluginFN);
   switch (CGOptLevel) {
@@ -314,7 +324,7 @@ static int run(int argc, char **argv) {
   else
     Backend = createInProcessThinBackend(
         llvm::heavyweight_hardware_concurrency(Threads));
-  LTO Lto(std::move(Conf), std::move(Backend));
+  LTO Lto(std::move(Conf), std::move(Backend), Partitions);
 
   bool HasErrors = false;
   for (std::string F : InputFilenames) {
@@ -0,0 +1,233 @@
+//===-- llvm-mos-profdump.cpp - Convert MOS profile counters --------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// MOS targets have no profile runtime and no filesystem. Instead, instrumented
+// MOS programs keep narrow saturating counters in RAM, and this tool converts
+// a dump of that RAM (e.g., from an emulator) into an indexed profile suitable
+// for -fprofile-use or -fprofile-instr-use.
+//
+// The profile data records and function names are read from the (non-loaded)
+// __llvm_prf_data and __llvm_prf_names sections of the instrumented
+// executable; the counters they refer to are read from the memory dump.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/InstrProfWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::object;
+using namespace llvm::support;
+
+static cl::opt<std::string>
+    InputFilename(cl::Positional, cl::Required,
+                  cl::desc("<instrumented executable>"));
+
+static cl::opt<std::string> DumpFilename(cl::Positional, cl::Required,
+                                         cl::desc("<memory dump>"));
+
+static cl::opt<std::string> OutputFilename("o", cl::Required,
+                                           cl::desc("Output profile file"),
+                                           cl::value_desc("filename"));
+
+static cl::opt<unsigned>
+    DumpBase("dump-base", cl::init(0),
+             cl::desc("Address of the first byte of the memory dump"));
+
+static cl::opt<unsigned> CounterWidth(
+    "counter-width", cl::init(16),
+    cl::desc("Width in bits of the profile counters (8 or 16); must match "
+             "-mos-instrprof-counter-width at compile time"));
+
+static cl::opt<bool> TextOutput("text", cl::init(false),
+                                cl::desc("Write the profile in text format"));
+
+static StringRef ToolName;
+
+static void exitWithError(const Twine &Message) {
+  WithColor::error(errs(), ToolName) << Message << "\n";
+  exit(1);
+}
+
+static void exitWithError(Error E, StringRef Whence) {
+  handleAllErrors(std::move(E), [&](const ErrorInfoBase &EI) {
+    exitWithError(Whence + ": " + EI.message());
+  });
+}
+
+template <typename T> static T unwrapOrExit(Expected<T> V, StringRef Whence) {
+  if (!V)
+    exitWithError(V.takeError(), Whence);
+  return std::move(*V);
+}
+
+namespace {
+// A profile data record as laid out on MOS. Pointers are 16 bits, and there is
+// no padding. See INSTR_PROF_DATA in InstrProfData.inc.
+struct MOSProfData {
+  uint64_t NameRef;
+  uint64_t FuncHash;
+  uint16_t CounterPtr;
+  uint32_t NumCounters;
+
+  static constexpr size_t Size =
+      8 + 8 + 2 + 2 + 2 + 4 + 2 * (IPVK_Last - IPVK_First + 1);
+
+  static MOSProfData read(const uint8_t *P) {
+    MOSProfData D;
+    D.NameRef = endian::read64le(P);
+    D.FuncHash = endian::read64le(P + 8);
+    D.CounterPtr = endian::read16le(P + 16);
+    // Skip FunctionPointer and Values.
+    D.NumCounters = endian::read32le(P + 22);
+    return D;
+  }
+};
+} // namespace
+
+static StringRef getSectionContents(const ObjectFile &Obj, StringRef Name) {
+  for (const SectionRef &Sec : Obj.sections()) {
+    StringRef SecName = unwrapOrExit(Sec.getName(), InputFilename);
+    if (SecName == Name)
+      return unwrapOrExit(Sec.getContents(), InputFilename);
+  }
+  exitWithError(InputFilename + ": no " + Name +
+                " section; was the program built with -fprofile-generate?");
+  return {};
+}
+
+// Returns the value of __llvm_profile_raw_version, which records the kind of
+// instrumentation, or 0 if it is absent (front-end instrumentation).
+static uint64_t getProfileVersion(const ObjectFile &Obj) {
+  for (const SymbolRef &Sym : Obj.symbols()) {
+    StringRef Name = unwrapOrExit(Sym.getName(), InputFilename);
+    if (Name != INSTR_PROF_QUOTE(INSTR_PROF_RAW_VERSION_VAR))
+      continue;
+    section_iterator Sec = unwrapOrExit(Sym.getSection(), InputFilename);
+    if (Sec == Obj.section_end())
+      return 0;
+    uint64_t Offset = unwrapOrExit(Sym.getAddress(), InputFilename) -
+                      Sec->getAddress();
+    StringRef Contents = unwrapOrExit(Sec->getContents(), InputFilename);
+    if (Offset + 8 > Contents.size())
+      return 0;
+    return endian::read64le(Contents.data() + Offset);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+  cl::ParseCommandLineOptions(argc, argv,
+                              "MOS profile memory dump converter\n");
+
+  if (CounterWidth != 8 && CounterWidth != 16)
+    exitWithError("counter width must be 8 or 16");
+  const unsigned CounterBytes = CounterWidth / 8;
+  const uint64_t CounterMax = CounterWidth == 8 ? UINT8_MAX : UINT16_MAX;
+
+  OwningBinary<Binary> OwningBin =
+      unwrapOrExit(createBinary(InputFilename), InputFilename);
+  const auto *Obj = dyn_cast<ELF32LEObjectFile>(OwningBin.getBinary());
+  if (!Obj || Obj->getEMachine() != ELF::EM_MCS6502)
+    exitWithError(InputFilename + ": not a MOS ELF executable");
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> DumpOrErr =
+      MemoryBuffer::getFile(DumpFilename, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false);
+  if (!DumpOrErr)
+    exitWithError(DumpFilename + ": " + DumpOrErr.getError().message());
+  StringRef Dump = (*DumpOrErr)->getBuffer();
+
+  StringRef Data =
+      getSectionContents(*Obj, INSTR_PROF_QUOTE(INSTR_PROF_DATA_COMMON));
+  StringRef Names =
+      getSectionContents(*Obj, INSTR_PROF_QUOTE(INSTR_PROF_NAME_COMMON));
+  if (Data.size() % MOSProfData::Size)
+    exitWithError(InputFilename + ": malformed " +
+                  INSTR_PROF_QUOTE(INSTR_PROF_DATA_COMMON) + " section");
+
+  InstrProfSymtab Symtab;
+  if (Error E = Symtab.create(Names))
+    exitWithError(std::move(E), InputFilename);
+
+  InstrProfWriter Writer;
+  uint64_t Version = getProfileVersion(*Obj);
+  if (Error E = Writer.setIsIRLevelProfile(Version & VARIANT_MASK_IR_PROF,
+                                           Version & VARIANT_MASK_CSIR_PROF))
+    exitWithError(std::move(E), InputFilename);
+  Writer.setInstrEntryBBEnabled(Version & VARIANT_MASK_INSTR_ENTRY);
+
+  unsigned NumSaturated = 0;
+  for (size_t I = 0, E = Data.size(); I < E; I += MOSProfData::Size) {
+    MOSProfData D = MOSProfData::read(Data.bytes_begin() + I);
+
+    // The counters of functions discarded by the linker have no address.
+    if (!D.CounterPtr)
+      continue;
+
+    StringRef Name = Symtab.getFuncName(D.NameRef);
+    if (Name.empty())
+      exitWithError(InputFilename + ": unknown function name reference");
+
+    uint64_t Begin = D.CounterPtr;
+    uint64_t End = Begin + uint64_t(D.NumCounters) * CounterBytes;
+    if (Begin < DumpBase || End - DumpBase > Dump.size())
+      exitWithError(DumpFilename + ": does not contain the counters for " +
+                    Name);
+
+    std::vector<uint64_t> Counts;
+    const uint8_t *P = Dump.bytes_begin() + (Begin - DumpBase);
+    for (uint32_t C = 0; C < D.NumCounters; ++C, P += CounterBytes) {
+      uint64_t Count = CounterBytes == 1 ? *P : endian::read16le(P);
+      if (Count == CounterMax)
+        ++NumSaturated;
+      Counts.push_back(Count);
+    }
+
+    auto Warn = [&](Error E) {
+      handleAllErrors(std::move(E), [&](const ErrorInfoBase &EI) {
+        WithColor::warning(errs(), ToolName)
+            << Name << ": " << EI.message() << "\n";
+      });
+    };
+    Writer.addRecord(NamedInstrProfRecord(Name, D.FuncHash, std::move(Counts)),
+                     /*Weight=*/1, Warn);
+  }
+
+  if (NumSaturated)
+    WithColor::warning(errs(), ToolName)
+        << NumSaturated << " counters saturated; consider a shorter run or "
+        << "-mos-instrprof-counter-width=16\n";
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC,
+                    TextOutput ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC)
+    exitWithError(OutputFilename + ": " + EC.message());
+  if (TextOutput) {
+    if (Error E = Writer.writeText(OS))
+      exitWithError(std::move(E), OutputFilename);
+  } else {
+    if (Error E = Writer.write(OS))
+      exitWithError(std::move(E), OutputFilename);
+  }
+  return 0;
+}
@@ -0,0 +1,1007 @@
+//===-- llvm-mos-sim.cpp - Cycle-counting MOS 65xx simulator --------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This tool loads a linked MOS ELF executable into a flat 64KiB address space
+// and runs it with exact cycle counts, so that the code generator's output can
+// be measured without leaving the tree. Each supported device family is
+// modelled, including page-crossing penalties, the NMOS JMP indirect bug,
+// decimal mode differences, and the opcodes added or removed by each family.
+//
+// The program communicates with the simulator through memory-mapped
+// registers:
+//
+//   $FFF0-$FFF3 (read)  The number of cycles elapsed, little-endian. Reading
+//                       $FFF0 latches the value of the other three bytes.
+//   $FFF8 (write)       Exits the simulation with the written value as status.
+//   $FFF9 (write)       Writes the value as a character to standard output.
+//
+// Execution starts at the ELF entry point, or at the reset vector if there is
+// none.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace llvm::object;
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                          cl::desc("<input executable>"));
+
+static cl::opt<std::string>
+    CPU("mcpu",
+        cl::desc("Device to simulate (default: from the ELF header flags)"),
+        cl::value_desc("device"));
+
+static cl::opt<uint64_t>
+    MaxCycles("max-cycles", cl::init(0),
+              cl::desc("Abort the simulation after this many cycles (0 for "
+                       "no limit)"));
+
+static cl::opt<bool>
+    PrintStats("stats", cl::init(false),
+               cl::desc("Print the cycle count and loaded size on exit"));
+
+static cl::opt<bool> Trace("trace", cl::init(false),
+                           cl::desc("Print each instruction as it executes"));
+
+static StringRef ToolName;
+
+LLVM_ATTRIBUTE_NORETURN static void exitWithError(const Twine &Message) {
+  outs().flush();
+  WithColor::error(errs(), ToolName) << Message << "\n";
+  exit(1);
+}
+
+namespace {
+
+enum Mode : uint8_t {
+  Imp,
+  Acc,
+  Imm,
+  ZP,
+  ZPX,
+  ZPY,
+  Abs,
+  AbsX,
+  AbsY,
+  Ind,
+  IndX,
+  IndY,
+  ZPInd,
+  AbsIndX,
+  Rel,
+  ZPRel,
+};
+
+enum Op : uint8_t {
+  Invalid,
+  Jam,
+  // Documented instructions.
+  ADC, AND, ASL, BBR, BBS, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRA, BRK, BVC,
+  BVS, CLC, CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY,
+  JMP, JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PHX, PHY, PLA, PLP, PLX,
+  PLY, RMB, ROL, ROR, RTI, RTS, SBC, SEC, SED, SEI, SMB, STA, STP, STX, STY,
+  STZ, TAX, TAY, TRB, TSB, TSX, TXA, TXS, TYA, WAI,
+  // Undocumented NMOS instructions.
+  ALR, ANC, ARR, DCP, ISC, LAX, RLA, RRA, SAX, SBX, SLO, SRE,
+};
+
+struct OpcodeInfo {
+  Op Operation = Invalid;
+  Mode AddrMode = Imp;
+  uint8_t Cycles = 0;
+  // Whether indexing across a page boundary costs an extra cycle.
+  bool PagePenalty = false;
+};
+
+enum class Variant {
+  NMOS,     // mos6502
+  NMOSX,    // mos6502x
+  CMOS,     // mos65c02
+  Rockwell, // mosr65c02
+  WDC,      // mosw65c02
+};
+
+enum Flag : uint8_t {
+  FlagC = 1 << 0,
+  FlagZ = 1 << 1,
+  FlagI = 1 << 2,
+  FlagD = 1 << 3,
+  FlagB = 1 << 4,
+  FlagU = 1 << 5,
+  FlagV = 1 << 6,
+  FlagN = 1 << 7,
+};
+
+constexpr uint16_t CycleCounterAddr = 0xFFF0;
+constexpr uint16_t ExitAddr = 0xFFF8;
+constexpr uint16_t PutcharAddr = 0xFFF9;
+
+class Simulator {
+public:
+  explicit Simulator(Variant V);
+
+  void load(uint16_t Addr, ArrayRef<uint8_t> Bytes);
+  void reset(uint16_t Entry);
+
+  // Runs the program until it exits, and returns its exit status.
+  int run();
+
+  uint64_t cycles() const { return Cycles; }
+
+private:
+  Variant V;
+  OpcodeInfo Table[256];
+  uint8_t Mem[0x10000] = {};
+
+  uint8_t A = 0, X = 0, Y = 0, S = 0xFD, P = FlagU | FlagI;
+  uint16_t PC = 0;
+  uint64_t Cycles = 0;
+  uint32_t LatchedCycles = 0;
+  Optional<int> ExitStatus;
+
+  bool isCMOS() const { return V >= Variant::CMOS; }
+
+  void buildTable();
+  void step();
+
+  uint8_t read(uint16_t Addr);
+  void write(uint16_t Addr, uint8_t Val);
+  uint16_t read16(uint16_t Addr) { return read(Addr) | read(Addr + 1) << 8; }
+  uint16_t readZP16(uint8_t Addr) {
+    return read(Addr) | read(uint8_t(Addr + 1)) << 8;
+  }
+
+  uint8_t fetch() { return read(PC++); }
+  uint16_t fetch16() {
+    uint8_t Lo = fetch();
+    return Lo | fetch() << 8;
+  }
+
+  void push(uint8_t Val) { write(0x100 | S--, Val); }
+  uint8_t pull() { return read(0x100 | ++S); }
+
+  uint16_t indexed(uint16_t Base, uint8_t Index, const OpcodeInfo &Info);
+  uint16_t address(const OpcodeInfo &Info);
+  uint8_t operand(const OpcodeInfo &Info);
+  template <typename Fn> uint8_t modify(const OpcodeInfo &Info, Fn F);
+
+  void setFlag(Flag F, bool Set) { P = Set ? P | F : P & ~F; }
+  void setNZ(uint8_t Val) {
+    setFlag(FlagN, Val & 0x80);
+    setFlag(FlagZ, !Val);
+  }
+
+  void branch(bool Taken);
+  void compare(uint8_t Reg, uint8_t Val);
+  void adc(uint8_t Val);
+  void sbc(uint8_t Val);
+  uint8_t asl(uint8_t Val);
+  uint8_t lsr(uint8_t Val);
+  uint8_t rol(uint8_t Val);
+  uint8_t ror(uint8_t Val);
+};
+
+} // namespace
+
+Simulator::Simulator(Variant V) : V(V) { buildTable(); }
+
+void Simulator::buildTable() {
+  auto Def = [&](uint8_t Opcode, Op O, Mode M, uint8_t Cycles,
+                 bool PagePenalty = false) {
+    Table[Opcode] = {O, M, Cycles, PagePenalty};
+  };
+
+  // The regular ALU group: ORA, AND, EOR, ADC, STA, LDA, CMP, SBC.
+  const Op ALUOps[] = {ORA, AND, EOR, ADC, STA, LDA, CMP, SBC};
+  for (unsigned I = 0; I < 8; ++I) {
+    uint8_t Base = I << 5;
+    Op O = ALUOps[I];
+    bool Store = O == STA;
+    if (!Store)
+      Def(Base | 0x09, O, Imm, 2);
+    Def(Base | 0x05, O, ZP, 3);
+    Def(Base | 0x15, O, ZPX, 4);
+    Def(Base | 0x0D, O, Abs, 4);
+    Def(Base | 0x1D, O, AbsX, Store ? 5 : 4, !Store);
+    Def(Base | 0x19, O, AbsY, Store ? 5 : 4, !Store);
+    Def(Base | 0x01, O, IndX, 6);
+    Def(Base | 0x11, O, IndY, Store ? 6 : 5, !Store);
+    if (isCMOS())
+      Def(Base | 0x12, O, ZPInd, 5);
+  }
+
+  // The read-modify-write group: ASL, ROL, LSR, ROR, DEC, INC.
+  const std::pair<uint8_t, Op> RMWOps[] = {{0x00, ASL}, {0x20, ROL},
+                                           {0x40, LSR}, {0x60, ROR},
+                                           {0xC0, DEC}, {0xE0, INC}};
+  for (const auto &RMW : RMWOps) {
+    uint8_t Base = RMW.first;
+    Op O = RMW.second;
+    bool Shift = Base < 0x80;
+    if (Shift)
+      Def(Base | 0x0A, O, Acc, 2);
+    Def(Base | 0x06, O, ZP, 5);
+    Def(Base | 0x16, O, ZPX, 6);
+    Def(Base | 0x0E, O, Abs, 6);
+    // The 65C02 skips the extra cycle for shifts that don't cross a page.
+    if (Shift && isCMOS())
+      Def(Base | 0x1E, O, AbsX, 6, true);
+    else
+      Def(Base | 0x1E, O, AbsX, 7);
+  }
+
+  const std::pair<uint8_t, Op> Branches[] = {
+      {0x10, BPL}, {0x30, BMI}, {0x50, BVC}, {0x70, BVS},
+      {0x90, BCC}, {0xB0, BCS}, {0xD0, BNE}, {0xF0, BEQ}};
+  for (const auto &B : Branches)
+    Def(B.first, B.second, Rel, 2);
+
+  const std::pair<uint8_t, Op> Implied[] = {
+      {0x18, CLC}, {0x38, SEC}, {0x58, CLI}, {0x78, SEI}, {0xB8, CLV},
+      {0xD8, CLD}, {0xF8, SED}, {0x88, DEY}, {0x8A, TXA}, {0x98, TYA},
+      {0x9A, TXS}, {0xA8, TAY}, {0xAA, TAX}, {0xBA, TSX}, {0xC8, INY},
+      {0xCA, DEX}, {0xE8, INX}, {0xEA, NOP}};
+  for (const auto &I : Implied)
+    Def(I.first, I.second, Imp, 2);
+
+  Def(0x00, BRK, Imp, 7);
+  Def(0x08, PHP, Imp, 3);
+  Def(0x28, PLP, Imp, 4);
+  Def(0x48, PHA, Imp, 3);
+  Def(0x68, PLA, Imp, 4);
+  Def(0x40, RTI, Imp, 6);
+  Def(0x60, RTS, Imp, 6);
+  Def(0x20, JSR, Abs, 6);
+  Def(0x4C, JMP, Abs, 3);
+  Def(0x6C, JMP, Ind, isCMOS() ? 6 : 5);
+
+  Def(0x24, BIT, ZP, 3);
+  Def(0x2C, BIT, Abs, 4);
+
+  Def(0xE0, CPX, Imm, 2);
+  Def(0xE4, CPX, ZP, 3);
+  Def(0xEC, CPX, Abs, 4);
+  Def(0xC0, CPY, Imm, 2);
+  Def(0xC4, CPY, ZP, 3);
+  Def(0xCC, CPY, Abs, 4);
+
+  Def(0xA2, LDX, Imm, 2);
+  Def(0xA6, LDX, ZP, 3);
+  Def(0xB6, LDX, ZPY, 4);
+  Def(0xAE, LDX, Abs, 4);
+  Def(0xBE, LDX, AbsY, 4, true);
+  Def(0xA0, LDY, Imm, 2);
+  Def(0xA4, LDY, ZP, 3);
+  Def(0xB4, LDY, ZPX, 4);
+  Def(0xAC, LDY, Abs, 4);
+  Def(0xBC, LDY, AbsX, 4, true);
+
+  Def(0x86, STX, ZP, 3);
+  Def(0x96, STX, ZPY, 4);
+  Def(0x8E, STX, Abs, 4);
+  Def(0x84, STY, ZP, 3);
+  Def(0x94, STY, ZPX, 4);
+  Def(0x8C, STY, Abs, 4);
+
+  if (!isCMOS()) {
+    const uint8_t Jams[] = {0x02, 0x12, 0x22, 0x32, 0x42, 0x52,
+                            0x62, 0x72, 0x92, 0xB2, 0xD2, 0xF2};
+    for (uint8_t Opcode : Jams)
+      Def(Opcode, Jam, Imp, 0);
+  }
+
+  if (V == Variant::NMOSX) {
+    const std::pair<uint8_t, Op> RMWALUOps[] = {{0x00, SLO}, {0x20, RLA},
+                                                {0x40, SRE}, {0x60, RRA},
+                                                {0xC0, DCP}, {0xE0, ISC}};
+    for (const auto &RMW : RMWALUOps) {
+      uint8_t Base = RMW.first;
+      Op O = RMW.second;
+      Def(Base | 0x07, O, ZP, 5);
+      Def(Base | 0x17, O, ZPX, 6);
+      Def(Base | 0x0F, O, Abs, 6);
+      Def(Base | 0x1F, O, AbsX, 7);
+      Def(Base | 0x1B, O, AbsY, 7);
+      Def(Base | 0x03, O, IndX, 8);
+      Def(Base | 0x13, O, IndY, 8);
+    }
+    Def(0xA7, LAX, ZP, 3);
+    Def(0xB7, LAX, ZPY, 4);
+    Def(0xAF, LAX, Abs, 4);
+    Def(0xBF, LAX, AbsY, 4, true);
+    Def(0xA3, LAX, IndX, 6);
+    Def(0xB3, LAX, IndY, 5, true);
+    Def(0x87, SAX, ZP, 3);
+    Def(0x97, SAX, ZPY, 4);
+    Def(0x8F, SAX, Abs, 4);
+    Def(0x83, SAX, IndX, 6);
+    Def(0x0B, ANC, Imm, 2);
+    Def(0x2B, ANC, Imm, 2);
+    Def(0x4B, ALR, Imm, 2);
+    Def(0x6B, ARR, Imm, 2);
+    Def(0xCB, SBX, Imm, 2);
+    Def(0xEB, SBC, Imm, 2);
+    for (uint8_t Opcode : {0x1A, 0x3A, 0x5A, 0x7A, 0xDA, 0xFA})
+      Def(Opcode, NOP, Imp, 2);
+    for (uint8_t Opcode : {0x80, 0x82, 0x89, 0xC2, 0xE2})
+      Def(Opcode, NOP, Imm, 2);
+    for (uint8_t Opcode : {0x04, 0x44, 0x64})
+      Def(Opcode, NOP, ZP, 3);
+    for (uint8_t Opcode : {0x14, 0x34, 0x54, 0x74, 0xD4, 0xF4})
+      Def(Opcode, NOP, ZPX, 4);
+    Def(0x0C, NOP, Abs, 4);
+    for (uint8_t Opcode : {0x1C, 0x3C, 0x5C, 0x7C, 0xDC, 0xFC})
+      Def(Opcode, NOP, AbsX, 4, true);
+  }
+
+  if (!isCMOS())
+    return;
+
+  Def(0x89, BIT, Imm, 2);
+  Def(0x34, BIT, ZPX, 4);
+  Def(0x3C, BIT, AbsX, 4, true);
+  Def(0x1A, INC, Acc, 2);
+  Def(0x3A, DEC, Acc, 2);
+  Def(0x7C, JMP, AbsIndX, 6);
+  Def(0x80, BRA, Rel, 2);
+  Def(0xDA, PHX, Imp, 3);
+  Def(0x5A, PHY, Imp, 3);
+  Def(0xFA, PLX, Imp, 4);
+  Def(0x7A, PLY, Imp, 4);
+  Def(0x64, STZ, ZP, 3);
+  Def(0x74, STZ, ZPX, 4);
+  Def(0x9C, STZ, Abs, 4);
+  Def(0x9E, STZ, AbsX, 5);
+  Def(0x04, TSB, ZP, 5);
+  Def(0x0C, TSB, Abs, 6);
+  Def(0x14, TRB, ZP, 5);
+  Def(0x1C, TRB, Abs, 6);
+
+  if (V >= Variant::Rockwell) {
+    for (uint8_t Bit = 0; Bit < 8; ++Bit) {
+      Def(Bit << 4 | 0x07, RMB, ZP, 5);
+      Def(Bit << 4 | 0x87, SMB, ZP, 5);
+      Def(Bit << 4 | 0x0F, BBR, ZPRel, 5);
+      Def(Bit << 4 | 0x8F, BBS, ZPRel, 5);
+    }
+  }
+
+  if (V == Variant::WDC) {
+    Def(0xCB, WAI, Imp, 3);
+    Def(0xDB, STP, Imp, 3);
+  }
+
+  // Every remaining opcode is a NOP on the 65C02.
+  for (unsigned Opcode = 0; Opcode < 256; ++Opcode) {
+    if (Table[Opcode].Operation != Invalid)
+      continue;
+    if ((Opcode & 0x0F) == 0x02)
+      Def(Opcode, NOP, Imm, 2);
+    else if (Opcode == 0x44)
+      Def(Opcode, NOP, ZP, 3);
+    else if (Opcode == 0x54 || Opcode == 0xD4 || Opcode == 0xF4)
+      Def(Opcode, NOP, ZPX, 4);
+    else if (Opcode == 0x5C)
+      Def(Opcode, NOP, Abs, 8);
+    else if (Opcode == 0xDC || Opcode == 0xFC)
+      Def(Opcode, NOP, Abs, 4);
+    else
+      Def(Opcode, NOP, Imp, 1);
+  }
+}
+
+void Simulator::load(uint16_t Addr, ArrayRef<uint8_t> Bytes) {
+  std::copy(Bytes.begin(), Bytes.end(), Mem + Addr);
+}
+
+void Simulator::reset(uint16_t Entry) { PC = Entry ? Entry : read16(0xFFFC); }
+
+uint8_t Simulator::read(uint16_t Addr) {
+  if (Addr >= CycleCounterAddr && Addr < CycleCounterAddr + 4) {
+    if (Addr == CycleCounterAddr)
+      LatchedCycles = Cycles;
+    return LatchedCycles >> 8 * (Addr - CycleCounterAddr);
+  }
+  return Mem[Addr];
+}
+
+void Simulator::write(uint16_t Addr, uint8_t Val) {
+  switch (Addr) {
+  case ExitAddr:
+    ExitStatus = Val;
+    return;
+  case PutcharAddr:
+    outs() << char(Val);
+    return;
+  default:
+    Mem[Addr] = Val;
+    return;
+  }
+}
+
+uint16_t Simulator::indexed(uint16_t Base, uint8_t Index,
+                            const OpcodeInfo &Info) {
+  uint16_t Addr = Base + Index;
+  if (Info.PagePenalty && (Addr ^ Base) & 0xFF00)
+    ++Cycles;
+  return Addr;
+}
+
+// Fetches the operand bytes of the instruction and returns the effective
+// address they refer to.
+uint16_t Simulator::address(const OpcodeInfo &Info) {
+  switch (Info.AddrMode) {
+  case ZP:
+    return fetch();
+  case ZPX:
+    return uint8_t(fetch() + X);
+  case ZPY:
+    return uint8_t(fetch() + Y);
+  case Abs:
+    return fetch16();
+  case AbsX:
+    return indexed(fetch16(), X, Info);
+  case AbsY:
+    return indexed(fetch16(), Y, Info);
+  case IndX:
+    return readZP16(fetch() + X);
+  case IndY:
+    return indexed(readZP16(fetch()), Y, Info);
+  case ZPInd:
+    return readZP16(fetch());
+  default:
+    llvm_unreachable("addressing mode has no effective address");
+  }
+}
+
+uint8_t Simulator::operand(const OpcodeInfo &Info) {
+  if (Info.AddrMode == Imm)
+    return fetch();
+  return read(address(Info));
+}
+
+// Applies F to the accumulator or memory operand of a read-modify-write
+// instruction, and returns the new value.
+template <typename Fn> uint8_t Simulator::modify(const OpcodeInfo &Info, Fn F) {
+  if (Info.AddrMode == Acc)
+    return A = F(A);
+  uint16_t Addr = address(Info);
+  uint8_t Val = F(read(Addr));
+  write(Addr, Val);
+  return Val;
+}
+
+void Simulator::branch(bool Taken) {
+  int8_t Offset = fetch();
+  if (!Taken)
+    return;
+  uint16_t Target = PC + Offset;
+  Cycles += (Target ^ PC) & 0xFF00 ? 2 : 1;
+  PC = Target;
+}
+
+void Simulator::compare(uint8_t Reg, uint8_t Val) {
+  setFlag(FlagC, Reg >= Val);
+  setNZ(Reg - Val);
+}
+
+void Simulator::adc(uint8_t Val) {
+  unsigned Carry = P & FlagC;
+  unsigned Sum = A + Val + Carry;
+  if (!(P & FlagD)) {
+    setFlag(FlagV, ~(A ^ Val) & (A ^ Sum) & 0x80);
+    setFlag(FlagC, Sum > 0xFF);
+    A = Sum;
+    setNZ(A);
+    return;
+  }
+
+  int Lo = (A & 0x0F) + (Val & 0x0F) + Carry;
+  if (Lo >= 0x0A)
+    Lo = ((Lo + 0x06) & 0x0F) + 0x10;
+  int Result = (A & 0xF0) + (Val & 0xF0) + Lo;
+  int Signed = int8_t(A & 0xF0) + int8_t(Val & 0xF0) + Lo;
+  if (Result >= 0xA0)
+    Result += 0x60;
+  setFlag(FlagV, Signed < -128 || Signed > 127);
+  setFlag(FlagC, Result >= 0x100);
+  A = Result;
+  if (isCMOS()) {
+    setNZ(A);
+    ++Cycles;
+  } else {
+    // The NMOS 6502 computes N and Z before the decimal adjustment.
+    setFlag(FlagN, Signed & 0x80);
+    setFlag(FlagZ, !uint8_t(Sum));
+  }
+}
+
+void Simulator::sbc(uint8_t Val) {
+  int Borrow = !(P & FlagC);
+  int Diff = A - Val - Borrow;
+  setFlag(FlagV, (A ^ Val) & (A ^ Diff) & 0x80);
+  setFlag(FlagC, Diff >= 0);
+  if (!(P & FlagD)) {
+    A = Diff;
+    setNZ(A);
+    return;
+  }
+
+  int Lo = (A & 0x0F) - (Val & 0x0F) - Borrow;
+  if (isCMOS()) {
+    int Result = Diff;
+    if (Result < 0)
+      Result -= 0x60;
+    if (Lo < 0)
+      Result -= 0x06;
+    A = Result;
+    setNZ(A);
+    ++Cycles;
+  } else {
+    if (Lo < 0)
+      Lo = ((Lo - 0x06) & 0x0F) - 0x10;
+    int Result = (A & 0xF0) - (Val & 0xF0) + Lo;
+    if (Result < 0)
+      Result -= 0x60;
+    A = Result;
+    // The NMOS 6502 computes N and Z before the decimal adjustment.
+    setNZ(Diff);
+  }
+}
+
+uint8_t Simulator::asl(uint8_t Val) {
+  setFlag(FlagC, Val & 0x80);
+  Val <<= 1;
+  setNZ(Val);
+  return Val;
+}
+
+uint8_t Simulator::lsr(uint8_t Val) {
+  setFlag(FlagC, Val & 1);
+  Val >>= 1;
+  setNZ(Val);
+  return Val;
+}
+
+uint8_t Simulator::rol(uint8_t Val) {
+  bool Carry = P & FlagC;
+  setFlag(FlagC, Val & 0x80);
+  Val = Val << 1 | Carry;
+  setNZ(Val);
+  return Val;
+}
+
+uint8_t Simulator::ror(uint8_t Val) {
+  bool Carry = P & FlagC;
+  setFlag(FlagC, Val & 1);
+  Val = Val >> 1 | Carry << 7;
+  setNZ(Val);
+  return Val;
+}
+
+void Simulator::step() {
+  uint16_t InstrPC = PC;
+  uint8_t Opcode = fetch();
+  const OpcodeInfo &Info = Table[Opcode];
+
+  if (Trace)
+    errs() << format("%04X  %02X  A=%02X X=%02X Y=%02X S=%02X P=%02X  %llu\n",
+                     InstrPC, Opcode, A, X, Y, S, P,
+                     (unsigned long long)Cycles);
+
+  Cycles += Info.Cycles;
+  auto Shift = [&](uint8_t (Simulator::*F)(uint8_t)) {
+    return modify(Info, [&](uint8_t Val) { return (this->*F)(Val); });
+  };
+
+  switch (Info.Operation) {
+  case Invalid:
+    exitWithError("illegal opcode $" + utohexstr(Opcode) + " at $" +
+                  utohexstr(InstrPC));
+  case Jam:
+    exitWithError("processor jammed by opcode $" + utohexstr(Opcode) +
+                  " at $" + utohexstr(InstrPC));
+  case STP:
+    exitWithError("processor stopped at $" + utohexstr(InstrPC));
+  case WAI:
+    exitWithError("waiting for an interrupt that will never come at $" +
+                  utohexstr(InstrPC));
+
+  case ADC:
+    adc(operand(Info));
+    break;
+  case SBC:
+    sbc(operand(Info));
+    break;
+  case AND:
+    setNZ(A &= operand(Info));
+    break;
+  case ORA:
+    setNZ(A |= operand(Info));
+    break;
+  case EOR:
+    setNZ(A ^= operand(Info));
+    break;
+  case CMP:
+    compare(A, operand(Info));
+    break;
+  case CPX:
+    compare(X, operand(Info));
+    break;
+  case CPY:
+    compare(Y, operand(Info));
+    break;
+  case BIT: {
+    uint8_t Val = operand(Info);
+    setFlag(FlagZ, !(A & Val));
+    if (Info.AddrMode != Imm) {
+      setFlag(FlagN, Val & 0x80);
+      setFlag(FlagV, Val & 0x40);
+    }
+    break;
+  }
+
+  case LDA:
+    setNZ(A = operand(Info));
+    break;
+  case LDX:
+    setNZ(X = operand(Info));
+    break;
+  case LDY:
+    setNZ(Y = operand(Info));
+    break;
+  case STA:
+    write(address(Info), A);
+    break;
+  case STX:
+    write(address(Info), X);
+    break;
+  case STY:
+    write(address(Info), Y);
+    break;
+  case STZ:
+    write(address(Info), 0);
+    break;
+
+  case ASL:
+    Shift(&Simulator::asl);
+    break;
+  case LSR:
+    Shift(&Simulator::lsr);
+    break;
+  case ROL:
+    Shift(&Simulator::rol);
+    break;
+  case ROR:
+    Shift(&Simulator::ror);
+    break;
+  case INC:
+    setNZ(modify(Info, [](uint8_t Val) -> uint8_t { return Val + 1; }));
+    break;
+  case DEC:
+    setNZ(modify(Info, [](uint8_t Val) -> uint8_t { return Val - 1; }));
+    break;
+  case TSB:
+  case TRB: {
+    uint16_t Addr = address(Info);
+    uint8_t Val = read(Addr);
+    setFlag(FlagZ, !(A & Val));
+    write(Addr, Info.Operation == TSB ? Val | A : Val & ~A);
+    break;
+  }
+  case RMB:
+  case SMB: {
+    uint8_t Bit = 1 << (Opcode >> 4 & 7);
+    uint16_t Addr = address(Info);
+    uint8_t Val = read(Addr);
+    write(Addr, Info.Operation == SMB ? Val | Bit : Val & ~Bit);
+    break;
+  }
+
+  case INX:
+    setNZ(++X);
+    break;
+  case INY:
+    setNZ(++Y);
+    break;
+  case DEX:
+    setNZ(--X);
+    break;
+  case DEY:
+    setNZ(--Y);
+    break;
+  case TAX:
+    setNZ(X = A);
+    break;
+  case TAY:
+    setNZ(Y = A);
+    break;
+  case TXA:
+    setNZ(A = X);
+    break;
+  case TYA:
+    setNZ(A = Y);
+    break;
+  case TSX:
+    setNZ(X = S);
+    break;
+  case TXS:
+    S = X;
+    break;
+
+  case CLC:
+    setFlag(FlagC, false);
+    break;
+  case SEC:
+    setFlag(FlagC, true);
+    break;
+  case CLI:
+    setFlag(FlagI, false);
+    break;
+  case SEI:
+    setFlag(FlagI, true);
+    break;
+  case CLV:
+    setFlag(FlagV, false);
+    break;
+  case CLD:
+    setFlag(FlagD, false);
+    break;
+  case SED:
+    setFlag(FlagD, true);
+    break;
+
+  case PHA:
+    push(A);
+    break;
+  case PHX:
+    push(X);
+    break;
+  case PHY:
+    push(Y);
+    break;
+  case PHP:
+    push(P | FlagB | FlagU);
+    break;
+  case PLA:
+    setNZ(A = pull());
+    break;
+  case PLX:
+    setNZ(X = pull());
+    break;
+  case PLY:
+    setNZ(Y = pull());
+    break;
+  case PLP:
+    P = (pull() & ~FlagB) | FlagU;
+    break;
+
+  case BPL:
+    branch(!(P & FlagN));
+    break;
+  case BMI:
+    branch(P & FlagN);
+    break;
+  case BVC:
+    branch(!(P & FlagV));
+    break;
+  case BVS:
+    branch(P & FlagV);
+    break;
+  case BCC:
+    branch(!(P & FlagC));
+    break;
+  case BCS:
+    branch(P & FlagC);
+    break;
+  case BNE:
+    branch(!(P & FlagZ));
+    break;
+  case BEQ:
+    branch(P & FlagZ);
+    break;
+  case BRA:
+    branch(true);
+    break;
+  case BBR:
+  case BBS: {
+    uint8_t Val = read(fetch());
+    bool Set = Val & 1 << (Opcode >> 4 & 7);
+    branch(Set == (Info.Operation == BBS));
+    break;
+  }
+
+  case JMP:
+    if (Info.AddrMode == Abs) {
+      PC = fetch16();
+    } else if (Info.AddrMode == AbsIndX) {
+      PC = read16(fetch16() + X);
+    } else {
+      uint16_t Ptr = fetch16();
+      // The NMOS 6502 doesn't carry into the high byte of the pointer.
+      uint16_t HiPtr = isCMOS() ? Ptr + 1 : (Ptr & 0xFF00) | uint8_t(Ptr + 1);
+      PC = read(Ptr) | read(HiPtr) << 8;
+    }
+    break;
+  case JSR: {
+    uint16_t Target = fetch16();
+    uint16_t Ret = PC - 1;
+    push(Ret >> 8);
+    push(Ret);
+    PC = Target;
+    break;
+  }
+  case RTS: {
+    uint8_t Lo = pull();
+    PC = (Lo | pull() << 8) + 1;
+    break;
+  }
+  case RTI: {
+    P = (pull() & ~FlagB) | FlagU;
+    uint8_t Lo = pull();
+    PC = Lo | pull() << 8;
+    break;
+  }
+  case BRK:
+    fetch();
+    push(PC >> 8);
+    push(PC);
+    push(P | FlagB | FlagU);
+    setFlag(FlagI, true);
+    if (isCMOS())
+      setFlag(FlagD, false);
+    PC = read16(0xFFFE);
+    break;
+
+  case NOP:
+    // Undocumented NOPs still consume their operands.
+    if (Info.AddrMode == Imm)
+      fetch();
+    else if (Info.AddrMode != Imp)
+      address(Info);
+    break;
+
+  case SLO:
+    setNZ(A |= Shift(&Simulator::asl));
+    break;
+  case RLA:
+    setNZ(A &= Shift(&Simulator::rol));
+    break;
+  case SRE:
+    setNZ(A ^= Shift(&Simulator::lsr));
+    break;
+  case RRA:
+    adc(Shift(&Simulator::ror));
+    break;
+  case DCP:
+    compare(A, modify(Info, [](uint8_t Val) -> uint8_t { return Val - 1; }));
+    break;
+  case ISC:
+    sbc(modify(Info, [](uint8_t Val) -> uint8_t { return Val + 1; }));
+    break;
+  case LAX:
+    setNZ(A = X = operand(Info));
+    break;
+  case SAX:
+    write(address(Info), A & X);
+    break;
+  case ANC:
+    setNZ(A &= operand(Info));
+    setFlag(FlagC, A & 0x80);
+    break;
+  case ALR:
+    A &= operand(Info);
+    A = lsr(A);
+    break;
+  case ARR:
+    A &= operand(Info);
+    A = A >> 1 | (P & FlagC) << 7;
+    setNZ(A);
+    setFlag(FlagC, A & 0x40);
+    setFlag(FlagV, (A >> 6 ^ A >> 5) & 1);
+    break;
+  case SBX: {
+    uint8_t Val = operand(Info);
+    uint8_t AX = A & X;
+    setFlag(FlagC, AX >= Val);
+    setNZ(X = AX - Val);
+    break;
+  }
+  }
+}
+
+int Simulator::run() {
+  while (!ExitStatus) {
+    if (MaxCycles && Cycles >= MaxCycles)
+      exitWithError("exceeded the cycle limit of " + Twine(MaxCycles));
+    step();
+  }
+  return *ExitStatus;
+}
+
+static Variant getVariant(unsigned EFlags) {
+  if (!CPU.empty()) {
+    Optional<Variant> V = StringSwitch<Optional<Variant>>(CPU)
+                              .Cases("mos6502", "mossweet16", Variant::NMOS)
+                              .Case("mos6502x", Variant::NMOSX)
+                              .Case("mos65c02", Variant::CMOS)
+                              .Case("mosr65c02", Variant::Rockwell)
+                              .Case("mosw65c02", Variant::WDC)
+                              .Default(None);
+    if (!V)
+      exitWithError("unsupported device '" + CPU + "'");
+    return *V;
+  }
+
+  if (EFlags & (ELF::EF_MOS_ARCH_W65816 | ELF::EF_MOS_ARCH_65EL02 |
+                ELF::EF_MOS_ARCH_65CE02))
+    exitWithError("unsupported device; use -mcpu to override");
+  if (EFlags & ELF::EF_MOS_ARCH_W65C02)
+    return Variant::WDC;
+  if (EFlags & ELF::EF_MOS_ARCH_R65C02)
+    return Variant::Rockwell;
+  if (EFlags & ELF::EF_MOS_ARCH_65C02)
+    return Variant::CMOS;
+  if (EFlags & ELF::EF_MOS_ARCH_6502X)
+    return Variant::NMOSX;
+  return Variant::NMOS;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+  cl::ParseCommandLineOptions(argc, argv, "MOS 65xx simulator\n");
+
+  Expected<OwningBinary<Binary>> BinOrErr = createBinary(InputFilename);
+  if (!BinOrErr)
+    exitWithError(InputFilename + ": " + toString(BinOrErr.takeError()));
+  const auto *Obj = dyn_cast<ELF32LEObjectFile>(BinOrErr->getBinary());
+  if (!Obj || Obj->getEMachine() != ELF::EM_MCS6502)
+    exitWithError(InputFilename + ": not a MOS ELF executable");
+  const ELFFile<ELF32LE> &ELF = Obj->getELFFile();
+
+  auto Sim = std::make_unique<Simulator>(getVariant(ELF.getHeader().e_flags));
+
+  auto PhdrsOrErr = ELF.program_headers();
+  if (!PhdrsOrErr)
+    exitWithError(InputFilename + ": " + toString(PhdrsOrErr.takeError()));
+  uint64_t Bytes = 0;
+  for (const ELF32LE::Phdr &Phdr : *PhdrsOrErr) {
+    if (Phdr.p_type != ELF::PT_LOAD || !Phdr.p_filesz)
+      continue;
+    if (Phdr.p_paddr + Phdr.p_filesz > 0x10000)
+      exitWithError(InputFilename + ": segment does not fit in 64KiB");
+    if (Phdr.p_offset + Phdr.p_filesz > ELF.getBufSize())
+      exitWithError(InputFilename + ": segment extends past end of file");
+    Sim->load(Phdr.p_paddr, makeArrayRef(ELF.base() + Phdr.p_offset,
+                                         Phdr.p_filesz));
+    Bytes += Phdr.p_filesz;
+  }
+
+  Sim->reset(ELF.getHeader().e_entry);
+  int Status = Sim->run();
+  outs().flush();
+
+  if (PrintStats) {
+    errs() << "cycles: " << Sim->cycles() << "\n";
+    errs() << "bytes: " << Bytes << "\n";
+  }
+  return Status;
+}
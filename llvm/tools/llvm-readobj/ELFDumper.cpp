@@ -1234,7 +1234,7 @@ static const EnumEntry<unsigned> ElfMipsSectionFlags[] = {
 };
 
 static const EnumEntry<unsigned> ElfMOSSectionFlags[] = {
-    ENUM_ENT(SHF_MOS_ZEROPAGE, "z")};
+    ENUM_ENT(SHF_MOS_ZEROPAGE, "z"), ENUM_ENT(SHF_MOS_NOPAGECROSS, "p")};
 
 static const EnumEntry<unsigned> ElfX86_64SectionFlags[] = {
   ENUM_ENT(SHF_X86_64_LARGE, "l")
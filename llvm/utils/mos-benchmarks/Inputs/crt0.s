@@ -0,0 +1,22 @@
+; Minimal startup code for the MOS benchmarks. The simulator loads every
+; segment directly into RAM and clears the rest of memory, so there's nothing
+; to copy or zero.
+;
+; The startup code is made of .init.* fragments that the linker script places
+; in name order, each falling through to the next. Runtime objects may add
+; fragments between the two here, like the decompressor for --mos-compress.
+
+.section .init.0,"ax",@progbits
+.global _start
+_start:
+  ldx #$ff
+  txs
+  lda #mos16lo(__stack)
+  sta __rc0
+  lda #mos16hi(__stack)
+  sta __rc1
+
+.section .init.999,"ax",@progbits
+  jsr main
+  ; Exit with the low byte of main's return value.
+  sta $fff8
@@ -0,0 +1,128 @@
+; Startup decompressor for the sections stored in .mos_compressed by ld.lld
+; --mos-compress; see lld/ELF/MOSCompress.cpp for the format. The linker pulls
+; this out of the runtime archive only when a link compresses something.
+;
+; This runs as a fragment of the startup code, after the stacks are set up and
+; before main, so it may use any imaginary register but the soft stack
+; pointer:
+;
+;   __rc2/__rc3  Next byte of compressed data.
+;   __rc4/__rc5  Next byte of output.
+;   __rc6/__rc7  Next byte to copy for a match.
+;   __rc8        Sections left to decompress.
+;   __rc9        Length of the current match, less the minimum.
+
+.section .init.200,"ax",@progbits
+.global __mos_decompress
+__mos_decompress:
+  lda #mos16lo(__mos_compressed)
+  sta mos8(__rc2)
+  lda #mos16hi(__mos_compressed)
+  sta mos8(__rc3)
+  ldy #0
+  jsr .Lnext
+  sta mos8(__rc8)
+  beq .Ldone
+
+.Lsection:
+  jsr .Lnext
+  sta mos8(__rc4)
+  jsr .Lnext
+  sta mos8(__rc5)
+
+.Ltoken:
+  jsr .Lnext
+  beq .Lend
+  bmi .Lmatch
+
+  ; 01-7F: Copy that many literal bytes.
+  tax
+.Lliteral:
+  jsr .Lnext
+  sta (__rc4),y
+  jsr .Lnext_output
+  dex
+  bne .Lliteral
+  beq .Ltoken
+
+.Lmatch:
+  ; The low six bits of the token give the length, less the minimum.
+  tax
+  and #$3f
+  sta mos8(__rc9)
+  txa
+  and #$40
+  bne .Llong
+
+  ; 80-BF d: Copy 3 or more bytes from d + 1 bytes back. With carry clear, SBC
+  ; subtracts the extra one.
+  jsr .Lnext
+  sta mos8(__rc6)
+  clc
+  lda mos8(__rc4)
+  sbc mos8(__rc6)
+  sta mos8(__rc6)
+  lda mos8(__rc5)
+  sbc #0
+  sta mos8(__rc7)
+  lda mos8(__rc9)
+  clc
+  adc #3
+  tax
+  bne .Lcopy
+
+  ; C0-FF dl dh: Copy 4 or more bytes from dh:dl bytes back.
+.Llong:
+  jsr .Lnext
+  sta mos8(__rc6)
+  jsr .Lnext
+  sta mos8(__rc7)
+  sec
+  lda mos8(__rc4)
+  sbc mos8(__rc6)
+  sta mos8(__rc6)
+  lda mos8(__rc5)
+  sbc mos8(__rc7)
+  sta mos8(__rc7)
+  lda mos8(__rc9)
+  clc
+  adc #4
+  tax
+
+  ; A byte at a time, since a match may overlap its own output.
+.Lcopy:
+  lda (__rc6),y
+  sta (__rc4),y
+  inc mos8(__rc6)
+  bne .Lcopy_next
+  inc mos8(__rc7)
+.Lcopy_next:
+  jsr .Lnext_output
+  dex
+  bne .Lcopy
+  beq .Ltoken
+
+.Lend:
+  dec mos8(__rc8)
+  bne .Lsection
+.Ldone:
+  ; Fall through to the rest of the startup code.
+
+.section .text.__mos_decompress,"ax",@progbits
+; Returns the next byte of compressed data in A, with N and Z set from it.
+.Lnext:
+  lda (__rc2),y
+  inc mos8(__rc2)
+  bne .Lnext_done
+  inc mos8(__rc3)
+.Lnext_done:
+  ora #0
+  rts
+
+; Advances the output pointer.
+.Lnext_output:
+  inc mos8(__rc4)
+  bne .Lnext_output_done
+  inc mos8(__rc5)
+.Lnext_output_done:
+  rts
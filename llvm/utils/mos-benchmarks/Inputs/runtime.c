@@ -0,0 +1,35 @@
+// Freestanding implementations of the library functions that the compiler may
+// emit calls to. Built with -fno-builtin so these aren't turned into calls to
+// themselves.
+
+#include <stddef.h>
+
+void *memcpy(void *dest, const void *src, size_t n) {
+  char *d = dest;
+  const char *s = src;
+  while (n--)
+    *d++ = *s++;
+  return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
+  char *d = dest;
+  const char *s = src;
+  if (d < s) {
+    while (n--)
+      *d++ = *s++;
+  } else {
+    d += n;
+    s += n;
+    while (n--)
+      *--d = *--s;
+  }
+  return dest;
+}
+
+void *memset(void *s, int c, size_t n) {
+  char *p = s;
+  while (n--)
+    *p++ = c;
+  return s;
+}
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Compares two runs of the MOS benchmark suite.
+
+Reads the JSON results that llvm-lit writes with -o, prints the change in each
+metric, and exits with a nonzero status if any benchmark got worse by more than
+the given threshold.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        results = json.load(f)
+    return {t['name']: t.get('metrics', {}) for t in results['tests']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('baseline', help='results of the baseline run')
+    parser.add_argument('new', help='results of the new run')
+    parser.add_argument('--threshold', type=float, default=0.0,
+                        help='allowed regression, in percent (default: 0)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    new = load(args.new)
+
+    regressed = False
+    print('%-40s %8s %10s %10s %8s' % ('Benchmark', 'Metric', 'Baseline',
+                                         'New', 'Change'))
+    for name in sorted(new):
+        for metric, value in sorted(new[name].items()):
+            old = baseline.get(name, {}).get(metric)
+            if old is None:
+                print('%-40s %8s %10s %10d %8s' % (name, metric, '-', value,
+                                                   'new'))
+                continue
+            change = (value - old) * 100.0 / old if old else 0.0
+            marker = ''
+            if change > args.threshold:
+                regressed = True
+                marker = ' REGRESSION'
+            print('%-40s %8s %10d %10d %+7.2f%%%s' % (name, metric, old, value,
+                                                     change, marker))
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
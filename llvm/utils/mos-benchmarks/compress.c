@@ -0,0 +1,35 @@
+// Initialized data stored compressed by ld.lld --mos-compress, then unpacked
+// by the startup decompressor before main checks it.
+// LDFLAGS: --mos-compress=.data
+
+#define TEXT "The quick brown fox jumps over the lazy dog. "
+
+#define SQ(i) (unsigned char)((i) * (i))
+#define SQ4(i) SQ(i), SQ(i + 1), SQ(i + 2), SQ(i + 3)
+#define SQ16(i) SQ4(i), SQ4(i + 4), SQ4(i + 8), SQ4(i + 12)
+#define SQ64(i) SQ16(i), SQ16(i + 16), SQ16(i + 32), SQ16(i + 48)
+
+static const char text[] = TEXT;
+
+// The copies of the text are further apart than a short match can reach. The
+// table has external linkage so that the compiler can't assume it's constant.
+struct {
+  char text[sizeof(TEXT)];
+  unsigned char squares[256];
+  char again[sizeof(TEXT)];
+} data = {TEXT, {SQ64(0), SQ64(64), SQ64(128), SQ64(192)}, TEXT};
+
+int main(void) {
+  for (unsigned char i = 0; i < sizeof(text); ++i)
+    if (data.text[i] != text[i] || data.again[i] != text[i])
+      return 1;
+
+  unsigned char square = 0;
+  unsigned char i = 0;
+  do {
+    if (data.squares[i] != square)
+      return 1;
+    square += 2 * i + 1;
+  } while (++i);
+  return 0;
+}
@@ -0,0 +1,19 @@
+// CRC-16/XMODEM of a 256-byte buffer, computed bitwise.
+
+static unsigned char buf[256];
+
+static unsigned crc16(const unsigned char *data, unsigned len) {
+  unsigned crc = 0;
+  while (len--) {
+    crc ^= (unsigned)*data++ << 8;
+    for (char i = 0; i < 8; ++i)
+      crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+int main(void) {
+  for (unsigned i = 0; i < sizeof(buf); ++i)
+    buf[i] = i;
+  return crc16(buf, sizeof(buf)) != 0x7E55;
+}
@@ -0,0 +1,7 @@
+// Naive recursive Fibonacci; exercises calls and the soft stack.
+
+__attribute__((noinline)) static unsigned fib(unsigned char n) {
+  return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int main(void) { return fib(15) != 610; }
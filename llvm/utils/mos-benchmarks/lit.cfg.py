@@ -0,0 +1,126 @@
+# -*- Python -*-
+#
+# A lit suite that measures the code generated for MOS targets.
+#
+# Each benchmark is a self-checking C program that returns zero on success. It
+# is compiled, linked against a minimal runtime, and run in llvm-mos-sim; the
+# cycles taken and bytes loaded are reported as lit metrics. A benchmark may
+# give extra linker flags on a line of the form "// LDFLAGS: <flags>". To track
+# the metrics across commits, record a run with -o and compare it against a
+# baseline:
+#
+#   llvm-lit llvm/utils/mos-benchmarks --param tools_dir=build/bin -o new.json
+#   llvm/utils/mos-benchmarks/compare.py baseline.json new.json
+#
+# Parameters:
+#   tools_dir  Directory containing clang, ld.lld, llvm-ar, and llvm-mos-sim
+#              (required).
+#   cflags     Compiler flags (default: -Os).
+#   mcpu       Device to compile for and simulate (default: mos6502).
+
+import os
+import re
+
+import lit.formats
+import lit.Test
+import lit.util
+
+
+class MOSBenchmark(lit.formats.FileBasedTest):
+    def __init__(self, tools_dir, cflags, mcpu):
+        self.clang = os.path.join(tools_dir, 'clang')
+        self.lld = os.path.join(tools_dir, 'ld.lld')
+        self.ar = os.path.join(tools_dir, 'llvm-ar')
+        self.sim = os.path.join(tools_dir, 'llvm-mos-sim')
+        self.cflags = ['--target=mos', '-mcpu=' + mcpu, '-ffreestanding'] + \
+            cflags.split()
+        self.mcpu = mcpu
+
+    def getTestsInDirectory(self, testSuite, path_in_suite, litConfig,
+                            localConfig):
+        source_path = testSuite.getSourcePath(path_in_suite)
+        for filename in sorted(os.listdir(source_path)):
+            if filename.endswith('.c') and \
+                    os.path.isfile(os.path.join(source_path, filename)):
+                yield lit.Test.Test(testSuite, path_in_suite + (filename,),
+                                    localConfig)
+
+    def _ldflags(self, source):
+        with open(source) as f:
+            for line in f:
+                match = re.match(r'\s*//\s*LDFLAGS:(.*)$', line)
+                if match:
+                    return match.group(1).split()
+        return []
+
+    def _run(self, cmd):
+        out, err, exitCode = lit.util.executeCommand(cmd)
+        return out, err, exitCode, ' '.join(cmd)
+
+    def execute(self, test, litConfig):
+        source = test.getSourcePath()
+        inputs = os.path.join(os.path.dirname(source), 'Inputs')
+        tmp_base = test.getExecPath()
+        lit.util.mkdir_p(os.path.dirname(tmp_base))
+
+        objects = []
+        steps = []
+        for src, extra in ((source, []),
+                           (os.path.join(inputs, 'runtime.c'),
+                            ['-fno-builtin']),
+                           (os.path.join(inputs, 'crt0.s'), [])):
+            obj = '%s.%s.o' % (tmp_base, os.path.basename(src))
+            steps.append([self.clang] + self.cflags + extra +
+                         ['-c', src, '-o', obj])
+            objects.append(obj)
+
+        # Runtime pieces that the linker only pulls in on demand.
+        archive = tmp_base + '.runtime.a'
+        archive_objects = []
+        for src in (os.path.join(inputs, 'decompress.s'),):
+            obj = '%s.%s.o' % (tmp_base, os.path.basename(src))
+            steps.append([self.clang] + self.cflags + ['-c', src, '-o', obj])
+            archive_objects.append(obj)
+        if os.path.exists(archive):
+            os.remove(archive)
+        steps.append([self.ar, 'rc', archive] + archive_objects)
+
+        elf = tmp_base + '.elf'
+        steps.append([self.lld, '-T', os.path.join(inputs, 'link.ld'), '-o',
+                      elf] + self._ldflags(source) + objects + [archive])
+
+        for cmd in steps:
+            out, err, exitCode, cmdline = self._run(cmd)
+            if exitCode:
+                return lit.Test.Result(
+                    lit.Test.FAIL, '%s\n%s%s' % (cmdline, out, err))
+
+        out, err, exitCode, cmdline = self._run(
+            [self.sim, '-mcpu=' + self.mcpu, '-stats',
+             '-max-cycles=1000000000', elf])
+        if exitCode:
+            return lit.Test.Result(
+                lit.Test.FAIL, '%s\nexit status %d\n%s%s' %
+                (cmdline, exitCode, out, err))
+
+        result = lit.Test.Result(lit.Test.PASS, out + err)
+        for metric in ('cycles', 'bytes'):
+            match = re.search(r'^%s: (\d+)$' % metric, err, re.MULTILINE)
+            if match:
+                result.addMetric(metric,
+                                 lit.Test.IntMetricValue(int(match.group(1))))
+        return result
+
+
+tools_dir = lit_config.params.get('tools_dir')
+if not tools_dir:
+    lit_config.fatal('the MOS benchmarks require --param tools_dir=<dir>')
+
+config.name = 'MOS-Benchmarks'
+config.suffixes = ['.c']
+config.excludes = ['Inputs']
+config.test_source_root = os.path.dirname(__file__)
+config.test_format = MOSBenchmark(
+    tools_dir,
+    lit_config.params.get('cflags', '-Os'),
+    lit_config.params.get('mcpu', 'mos6502'))
@@ -0,0 +1,25 @@
+// Byte selects on comparison results: clamping, min/max and flag counting.
+
+static unsigned char buf[256];
+
+static unsigned char clamp(unsigned char x, unsigned char lo,
+                           unsigned char hi) {
+  x = x < lo ? lo : x;
+  return x > hi ? hi : x;
+}
+
+int main(void) {
+  for (unsigned i = 0; i < sizeof(buf); ++i)
+    buf[i] = i * 37;
+
+  unsigned sum = 0;
+  unsigned char lo = 0xff, hi = 0, count = 0;
+  for (unsigned i = 0; i < sizeof(buf); ++i) {
+    unsigned char x = buf[i];
+    sum += clamp(x, 0x20, 0xe0);
+    lo = x < lo ? x : lo;
+    hi = x > hi ? x : hi;
+    count += x >= 0x80 ? 1 : 0;
+  }
+  return sum != 0x7FA0 || lo != 0 || hi != 0xff || count != 128;
+}
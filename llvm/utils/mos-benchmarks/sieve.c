@@ -0,0 +1,17 @@
+// Sieve of Eratosthenes over the first 2048 integers.
+
+#define N 2048
+
+static char composite[N];
+
+int main(void) {
+  unsigned count = 0;
+  for (unsigned i = 2; i < N; ++i) {
+    if (composite[i])
+      continue;
+    ++count;
+    for (unsigned j = i + i; j < N; j += i)
+      composite[j] = 1;
+  }
+  return count != 309;
+}
@@ -0,0 +1,26 @@
+// Insertion sort of 128 16-bit values from a linear congruential generator.
+
+#define N 128
+
+static unsigned values[N];
+
+int main(void) {
+  unsigned x = 1;
+  for (unsigned char i = 0; i < N; ++i) {
+    x = (x << 2) + x + 13;
+    values[i] = x;
+  }
+
+  for (unsigned char i = 1; i < N; ++i) {
+    unsigned v = values[i];
+    unsigned char j = i;
+    for (; j > 0 && values[j - 1] > v; --j)
+      values[j] = values[j - 1];
+    values[j] = v;
+  }
+
+  for (unsigned char i = 1; i < N; ++i)
+    if (values[i - 1] > values[i])
+      return 1;
+  return 0;
+}